@@ -2,9 +2,12 @@
 
 #include <cmath>
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <sentinel/window.hpp>
 #include <sentutil/all.hpp>
@@ -17,6 +20,7 @@ namespace {
 std::unique_ptr<blamtracer::thread_pool> thread_pool;
 float                    fovy         = 0.94247779607694f; // 54 degrees
 float                    ray_distance = 4.0f;
+bool                     native_rays  = false; ///< Trace the structure without the game.
 blamtracer::Renderer     current_renderer;
 blamtracer::RenderResult sample_renderer(LPDIRECT3DSURFACE9 pSurface);
 
@@ -44,6 +48,12 @@ bool Load()
             if (value) ray_distance = std::max(value.value(), 0.0f);
             return ray_distance;
         }, "changes the maximum distance at which rays may be cast"
+    ) && sentutil::script::install_script_function<"sentinel_raytracer_native">(
+        +[] (std::optional<bool> enable) -> bool
+        {
+            if (enable) native_rays = enable.value();
+            return native_rays;
+        }, "toggles tracing only the structure, without calling into the game for each ray"
     ) && sentutil::script::install_script_function<"sentinel_raytracer_threads"> (
         +[] (short threads)
         {
@@ -132,6 +142,7 @@ constexpr color operator*(float f, const color& c)
 }
 
 color get_color(std::optional<sentinel::identity<sentinel::object>> source_object,
+                const sentinel::tags::collision_bsp* collision_bsp,
                 const sentinel::affine_matrix3d& camera,
                 const projective_settings& settings,
                 float x, float y)
@@ -156,6 +167,15 @@ color get_color(std::optional<sentinel::identity<sentinel::object>> source_objec
 
     const sentinel::real3d ray_direction = normalized(camera.ortho_transform * sentinel::real3d{near_plane, -x, y});
 
+    if (collision_bsp) {
+        if (auto result = sentutil::collision::test_segment(*collision_bsp, camera.translation, ray_distance * ray_direction)) {
+            const float perp = std::max(0.5f, std::abs(dot(result.value().plane.normal, camera.ortho_transform[0])));
+            return perp * hit_environment;
+        }
+
+        return no_hit;
+    }
+
     if (auto result = sentutil::raycast::cast_projectile_ray(camera.translation, ray_distance * ray_direction, source_object.value_or(sentinel::invalid_identity))) {
         const sentinel::raycast_result_type& hit_result = result.value();
         const float perp = std::max(0.5f, std::abs(dot(hit_result.plane.normal, camera.ortho_transform[0])));
@@ -175,28 +195,68 @@ namespace job_info {
 
 std::uint8_t*                        bytes = nullptr;
 sentinel::identity<sentinel::object> source_object = sentinel::invalid_identity;
+const sentinel::tags::collision_bsp* collision_bsp = nullptr; ///< Traced natively if not null.
 sentinel::affine_matrix3d            camera;
 projective_settings                  settings = {fovy, 800, 600};
-std::atomic<long>                    row   = 0L;
 long                                 width = 0L;
+long                                 height = 0L;
 DWORD                                pitch = 0L;
 constexpr int                        stride = 4;
 
-void process_next_row()
+// The image is traced in square tiles, which are dispatched in Morton order so that
+// neighbouring rays, and so the BSP nodes they visit, are traced together.
+constexpr long             tile_size = 16;
+std::vector<std::uint32_t> tile_order; ///< Tile coordinates, `x | (y << 16)`.
+long                       tiles_x = 0L;
+long                       tiles_y = 0L;
+
+/** \brief Spreads the low 16 bits of \a v to the even bits of the result.
+ */
+constexpr std::uint32_t spread_bits(std::uint32_t v)
+{
+    v &= 0x0000FFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+/** \brief Rebuilds #tile_order if the image is not covered by #tiles_x by #tiles_y tiles.
+ */
+void update_tile_order()
 {
-    long job_col = 0L;
-    const long job_row = row.fetch_add(1L, std::memory_order_acquire);
-    std::uint8_t* job_bytes = bytes + job_row * pitch + job_col * stride;
+    const long columns = (width + tile_size - 1) / tile_size;
+    const long rows    = (height + tile_size - 1) / tile_size;
+    if (columns == tiles_x && rows == tiles_y)
+        return;
+
+    tiles_x = columns;
+    tiles_y = rows;
+    tile_order.clear();
+    for (long y = 0; y < rows; ++y) {
+        for (long x = 0; x < columns; ++x)
+            tile_order.push_back(static_cast<std::uint32_t>(x) | (static_cast<std::uint32_t>(y) << 16));
+    }
 
-    float screen_x = 0.5f;
+    auto morton = [] (std::uint32_t tile) { return spread_bits(tile) | (spread_bits(tile >> 16) << 1); };
+    std::sort(tile_order.begin(), tile_order.end(),
+              [morton] (std::uint32_t a, std::uint32_t b) { return morton(a) < morton(b); });
+}
+
+void process_span(long job_row, long first_col, long last_col)
+{
+    std::uint8_t* job_bytes = bytes + job_row * pitch + first_col * stride;
+
+    float screen_x = 0.5f + first_col;
     const float screen_y = 0.5f + job_row;
-    for (long job_col = 0L, end = width; job_col < end; ++job_col, job_bytes += stride, screen_x += 1.0f) {
+    for (long job_col = first_col, end = last_col; job_col < end; ++job_col, job_bytes += stride, screen_x += 1.0f) {
         std::uint8_t& blue = job_bytes[0];
         std::uint8_t& green = job_bytes[1];
         std::uint8_t& red = job_bytes[2];
         std::uint8_t& alpha = job_bytes[3];
 
-        color&& pixel = get_color(source_object, camera, settings, screen_x, screen_y);
+        color&& pixel = get_color(source_object, collision_bsp, camera, settings, screen_x, screen_y);
 
         blue = pixel.blue;
         green = pixel.green;
@@ -205,12 +265,23 @@ void process_next_row()
     }
 }
 
+void process_tile(std::uint32_t tile)
+{
+    const long first_col = static_cast<long>(tile & 0xFFFFu) * tile_size;
+    const long first_row = static_cast<long>(tile >> 16) * tile_size;
+    const long last_col  = std::min(first_col + tile_size, width);
+    const long last_row  = std::min(first_row + tile_size, height);
+    for (long job_row = first_row; job_row < last_row; ++job_row)
+        process_span(job_row, first_col, last_col);
+}
+
 void process_image(std::uint8_t* pImage, const D3DSURFACE_DESC& desc, DWORD imagePitch)
 {
     const auto& camera_globals = *sentutil::globals::camera_globals;
 
     bytes = pImage;
     source_object = sentinel_GetLocalPlayerUnit();
+    collision_bsp = native_rays ? sentutil::globals::map_globals->collision_bsp : nullptr;
     camera = sentinel::affine_matrix3d{
         1.0f,
         {
@@ -222,14 +293,16 @@ void process_image(std::uint8_t* pImage, const D3DSURFACE_DESC& desc, DWORD imag
     };
     settings = projective_settings(fovy, desc.Width, desc.Height);
     width = desc.Width;
+    height = desc.Height;
     pitch = imagePitch;
-    row.store(0L, std::memory_order_release);
+    update_tile_order();
 
     if (!thread_pool)
         thread_pool = std::make_unique<blamtracer::thread_pool>(1);
-    thread_pool->push_tasks(desc.Height, [] (...) { return process_next_row; }).join();
-    //for (auto rows_left = desc.Height; rows_left; --rows_left)
-    //  process_next_row();
+    thread_pool->parallel_for(0, tile_order.size(), 1, [] (std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            process_tile(tile_order[i]);
+    });
 }
 
 }
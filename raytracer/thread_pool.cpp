@@ -1,114 +1,182 @@
 #include "thread_pool.hpp"
 
+#include <algorithm>
+
 namespace blamtracer {
 
 thread_pool::thread_pool(std::size_t thread_count)
-    : mutex()
+    : deques(std::max(std::size_t(1), thread_count) + 1)
+    , remaining(ATOMIC_VAR_INIT(static_cast<std::size_t>(0)))
+    , epoch(ATOMIC_VAR_INIT(0u))
+    , active(ATOMIC_VAR_INIT(false))
     , do_stop(ATOMIC_VAR_INIT(false))
-    , tasks_cv()
-    , tasks()
-    , idle_count(ATOMIC_VAR_INIT(static_cast<std::size_t>(0)))
-    , fully_idle_cv()
     , workers()
 {
     thread_count = std::max(std::size_t(1), thread_count);
     workers.reserve(thread_count);
 
-    for (; thread_count; --thread_count)
-        workers.emplace_back(worker_implementation, std::ref(*this));
+    for (std::size_t index = 0; index < thread_count; ++index)
+        workers.emplace_back(worker_implementation, std::ref(*this), index);
 }
 
-thread_pool& thread_pool::push_task(task_type task)
+void thread_pool::shutdown()
 {
     {
-        std::unique_lock lk(mutex);
-        tasks.push(std::move(task));
+        std::lock_guard lk(park_mutex);
+        do_stop.store(true, std::memory_order_relaxed);
     }
-    tasks_cv.notify_one();
-    return *this;
+    park_cv.notify_all();
+    for (auto& thread : workers)
+        thread.join();
+    workers.clear();
 }
 
-thread_pool& thread_pool::push_tasks(std::size_t n, std::function<task_type()> generator)
+void thread_pool::run(const job_type& job_, std::size_t first, std::size_t last)
 {
+    if (first >= last)
+        return;
+
+    std::lock_guard submit_lk(submit_mutex);
+    job = &job_;
+    remaining.store(last - first, std::memory_order_relaxed);
+
+    const std::size_t index = workers.size(); // the caller's deque
+    deques[index].push(first, last);
     {
-        std::unique_lock lk(mutex);
-        for (; n; --n)
-            tasks.push(generator());
+        std::lock_guard lk(park_mutex);
+        active.store(true, std::memory_order_release);
+        epoch.fetch_add(1, std::memory_order_relaxed);
     }
-    tasks_cv.notify_all();
-    return *this;
+    park_cv.notify_all();
+
+    unsigned seed = 0x9E3779B9u;
+    std::size_t begin, end;
+    while (remaining.load(std::memory_order_acquire) != 0) {
+        if (find_work(index, seed, begin, end))
+            process(index, begin, end);
+        else
+            std::this_thread::yield();
+    }
+
+    active.store(false, std::memory_order_relaxed);
+    job = nullptr;
 }
 
-void thread_pool::join()
+void thread_pool::process(std::size_t index, std::size_t begin, std::size_t end)
 {
-    std::unique_lock lk(mutex);
-    fully_idle_cv.wait(lk, [this] { return tasks.empty() && is_idle(); });
+    const job_type& current = *job;
+    while (end - begin > current.grain) {
+        const std::size_t middle = begin + (end - begin) / 2;
+        if (!deques[index].push(middle, end))
+            break; // the deque is full, so the rest is processed here
+        end = middle;
+    }
+
+    current.invoke(current.fn, begin, end);
+    remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
 }
 
-void thread_pool::shutdown()
+bool thread_pool::find_work(std::size_t index, unsigned& seed, std::size_t& begin, std::size_t& end)
 {
-    do_stop.store(true, std::memory_order_relaxed);
-    tasks_cv.notify_all();
-    for (auto& thread : workers)
-        thread.join();
-    workers.clear();
+    if (deques[index].pop(begin, end))
+        return true;
+
+    // victims are visited from a random deque onwards
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    const std::size_t count = deques.size();
+    for (std::size_t i = 0, victim = seed % count; i < count; ++i, victim = (victim + 1) % count) {
+        if (victim != index && deques[victim].steal(begin, end))
+            return true;
+    }
+
+    return false;
+}
+
+void thread_pool::worker_implementation(thread_pool& pool, std::size_t index)
+{
+    unsigned seed = 0x2545F491u * static_cast<unsigned>(index + 1);
+    std::size_t begin, end;
+
+    while (!pool.do_stop.load(std::memory_order_relaxed)) {
+        // the epoch is read before searching, so a range submitted after the search
+        // changes it and the worker does not park
+        const unsigned last_epoch = pool.epoch.load(std::memory_order_acquire);
+
+        bool found = false;
+        for (int spin = 0; spin < spin_count && !found; ++spin) {
+            found = pool.find_work(index, seed, begin, end);
+            if (!found)
+                std::this_thread::yield();
+        }
+
+        if (found) {
+            pool.process(index, begin, end);
+        } else if (!pool.active.load(std::memory_order_acquire)) {
+            std::unique_lock lk(pool.park_mutex);
+            pool.park_cv.wait(lk, [&] {
+                return pool.do_stop.load(std::memory_order_relaxed)
+                    || pool.epoch.load(std::memory_order_relaxed) != last_epoch;
+            });
+        }
+    }
 }
 
-bool thread_pool::is_idle() const noexcept
+bool thread_pool::range_deque::push(std::size_t begin, std::size_t end) noexcept
 {
-    return idle_count.load(std::memory_order_acquire) == workers.size();
+    const std::size_t b = bottom.load(std::memory_order_relaxed);
+    const std::size_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+        return false;
+
+    slot& s = slots[b % capacity];
+    s.begin.store(begin, std::memory_order_relaxed);
+    s.end.store(end, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
 }
 
-void thread_pool::worker_implementation(thread_pool& pool)
+bool thread_pool::range_deque::pop(std::size_t& begin, std::size_t& end) noexcept
 {
-    bool is_idle = false;
-    auto add_as_idle = [&pool, &is_idle] {
-        const bool added = !is_idle;
-        is_idle = true;
-        if (!added)
-            return;
-
-        const std::size_t amount_idle = added + pool.idle_count.fetch_add(added, std::memory_order_acq_rel);
-        if (amount_idle == pool.workers.size())
-            pool.fully_idle_cv.notify_all();
-    };
-
-    auto remove_from_idle = [&pool, &is_idle] {
-       const bool removed = is_idle;
-       is_idle = false;
-       pool.idle_count.fetch_sub(removed, std::memory_order_relaxed);
-    };
-
-    struct task_info {
-        bool stop_signal;
-        std::optional<task_type> task;
-
-        inline constexpr operator bool() const noexcept { return !stop_signal; }
-        inline constexpr void operator()() { if (task) task.value()(); }
-    };
-
-    auto get_task = [&] () -> task_info {
-        std::unique_lock lk(pool.mutex);
-        if (pool.tasks.empty())
-            add_as_idle();
-        pool.tasks_cv.wait(lk, [&] { return pool.do_stop.load(std::memory_order_relaxed) || !pool.tasks.empty(); });
-
-        if (pool.do_stop.load(std::memory_order_acq_rel)) {
-            add_as_idle();
-            return {true, std::nullopt};
-        } else if (pool.tasks.empty()) {
-            add_as_idle();
-            return {false, std::nullopt};
-        }
+    const std::size_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::size_t t = top.load(std::memory_order_relaxed);
+
+    if (static_cast<std::ptrdiff_t>(b - t) < 0) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
 
-        remove_from_idle();
-        task_type task = pool.tasks.front();
-        pool.tasks.pop();
-        return {false, std::move(task)};
-    };
+    const slot& s = slots[b % capacity];
+    begin = s.begin.load(std::memory_order_relaxed);
+    end   = s.end.load(std::memory_order_relaxed);
+    if (b != t)
+        return true;
+
+    // the last range, which a thief may be claiming
+    const bool won = top.compare_exchange_strong(t, t + 1,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+}
 
-    while (auto task = get_task())
-        task();
+bool thread_pool::range_deque::steal(std::size_t& begin, std::size_t& end) noexcept
+{
+    std::size_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::size_t b = bottom.load(std::memory_order_acquire);
+    if (static_cast<std::ptrdiff_t>(b - t) <= 0)
+        return false;
+
+    const slot& s = slots[t % capacity];
+    begin = s.begin.load(std::memory_order_relaxed);
+    end   = s.end.load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
 }
 
 } // namespace blamtracer
@@ -2,24 +2,31 @@
 
 #include <cstddef>
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
-#include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace blamtracer {
 
-/** \brief A collection of threads that splits the work of submitted tasks.
+/** \brief A collection of threads that splits the work of ranges submitted through
+ *         #parallel_for.
+ *
+ * Each worker owns a deque of subranges, which it pushes and pops at the bottom while
+ * other workers steal from the top without locking (a Chase-Lev deque). A worker
+ * splits the range it takes in half until it is no larger than the grain, pushing the
+ * halves it does not process, so idle workers steal the largest pieces of work left.
+ *
+ * Workers that find no work spin for a while before parking until the next range is
+ * submitted.
  */
 class thread_pool {
 public:
-    /** \brief The unit of work submitted to the thread pool.
-     */
-    using task_type = std::function<void()>;
-
     /** \brief Constructs a thread pool with \a thread_count threads.
      */
     thread_pool(std::size_t thread_count);
@@ -30,9 +37,6 @@ public:
 
     /** \brief Signals the worker threads to stop and waits for them to finish
      *         execution before destroying pool resources.
-     *
-     * Claimed tasks will be finished, but unclaimed tasks may be unprocessed when
-     * this function returns.
      */
     ~thread_pool() noexcept { shutdown(); }
 
@@ -41,60 +45,93 @@ public:
     thread_pool& operator=(const thread_pool&) = delete; ///< DELETED
     thread_pool& operator=(thread_pool&&)      = delete; ///< DELETED
 
-    /** \brief Blocks the current thread until all tasks have been completed.
-     *
-     * When the calling thread returns from `join()`, all writes from the worker
-     * threads will be observed.
+    /** \brief Signals the worker threads to stop and blocks until they have exited.
      */
-    void join();
+    void shutdown();
 
-    /** \brief Signals the worker threads to stop and blocks the entire pool is idle.
+    /** \brief Invokes `fn(begin, end)` over subranges of `[first, last)` across the
+     *         pool, blocking until all of them have been processed.
      *
-     * Claimed tasks will be finished, but unclaimed tasks may be unprocessed when
-     * this function returns.
+     * Subranges are no larger than \a grain, except where a worker's deque is full.
+     * The calling thread processes subranges as well. Ranges are submitted one at a
+     * time, so concurrent calls are serialized.
      *
-     * Unlike `join()`, there is no guarantee on the order of memory writes that
-     * arrive from the worker threads when this function returns.
+     * When the calling thread returns, all writes from the invocations of \a fn will
+     * be observed.
      */
-    void shutdown();
+    template<class Function>
+    void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Function&& fn)
+    {
+        using function_type = std::remove_reference_t<Function>;
+        auto invoke = [] (const void* f, std::size_t begin, std::size_t end) {
+            (*static_cast<function_type*>(const_cast<void*>(f)))(begin, end);
+        };
+        run({invoke, std::addressof(fn), std::max<std::size_t>(grain, 1)}, first, last);
+    }
 
-    /** \brief Gives the thread pool a single task to complete.
-     *
-     * #push_task acquires a mutex to modify the task list. If the user is submitting
-     * more than one task at a time, it is recommended to use #push_tasks, which
-     * acquires the mutex only once when submitting the tasks.
-     *
-     * \return `*this`
+private:
+    /** \brief The function of a range, stored without allocating.
      */
-    thread_pool& push_task(task_type task);
+    struct job_type {
+        void (*invoke)(const void*, std::size_t, std::size_t);
+        const void* fn;    ///< The function object, owned by the caller of #parallel_for.
+        std::size_t grain;
+    };
 
-    /** \brief Submits \a n tasks as supplied by the expression `generator()`.
+    /** \brief A fixed-capacity Chase-Lev deque of subranges.
      *
-     * \return `*this`
+     * A range is stored as two atomics, which is safe as a thief only keeps what it read
+     * if its claim on the top succeeds, which the owner cannot overwrite before then.
      */
-    thread_pool& push_tasks(std::size_t n, std::function<task_type()> generator);
+    class range_deque {
+    public:
+        static constexpr std::size_t capacity = 64; ///< Enough for halving any range.
 
-    /** \brief Indicates if all the threads belonging to the thread pool are idle.
-     *
-     * \return `true` if and only if the entire thread pool is idle.
+        bool push(std::size_t begin, std::size_t end) noexcept;
+        bool pop(std::size_t& begin, std::size_t& end) noexcept;
+        bool steal(std::size_t& begin, std::size_t& end) noexcept;
+
+    private:
+        struct slot {
+            std::atomic<std::size_t> begin;
+            std::atomic<std::size_t> end;
+        };
+
+        alignas(64) std::atomic<std::size_t> top    = 0; ///< Indices wrap, so they are
+        alignas(64) std::atomic<std::size_t> bottom = 0; ///< compared by difference.
+        slot slots[capacity];
+    };
+
+    static constexpr int spin_count = 256; ///< The attempts to find work before parking.
+
+    void run(const job_type& job, std::size_t first, std::size_t last);
+
+    /** \brief Processes `[begin, end)` from the deque at \a index, pushing the halves
+     *         split off to that deque.
      */
-    bool is_idle() const noexcept;
+    void process(std::size_t index, std::size_t begin, std::size_t end);
 
-private:
-    static void worker_implementation(thread_pool& pool); ///< The entry point for
-                                                          ///< the worker threads.
-
-    std::mutex              mutex;    ///< The mutex for the condition variables
-                                      ///< and task list.
-    std::atomic<bool>       do_stop;  ///< An indicator for the threads to stop.
-    std::condition_variable tasks_cv; ///< A CV that is notified when there is a new
-                                      ///< task in #tasks.
-    std::queue<task_type>   tasks;    ///< The list of tasks to process.
-
-    std::atomic<std::size_t> idle_count;    ///< The number of threads that are in a
-                                            ///< waiting or finished state.
-    std::condition_variable  fully_idle_cv; ///< A CV that is notified when the last
-                                            ///< active thread becomes idle.
+    /** \brief Takes a subrange from the deque at \a index, or steals one from another.
+     */
+    bool find_work(std::size_t index, unsigned& seed, std::size_t& begin, std::size_t& end);
+
+    static void worker_implementation(thread_pool& pool, std::size_t index); ///< The entry
+                                                                             ///< point for the
+                                                                             ///< worker threads.
+
+    std::vector<range_deque> deques; ///< One per worker, then one for the caller.
+
+    const job_type*          job = nullptr; ///< The job of the range being processed.
+    std::atomic<std::size_t> remaining;     ///< The elements of the range left unprocessed.
+    std::mutex               submit_mutex;  ///< Serializes calls to #parallel_for.
+
+    std::mutex               park_mutex; ///< The mutex for #park_cv.
+    std::condition_variable  park_cv;    ///< A CV that is notified when a range is
+                                         ///< submitted or the pool stops.
+    std::atomic<unsigned>    epoch;      ///< Incremented under #park_mutex when a range
+                                         ///< is submitted, so no wakeup is missed.
+    std::atomic<bool>        active;     ///< A range is being processed.
+    std::atomic<bool>        do_stop;    ///< An indicator for the threads to stop.
 
     std::vector<std::thread> workers; ///< The collection of worker threads.
 };
@@ -34,7 +34,7 @@ struct collision_bsp {
     tag_block<surface> surfaces;
     tag_block<edge>    edges;
     tag_block<vertex>  vertices;
-}; static_assert(sizeof(collision_bsp) == 0x60);
+}; static_assert(sizeof(void*) != 4 || sizeof(collision_bsp) == 0x60);
 
 struct collision_bsp::bsp3d_node {
     /** \brief The index of the plane the node partitions.
@@ -15,6 +15,9 @@
 
 namespace sentinel { namespace tags {
 
+// The layouts of tag structures containing pointers are only asserted for the game's
+// 32-bit pointers, so that tools on other targets may still build tag data in memory.
+
 /** \brief Reference to another tag found internally in tag metadata. */
 template<class Tag>
 struct tag_reference {
@@ -36,7 +39,7 @@ struct tag_reference {
     template<class U = std::remove_cv_t<Tag>>
     std::enable_if_t<is_identity_dereferenceable_v<identity<U>>, pointer>
     operator->() const { return tag->operator->(); }
-}; static_assert(sizeof(tag_reference<void>) == 0x10);
+}; static_assert(sizeof(void*) != 4 || sizeof(tag_reference<void>) == 0x10);
 
 /** \brief Reference to an array of data found in tag metadata.
  *
@@ -77,7 +80,7 @@ struct tag_block {
         -> std::enable_if_t<!B, T> const& {
         return data[index];
     }
-}; static_assert(sizeof(tag_block<void>) == 0x0C);
+}; static_assert(sizeof(void*) != 4 || sizeof(tag_block<void>) == 0x0C);
 
 template<class T>
 struct tag_blob {
@@ -94,6 +97,6 @@ struct tag_blob {
     pointer operator*() const noexcept { return data; }
     pointer operator->() const noexcept { return data; }
     operator pointer() const noexcept { return data; }
-}; static_assert(sizeof(tag_blob<void>) == 0x14);
+}; static_assert(sizeof(void*) != 4 || sizeof(tag_blob<void>) == 0x14);
 
 } } // namespace sentinel::tags
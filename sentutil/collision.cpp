@@ -0,0 +1,179 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <sentutil/collision.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+using cbsp_type = sentinel::tags::collision_bsp;
+
+/** \brief The state of a segment test, as the segment is traversed through the BSP.
+ */
+struct segment_test {
+    const cbsp_type&     cbsp;
+    sentinel::position3d source;
+    sentinel::real3d     delta;
+
+    std::int32_t last_leaf   = -1;    ///< The last leaf the segment passed through.
+    std::int32_t entry_plane = 0;     ///< The plane last crossed, negative if reversed.
+    bool         has_entry   = false; ///< Whether or not a plane has been crossed.
+
+    sentutil::collision::bsp_hit hit = {};
+
+    /** \brief Traverses the part of the segment from \a t0 to \a t1 through the
+     *         subtree at \a node.
+     *
+     * \return `true` if the segment enters solid space, otherwise `false`.
+     */
+    bool traverse(std::int32_t node, sentinel::real t0, sentinel::real t1, std::size_t depth);
+
+    /** \brief Returns the surface of \a leaf on \a plane at \a point, or `-1`.
+     */
+    sentinel::index_long locate_surface(std::int32_t leaf,
+                                        std::int32_t plane,
+                                        const sentinel::position3d& point) const noexcept;
+};
+
+/** \brief Returns the plane with the index encoded in \a plane, reversed if \a plane
+ *         is negative.
+ */
+cbsp_type::plane get_plane(const cbsp_type& cbsp, std::int32_t plane) noexcept;
+
+} // namespace (anonymous)
+
+namespace sentutil { namespace collision {
+
+std::optional<bsp_hit>
+test_segment(const sentinel::tags::collision_bsp& cbsp,
+             const sentinel::position3d&          source,
+             const sentinel::real3d&              delta) noexcept
+{
+    if (cbsp.bsp3d_nodes.count <= 0)
+        return std::nullopt;
+
+    segment_test test{cbsp, source, delta};
+    if (!test.traverse(0, 0.0f, 1.0f, 0))
+        return std::nullopt;
+
+    return test.hit;
+}
+
+} } // namespace sentutil::collision
+
+namespace {
+
+bool segment_test::traverse(std::int32_t node,
+                            sentinel::real t0,
+                            sentinel::real t1,
+                            std::size_t depth)
+{
+    if (node < 0) {
+        if (node != -1) { // an empty leaf
+            last_leaf = node & 0x7FFFFFFF;
+            return false;
+        } else if (!has_entry) {
+            return false; // the segment starts in solid space
+        }
+
+        const cbsp_type::plane plane = get_plane(cbsp, entry_plane);
+        hit.fraction = t0;
+        hit.distance = t0 * norm(delta);
+        hit.point    = source + t0 * delta;
+        hit.plane    = plane;
+        hit.surface  = locate_surface(last_leaf, entry_plane, hit.point);
+        return true;
+    }
+
+    // the depth is bounded so that malformed trees cannot loop
+    if (depth >= static_cast<std::size_t>(cbsp.bsp3d_nodes.count) || node >= cbsp.bsp3d_nodes.count)
+        return false;
+
+    const cbsp_type::bsp3d_node& bsp_node = cbsp.bsp3d_nodes[node];
+    const cbsp_type::plane plane = get_plane(cbsp, bsp_node.plane);
+    const sentinel::real d0 = dot(plane.normal, source + t0 * delta) - plane.d;
+    const sentinel::real d1 = dot(plane.normal, source + t1 * delta) - plane.d;
+
+    if (d0 >= 0 && d1 >= 0)
+        return traverse(bsp_node.children[1], t0, t1, depth + 1);
+    else if (d0 < 0 && d1 < 0)
+        return traverse(bsp_node.children[0], t0, t1, depth + 1);
+
+    // the near side is traversed first, then the far side from the crossing
+    const int            near = d0 >= 0 ? 1 : 0;
+    const sentinel::real t    = t0 + (t1 - t0) * (d0 / (d0 - d1));
+    if (traverse(bsp_node.children[near], t0, t, depth + 1))
+        return true;
+
+    // the plane is recorded facing the near side, towards the source
+    const bool reversed = (bsp_node.plane < 0) != (near == 0);
+    entry_plane = reversed ? static_cast<std::int32_t>(bsp_node.plane | 0x80000000)
+                           : bsp_node.plane & 0x7FFFFFFF;
+    has_entry   = true;
+    return traverse(bsp_node.children[1 - near], t, t1, depth + 1);
+}
+
+sentinel::index_long segment_test::locate_surface(std::int32_t leaf,
+                                                  std::int32_t plane,
+                                                  const sentinel::position3d& point) const noexcept
+{
+    if (leaf < 0 || leaf >= cbsp.leaves.count)
+        return -1;
+
+    const cbsp_type::leaf& bsp_leaf = cbsp.leaves[leaf];
+    const std::int32_t first = bsp_leaf.first_bsp2d_reference;
+    const std::int32_t last  = first + bsp_leaf.bsp2d_reference_count;
+    for (std::int32_t r = first; r < last; ++r) {
+        if (r < 0 || r >= cbsp.bsp2d_references.count)
+            break;
+
+        const cbsp_type::bsp2d_reference& reference = cbsp.bsp2d_references[r];
+        if ((reference.plane & 0x7FFFFFFF) != (plane & 0x7FFFFFFF))
+            continue;
+
+        // project onto the coordinate plane most parallel to the reference plane,
+        // preserving the winding of surfaces that face along its normal
+        const sentinel::direction3d normal = get_plane(cbsp, reference.plane).normal;
+        int axis = 0;
+        for (int i = 1; i < 3; ++i) {
+            if (std::abs(normal[i]) > std::abs(normal[axis]))
+                axis = i;
+        }
+
+        const int u = normal[axis] > 0 ? (axis + 1) % 3 : (axis + 2) % 3;
+        const int v = normal[axis] > 0 ? (axis + 2) % 3 : (axis + 1) % 3;
+
+        std::int32_t node = reference.bsp2d_node;
+        for (std::int32_t depth = 0; node >= 0; ++depth) {
+            if (depth >= cbsp.bsp2d_nodes.count || node >= cbsp.bsp2d_nodes.count)
+                return -1;
+
+            const cbsp_type::bsp2d_node& bsp_node = cbsp.bsp2d_nodes[node];
+            node = bsp_node.children[bsp_node.plane.normal[0] * point[u]
+                                     + bsp_node.plane.normal[1] * point[v] >= bsp_node.plane.d];
+        }
+
+        return node == -1 ? -1 : node & 0x7FFFFFFF;
+    }
+
+    return -1;
+}
+
+cbsp_type::plane get_plane(const cbsp_type& cbsp, std::int32_t plane) noexcept
+{
+    cbsp_type::plane result = cbsp.planes[plane & 0x7FFFFFFF];
+    if (plane < 0) {
+        result.normal = -result.normal;
+        result.d      = -result.d;
+    }
+
+    return result;
+}
+
+} // namespace (anonymous)
@@ -10,6 +10,7 @@
 #include <sentinel/all.hpp>
 
 #include <sentutil/chat.hpp>
+#include <sentutil/collision.hpp>
 #include <sentutil/color.hpp>
 #include <sentutil/console.hpp>
 #include <sentutil/constants.hpp>
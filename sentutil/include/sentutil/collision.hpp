@@ -0,0 +1,57 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <optional>
+
+#include <sentinel/types.hpp>
+#include <sentinel/tags/collision_bsp.hpp>
+
+namespace sentutil { namespace collision {
+
+/** \brief Describes where a segment enters the solid space of a collision BSP.
+ */
+struct bsp_hit {
+    sentinel::real       fraction; ///< The fraction of the segment before the hit.
+    sentinel::real       distance; ///< The distance along the segment before the hit.
+    sentinel::position3d point;    ///< The point of intersection.
+
+    /** \brief The plane that was hit, with its normal facing the source of the segment.
+     */
+    sentinel::tags::collision_bsp::plane plane;
+
+    /** \brief The index of the surface that was hit, or `-1` if the surface could
+     *         not be determined.
+     */
+    sentinel::index_long surface;
+};
+
+/** \brief Tests a segment from a position across a delta against the structure of
+ *         a collision BSP.
+ *
+ * Unlike sentutil::raycast::cast_ray, this does not call into the game, does not
+ * test objects or water and does not modify any state, so it may be called from
+ * any number of threads for as long as \a cbsp remains loaded.
+ *
+ * The segment is traversed through the 3D BSP, front to back, until it enters
+ * solid space. The surface that was hit is then located through the 2D BSP of
+ * the last leaf the segment passed through. Solid space that the segment starts
+ * in is passed through.
+ *
+ * \param[in] cbsp   The collision BSP to test against.
+ * \param[in] source The starting position of the segment.
+ * \param[in] delta  The translation to move the segment through.
+ *
+ * \return A `std::optional` containing the intersection information if the segment
+ *         intersected the structure, otherwise an empty `std::optional`.
+ */
+std::optional<bsp_hit>
+test_segment(const sentinel::tags::collision_bsp& cbsp,
+             const sentinel::position3d&          source,
+             const sentinel::real3d&              delta) noexcept;
+
+} } // namespace sentutil::collision
@@ -0,0 +1,477 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace simulacrum {
+
+/** \brief A path planner over a #navigation_graph that works within a time budget,
+ *         resuming its search across calls.
+ *
+ * The planner runs a weighted A* search, with the heuristic inflated by a weight that
+ * starts at #initial_weight. Each time the goal is reached, the path found is kept
+ * and the search restarts with the weight lowered by #weight_step, until a search
+ * with a weight of `1` finds a shortest path. A path found with weight `w` is at
+ * most `w` times the length of the shortest path, so paths improve the longer the
+ * planner runs.
+ *
+ * Until the first path is found, the best partial path is that to the vertex
+ * expanded so far that is nearest the goal by the heuristic.
+ *
+ * A moving target seldom stays on one vertex for long, so a goal that moves by at
+ * most #retarget_distance does not discard the planning so far. The path found is
+ * kept where it still reaches the new goal, or else followed as a partial path, and
+ * the search in progress is retargeted rather than restarted. Distances from the
+ * start do not depend on the goal, so only the frontier is keyed anew; a retargeted
+ * search bounds nothing, so its path is not counted towards lowering the weight.
+ * Likewise, a start that moves onto or next to the path followed keeps that path.
+ *
+ * The clock is read every #expansions_per_clock_check expansions and every
+ * #rekeys_per_clock_check steps of keying the frontier anew, so a call to #improve
+ * overruns its budget by at most that much work. A frontier too large to key anew
+ * within one call is keyed over as many calls as it takes, before the search resumes.
+ */
+class anytime_planner {
+public:
+    using graph_type   = navigation_graph::graph_type;
+    using vertex_index = graph_type::vertex_index;
+    using size_type    = std::size_t;
+    using clock        = std::chrono::steady_clock;
+
+    static constexpr vertex_index no_vertex = static_cast<vertex_index>(-1);
+
+    static constexpr float     initial_weight    = 3.0f;
+    static constexpr float     weight_step       = 0.5f;
+    static constexpr float     retarget_distance = 2.0f; ///< In world units.
+    static constexpr size_type expansions_per_clock_check = 32;
+    static constexpr size_type rekeys_per_clock_check     = 128;
+
+    /** \brief Returns the graph the planner is bound to, or `nullptr` if unbound.
+     */
+    const graph_type* get_graph() const noexcept { return graph; }
+
+    /** \brief Discards all search state and binds the planner to \a graph_.
+     */
+    void reset(const graph_type& graph_)
+    {
+        graph = std::addressof(graph_);
+        start = goal = no_vertex;
+        restart();
+    }
+
+    /** \brief Sets the start and goal vertices.
+     *
+     * If the start moves onto or next to the path followed, the path is kept from the
+     * new start onwards. If the goal moves by at most #retarget_distance, the planning
+     * is retargeted by the next call to #improve. Otherwise the planning starts over.
+     */
+    void set_query(vertex_index start_, vertex_index goal_)
+    {
+        if (start_ == start && goal_ == goal)
+            return;
+
+        const bool goal_kept = goal_ == goal
+            || (goal != no_vertex
+                && norm(graph->node(goal_).point - graph->node(goal).point) <= retarget_distance);
+        if (!goal_kept) {
+            start = start_;
+            goal  = goal_;
+            restart();
+            return;
+        }
+
+        if (start_ != start) {
+            if (!rejoin_path(start_)) {
+                start = start_;
+                goal  = goal_;
+                restart();
+                return;
+            }
+
+            start     = start_;
+            searching = false; // the search is rooted at the previous start
+            rekeying  = false;
+        }
+
+        if (goal_ != goal) {
+            goal        = goal_;
+            retargeting = true;
+        }
+    }
+
+    /** \brief Discards the paths found, for when edge costs have changed.
+     */
+    void invalidate() noexcept { restart(); }
+
+    /** \brief Returns `true` if a path to the goal is known.
+     */
+    bool has_path() const noexcept { return solved; }
+
+    /** \brief Returns `true` if the path known is a shortest path.
+     */
+    bool is_converged() const noexcept { return converged; }
+
+    /** \brief Returns the bound on the length of the path known relative to the
+     *         shortest path, or infinity if no path is known or the path known was
+     *         kept through a move of the goal.
+     */
+    float path_bound() const noexcept { return solved ? solution_weight : std::numeric_limits<float>::infinity(); }
+
+    /** \brief Continues planning for at most \a budget.
+     *
+     * \param[in] heuristic Invoked as `heuristic(node, goal_node)`.
+     * \param[in] cost      Invoked as `cost(node, node, edge)`, returns an infinite
+     *                      distance for untraversable edges.
+     * \return `true` if a path to the goal is known, otherwise `false`.
+     */
+    template<class Heuristic, class Cost>
+    bool improve(clock::duration budget, const Heuristic& heuristic, const Cost& cost)
+    {
+        if (!graph || start == no_vertex || goal == no_vertex)
+            return solved;
+
+        const clock::time_point deadline = clock::now() + budget;
+        if (rejoining) {
+            rejoining = false;
+            const std::vector<vertex_index>& path = solved ? solution : partial;
+            if (path.empty() || !traversable(start, path.front(), cost))
+                restart();
+        }
+        if (retargeting)
+            retarget(heuristic, cost);
+        if (converged || exhausted)
+            return solved;
+        if (rekeying && !continue_rekey(deadline, heuristic))
+            return solved;
+
+        const navigation_graph_node& goal_node = graph->node(goal);
+        auto& frontier = workspace.frontier;
+
+        if (!searching)
+            begin_search(heuristic);
+
+        for (size_type expansions = 0; ; ++expansions) {
+            if (expansions % expansions_per_clock_check == 0 && clock::now() >= deadline)
+                break;
+
+            if (frontier.empty()) {
+                // no path at this weight means no path at any weight
+                searching = false;
+                exhausted = !solved;
+                converged = solved && bounded;
+                break;
+            }
+
+            const vertex_index vertex = frontier.top().vertex;
+            frontier.pop();
+            workspace.close(vertex);
+
+            if (vertex == goal) {
+                store_path(goal, solution);
+                solved          = true;
+                solution_weight = bounded ? weight : std::numeric_limits<float>::infinity();
+                if (bounded && weight <= 1.0f) {
+                    converged = true;
+                    searching = false;
+                    break;
+                }
+
+                if (bounded)
+                    weight = std::max(1.0f, weight - weight_step);
+                begin_search(heuristic);
+                continue;
+            }
+
+            const navigation_graph_node& node = graph->node(vertex);
+            const float distance  = workspace.distance(vertex);
+            const float estimate  = heuristic(node, goal_node);
+            if (estimate < nearest_estimate) {
+                nearest          = vertex;
+                nearest_estimate = estimate;
+            }
+
+            for (const graph_type::edge_type& edge : graph->egress_edges(vertex)) {
+                if (workspace.expanded(edge.target))
+                    continue;
+
+                const navigation_graph_node& target = graph->node(edge.target);
+                const float edge_cost = cost(node, target, edge);
+                if (!(edge_cost < std::numeric_limits<float>::infinity()))
+                    continue;
+
+                const float target_distance = distance + edge_cost;
+                if (workspace.relax(edge.target, vertex, target_distance))
+                    frontier.push_or_update(edge.target, target_distance + weight * heuristic(target, goal_node));
+            }
+        }
+
+        if (!solved && nearest != no_vertex && nearest_estimate < partial_estimate) {
+            store_path(nearest, partial);
+            partial_estimate = nearest_estimate;
+        }
+        return solved;
+    }
+
+    /** \brief Follows the path found from the start vertex towards the goal, or the best
+     *         partial path if no path to the goal is known.
+     *
+     * \param[in]  max_count The maximum number of vertices to follow.
+     * \param[out] out       The output iterator receiving the vertex indices on the
+     *                       path, excluding the start vertex.
+     * \return The number of vertices written to \a out.
+     */
+    template<class OutputIt>
+    size_type get_path(size_type max_count, OutputIt out) const
+    {
+        const std::vector<vertex_index>& path = solved ? solution : partial;
+        const size_type count = std::min(max_count, path.size());
+        std::copy(path.begin(), path.begin() + count, out);
+        return count;
+    }
+
+private:
+    const graph_type* graph = nullptr;
+
+    vertex_index start = no_vertex;
+    vertex_index goal  = no_vertex;
+
+    float weight      = initial_weight; ///< The weight of the current search.
+    bool  searching   = false;          ///< The current search is in progress.
+    bool  bounded     = false;          ///< The current search bounds its path by #weight.
+    bool  retargeting = false;          ///< The goal moved since the last call to #improve.
+    bool  rekeying    = false;          ///< The frontier is being keyed for the goal.
+    bool  rejoining   = false;          ///< The start moved next to the path followed.
+    bool  solved      = false;          ///< #solution holds a path to the goal.
+    bool  converged   = false;          ///< #solution holds a shortest path.
+    bool  exhausted   = false;          ///< The goal is unreachable.
+
+    std::vector<vertex_index> solution;        ///< The best path to the goal.
+    float                     solution_weight; ///< The weight #solution was found with.
+
+    vertex_index              nearest = no_vertex; ///< The expanded vertex nearest the goal.
+    float                     nearest_estimate;
+    std::vector<vertex_index> partial;             ///< The best partial path.
+    float                     partial_estimate;    ///< The estimated distance from the
+                                                   ///< end of #partial to the goal.
+
+    size_type rekey_step = 0; ///< The next step of keying the frontier anew.
+
+    astar_workspace<float> workspace;
+
+    void restart() noexcept
+    {
+        weight    = initial_weight;
+        searching = solved = converged = exhausted = retargeting = rekeying = rejoining = false;
+        nearest   = no_vertex;
+        solution.clear();
+        partial.clear();
+        partial_estimate = std::numeric_limits<float>::infinity();
+
+        if (start != no_vertex && start == goal) {
+            solved = converged = true;
+            solution_weight    = 1.0f;
+        }
+    }
+
+    template<class Heuristic>
+    void begin_search(const Heuristic& heuristic)
+    {
+        const float estimate = heuristic(graph->node(start), graph->node(goal));
+        workspace.begin_search(graph->size());
+        workspace.relax(start, start, 0.0f);
+        workspace.frontier.push_or_update(start, weight * estimate);
+
+        searching        = true;
+        bounded          = true;
+        rekeying         = false;
+        nearest          = start;
+        nearest_estimate = estimate;
+    }
+
+    /** \brief Carries the planning over to the goal set by #set_query.
+     */
+    template<class Heuristic, class Cost>
+    void retarget(const Heuristic& heuristic, const Cost& cost)
+    {
+        retargeting = false;
+        converged   = exhausted = false;
+        if (start == goal) {
+            solution.clear();
+            solved = converged = true;
+            solution_weight    = 1.0f;
+            searching          = false;
+            return;
+        }
+
+        // the path is kept up to the new goal or extended to it where it can be,
+        // otherwise it leads towards the previous goal and is only a partial path
+        if (solved) {
+            solution_weight = std::numeric_limits<float>::infinity();
+            auto it = std::find(solution.begin(), solution.end(), goal);
+            if (it != solution.end()) {
+                solution.erase(std::next(it), solution.end());
+            } else if (!extend_to_goal(solution, cost)) {
+                partial.swap(solution);
+                solution.clear();
+                solved = false;
+            }
+        }
+
+        const navigation_graph_node& goal_node = graph->node(goal);
+        partial_estimate = heuristic(graph->node(partial.empty() ? start : partial.back()),
+                                     goal_node);
+
+        if (!searching) {
+            weight = initial_weight;
+            return;
+        }
+
+        bounded = false;
+        if (workspace.expanded(goal)) {
+            store_path(goal, solution);
+            solved          = true;
+            solution_weight = std::numeric_limits<float>::infinity();
+            begin_search(heuristic);
+            return;
+        }
+
+        // a frontier still being keyed for an earlier goal is keyed on for this one; the
+        // entries keyed already are only ordered for the earlier goal, which bounds nothing
+        if (!rekeying) {
+            rekeying   = true;
+            rekey_step = 0;
+        }
+        nearest          = start;
+        nearest_estimate = heuristic(graph->node(start), goal_node);
+    }
+
+    /** \brief Continues keying the frontier for the goal until \a deadline.
+     *
+     * \return `true` if the frontier is keyed, otherwise `false`.
+     */
+    template<class Heuristic>
+    bool continue_rekey(clock::time_point deadline, const Heuristic& heuristic)
+    {
+        auto& frontier = workspace.frontier;
+        const navigation_graph_node& goal_node = graph->node(goal);
+        auto key_of = [this, &heuristic, &goal_node] (vertex_index vertex) {
+            return workspace.distance(vertex) + weight * heuristic(graph->node(vertex), goal_node);
+        };
+
+        const size_type steps = frontier.rekey_steps();
+        while (rekey_step < steps) {
+            if (clock::now() >= deadline)
+                return false;
+
+            const size_type last = std::min(steps, rekey_step + rekeys_per_clock_check);
+            frontier.rekey(rekey_step, last, key_of);
+            rekey_step = last;
+        }
+
+        rekeying = false;
+        return true;
+    }
+
+    /** \brief Keeps the part of the path followed that leads on from \a start_, the new
+     *         start vertex.
+     *
+     * If \a start_ is on the path, the path is kept after it. Otherwise the path is kept
+     * from the vertex furthest along it, counting the previous start, that an edge leads
+     * to from \a start_. That edge is checked by the next call to #improve.
+     *
+     * \return `true` if the path was kept, otherwise `false`.
+     */
+    bool rejoin_path(vertex_index start_)
+    {
+        std::vector<vertex_index>& path = solved ? solution : partial;
+        auto it = std::find(path.begin(), path.end(), start_);
+        if (it != path.end()) {
+            path.erase(path.begin(), std::next(it));
+            rejoining = false;
+            return true;
+        }
+
+        if (start == no_vertex || (!solved && path.empty()))
+            return false;
+
+        // positions count from the previous start, which is at 0
+        std::ptrdiff_t furthest = -1;
+        for (const graph_type::edge_type& edge : graph->egress_edges(start_)) {
+            if (edge.target == start) {
+                furthest = std::max<std::ptrdiff_t>(furthest, 0);
+                continue;
+            }
+
+            auto on_path = std::find(path.begin(), path.end(), edge.target);
+            if (on_path != path.end())
+                furthest = std::max(furthest, std::distance(path.begin(), on_path) + 1);
+        }
+
+        if (furthest < 0)
+            return false;
+        if (furthest == 0)
+            path.insert(path.begin(), start);
+        else
+            path.erase(path.begin(), path.begin() + (furthest - 1));
+
+        if (solved)
+            solution_weight = std::numeric_limits<float>::infinity();
+        rejoining = true;
+        return true;
+    }
+
+    /** \brief Appends the goal to \a path if an edge leads to it from the end of
+     *         \a path.
+     *
+     * \return `true` if \a path now leads to the goal, otherwise `false`.
+     */
+    template<class Cost>
+    bool extend_to_goal(std::vector<vertex_index>& path, const Cost& cost) const
+    {
+        if (!traversable(path.empty() ? start : path.back(), goal, cost))
+            return false;
+
+        path.push_back(goal);
+        return true;
+    }
+
+    /** \brief Returns `true` if a traversable edge leads from \a from to \a to,
+     *         otherwise `false`.
+     */
+    template<class Cost>
+    bool traversable(vertex_index from, vertex_index to, const Cost& cost) const
+    {
+        for (const graph_type::edge_type& edge : graph->egress_edges(from)) {
+            if (edge.target == to
+                && cost(graph->node(from), graph->node(to), edge) < std::numeric_limits<float>::infinity())
+                return true;
+        }
+        return false;
+    }
+
+    /** \brief Stores the path from the start vertex to \a vertex in the current search
+     *         to \a path, excluding the start vertex.
+     */
+    void store_path(vertex_index vertex, std::vector<vertex_index>& path) const
+    {
+        path.clear();
+        for (; vertex != start; vertex = workspace.predecessor(vertex))
+            path.push_back(vertex);
+        std::reverse(path.begin(), path.end());
+    }
+};
+
+} // namespace simulacrum
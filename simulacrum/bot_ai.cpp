@@ -5,13 +5,32 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "bot_ai.hpp"
+#include "anytime_planner.hpp"
 #include "bot_control.hpp"
+#include "distance_field.hpp"
 #include "game_context.hpp"
 #include "graph.hpp"
+#include "hierarchy.hpp"
+#include "landmarks.hpp"
+#include "marker_cache.hpp"
+#include "math.hpp"
+#include "obstacles.hpp"
+#include "perf.hpp"
+#include "target_scoring.hpp"
+#include "visibility.hpp"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
 
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/geometries.hpp>
@@ -21,7 +40,169 @@
 
 namespace {
 
-simulacrum::navigation_graph nav_graph;
+/** \brief The navigation structures for a map, which are built together off the game
+ *         thread and published once complete.
+ *
+ * The hierarchy and landmarks refer to #graph, so states are never moved or copied.
+ */
+struct navigation_state {
+    navigation_state(simulacrum::utility::compiled_cbsp&& geometry_,
+                     simulacrum::navigation_graph&& graph_,
+                     const sentinel::tags::collision_bsp& cbsp);
+
+    navigation_state(const navigation_state&) = delete;
+
+    simulacrum::utility::compiled_cbsp geometry; ///< Used to locate the surfaces that
+                                                 ///< units stand on.
+    simulacrum::navigation_graph     graph;
+    simulacrum::navigation_hierarchy hierarchy; ///< Used for paths that the flat
+                                                ///< searches cannot find within their
+                                                ///< expansion budget.
+    simulacrum::landmark_heuristic   landmarks; ///< The heuristic for searches over
+                                                ///< #search_workspace.
+    simulacrum::cluster_visibility   visibility; ///< Culls line of sight tests between
+                                                 ///< clusters that cannot see each other.
+};
+
+/** \brief The navigation state for the current map, or `nullptr` while it is built.
+ *
+ * This must only be accessed through `std::atomic_load` and `std::atomic_store`.
+ * Readers hold their own reference for as long as they use the state, so a state is
+ * freed by whichever thread releases it last.
+ */
+std::shared_ptr<const navigation_state> published_navigation;
+
+/** \brief Guards #navigation_generation, such that a build publishes its state only
+ *         if no build was started or retired after it.
+ */
+std::mutex publish_mutex;
+unsigned long navigation_generation = 0;
+
+/** \brief The navigation builds in flight, which are pruned as new builds start.
+ *
+ * Each build waits for the build before it, so superseded builds never run
+ * concurrently with each other or with the current build.
+ */
+std::vector<std::shared_future<void>> navigation_builds;
+
+/** \brief The state that #planner is bound to, kept alive so that the graph the
+ *         planner refers to is not freed and reused while it is bound.
+ */
+std::shared_ptr<const navigation_state> planned_navigation;
+
+/** \brief The reusable search state for pathfinding, so that steady-state path
+ *         queries do not allocate.
+ */
+simulacrum::astar_workspace<float> search_workspace;
+
+/** \brief The search state for incremental replanning, which is repaired as the
+ *         bot and its target move rather than recomputed each tick.
+ */
+simulacrum::incremental_planner<simulacrum::navigation_graph_node,
+                                simulacrum::navigation_graph_edge> planner;
+
+/** \brief The search state for planning within a time budget, which improves its
+ *         path over the following ticks.
+ */
+simulacrum::anytime_planner anytime_search;
+
+/** \brief The searches that paths can be planned with.
+ *
+ * Each falls back to the hierarchy when it has no path to the target, if
+ * #use_hierarchical_planning is set.
+ */
+enum class path_planner {
+    astar,       ///< #search_workspace, searching from scratch each tick.
+    incremental, ///< #planner, repairing its search as the bot and target move.
+    anytime      ///< #anytime_search, improving its path over the following ticks.
+};
+
+/** \brief The names of the planners, as given to `simulacrum_path_planner`.
+ */
+constexpr std::array<std::string_view, 3> path_planner_names = {"astar", "incremental", "anytime"};
+
+path_planner planner_mode = path_planner::incremental; ///< The planner paths are
+                                                       ///< planned with.
+
+long planning_budget = 1000; ///< The time the planners may search for each tick, in
+                             ///< microseconds.
+
+/** \brief The reusable search state for navigation_state::hierarchy.
+ */
+simulacrum::hierarchy_workspace hierarchy_search;
+
+bool use_hierarchical_planning = true; ///< Fall back to the hierarchy for long paths.
+
+/** \brief The edges of the navigation graph that are blocked by moving objects, which
+ *         is bound to the same state as #planner.
+ *
+ * The hierarchy is not aware of obstacles, so paths found through it may be blocked.
+ */
+simulacrum::obstacle_layer obstacles;
+
+/** \brief The obstacle spheres of the current tick, kept to reuse their storage.
+ */
+std::vector<simulacrum::obstacle_sphere> obstacle_spheres;
+
+bool use_dynamic_obstacles = true; ///< Block edges obstructed by moving objects.
+
+/** \brief The distances towards the current target, from which paths are read in
+ *         place of searching when #use_distance_field is set.
+ *
+ * The field is recomputed only when the vertex of the target changes, when edges
+ * are blocked or unblocked, or when a new navigation state is bound.
+ */
+simulacrum::distance_field target_field;
+bool target_field_stale = true; ///< Set when #target_field must be recomputed.
+
+bool  use_distance_field    = false; ///< Follow #target_field over #planner.
+float distance_field_radius = 0.0f;  ///< The extent of #target_field, or `0` for the
+                                     ///< whole graph.
+
+bool use_visibility_culling = true; ///< Consult navigation_state::visibility before
+                                    ///< testing lines of sight.
+
+/** \brief The live enemies of the current tick, kept to reuse their storage.
+ */
+simulacrum::target_scorer target_candidates;
+simulacrum::target_scorer::weights_type target_weights;
+
+/** \brief The units of the live enemies and the positions of their body markers, kept
+ *         to reuse their storage.
+ */
+std::vector<simulacrum::marker_cache::object_identity> candidate_units;
+std::vector<std::optional<sentinel::real3d>>           candidate_bodies;
+
+bool use_target_scoring = true; ///< Choose targets by #target_candidates rather than
+                                ///< by distance alone.
+
+/** \brief Publishes \a state, unless a build was started or retired after the build
+ *         of \a generation.
+ */
+void publish_navigation(std::shared_ptr<const navigation_state> state,
+                        unsigned long generation);
+
+/** \brief Returns `true` if a build was started or retired after the build of
+ *         \a generation, such that the build would not be published.
+ */
+bool is_superseded(unsigned long generation);
+
+/** \brief Runs \a query_count (default 1000) searches between random vertices of the
+ *         navigation graph with both the straight-line and landmark heuristics, and
+ *         prints the number of vertices expanded and the time taken for each.
+ */
+void benchmark_landmarks(std::optional<long> query_count);
+
+/** \brief Returns the file that the navigation graph for the map cache \a cache_name
+ *         is persisted to.
+ */
+std::string navigation_cache_filename(std::string_view cache_name);
+
+/** \brief Locates the vertices of \a query_count (default 10000) random points above
+ *         the navigation graph by the collision BSP and by the spatial index, and
+ *         prints the time taken by each.
+ */
+void benchmark_point_location(std::optional<long> query_count);
 
 } // namespace (anonymous)
 
@@ -32,46 +213,285 @@ void reset()
     recalculate_navigation(std::nullopt);
 }
 
+void retire_navigation()
+{
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    ++navigation_generation;
+    std::atomic_store(&published_navigation, std::shared_ptr<const navigation_state>());
+}
+
 bool load()
 {
-    return true;
+    using sentutil::script::install_script_function;
+
+    return
+        install_script_function<"simulacrum_path_planner">(
+            +[] (std::optional<std::string_view> name) {
+                if (name) {
+                    auto it = std::find(path_planner_names.begin(), path_planner_names.end(),
+                                        name.value());
+                    if (it == path_planner_names.end()) {
+                        sentutil::console::cprintf(sentutil::color::red, "unknown planner \"%s\"",
+                                                   std::string(name.value()).c_str());
+                        return;
+                    }
+                    planner_mode = static_cast<path_planner>(it - path_planner_names.begin());
+                }
+
+                sentutil::console::cprintf("%s", path_planner_names[static_cast<int>(planner_mode)].data());
+            },
+            "selects the path planner: incremental (default) repairs its search as the bot and target move, astar searches from scratch each tick and anytime improves its path over the following ticks",
+            "[string: astar|incremental|anytime]"
+        ) &&
+        install_script_function<"simulacrum_planning_budget">(
+            +[] (std::optional<long> microseconds) -> long {
+                if (microseconds) planning_budget = std::max(microseconds.value(), 0l);
+                return planning_budget;
+            },
+            "sets the time in microseconds that the path planner may search for each tick"
+        ) &&
+        install_script_function<"simulacrum_hierarchical_planning">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_hierarchical_planning = enable.value();
+                return use_hierarchical_planning;
+            },
+            "toggles hierarchical pathfinding for paths that are too long to search for directly"
+        ) &&
+        install_script_function<"simulacrum_dynamic_obstacles">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_dynamic_obstacles = enable.value();
+                return use_dynamic_obstacles;
+            },
+            "toggles avoiding vehicles, devices and other moving objects while pathfinding"
+        ) &&
+        install_script_function<"simulacrum_distance_field">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_distance_field = enable.value();
+                return use_distance_field;
+            },
+            "toggles following a field of distances from the target, which is recomputed only when the target moves"
+        ) &&
+        install_script_function<"simulacrum_distance_field_radius">(
+            +[] (std::optional<float> radius) -> float {
+                if (radius) {
+                    distance_field_radius = std::max(radius.value(), 0.0f);
+                    target_field_stale    = true;
+                }
+                return distance_field_radius;
+            },
+            "sets the distance from the target that the distance field extends to, or 0 for the whole map"
+        ) &&
+        install_script_function<"simulacrum_visibility_culling">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_visibility_culling = enable.value();
+                return use_visibility_culling;
+            },
+            "toggles skipping line of sight tests between regions of the map that cannot see each other"
+        ) &&
+        install_script_function<"simulacrum_target_scoring">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_target_scoring = enable.value();
+                return use_target_scoring;
+            },
+            "toggles choosing targets by distance, aim, projectile travel time and visibility, otherwise the nearest is chosen"
+        ) &&
+        install_script_function<"simulacrum_benchmark_landmarks">(
+            benchmark_landmarks,
+            "compares the vertices expanded by searches with and without the landmark heuristic"
+        ) &&
+        install_script_function<"simulacrum_benchmark_point_location">(
+            benchmark_point_location,
+            "compares locating navigation vertices by the collision BSP and by nearest neighbour queries"
+        );
 }
 
 void recalculate_navigation(std::optional<std::string_view> cache_name)
 {
-    nav_graph = simulacrum::navigation_graph(simulacrum::this_collision_bsp);
+    retire_navigation();
+
+    // builds that have finished, or have been superseded and will finish, are pruned
+    navigation_builds.erase(
+        std::remove_if(navigation_builds.begin(), navigation_builds.end(),
+                       [] (const std::shared_future<void>& build) {
+                           using namespace std::chrono_literals;
+                           return build.wait_for(0s) == std::future_status::ready;
+                       }),
+        navigation_builds.end());
+
+    const sentinel::tags::collision_bsp* cbsp = sentutil::globals::map_globals->collision_bsp;
+    if (!cbsp)
+        return;
+
+    unsigned long generation;
+    {
+        std::lock_guard<std::mutex> lock(publish_mutex);
+        generation = navigation_generation;
+    }
+
+    // the tag data and object table are only read here, so that the build cannot
+    // observe them as the game thread changes them or unloads the map
+    auto build = [snapshot = std::make_unique<simulacrum::collision_bsp_snapshot>(*cbsp),
+                  scenery  = simulacrum::snapshot_scenery(),
+                  filename = cache_name ? std::optional(navigation_cache_filename(cache_name.value()))
+                                        : std::nullopt,
+                  previous = navigation_builds.empty() ? std::shared_future<void>()
+                                                       : navigation_builds.back(),
+                  generation] {
+        // the build runs alone, and is abandoned between phases once it is superseded
+        if (previous.valid())
+            previous.wait();
+        if (is_superseded(generation))
+            return;
+
+        simulacrum::utility::compiled_cbsp geometry(snapshot->get());
+        std::optional<simulacrum::navigation_graph> graph;
+        std::uint64_t key = 0;
+        if (filename) {
+            key   = simulacrum::navigation_graph_key(snapshot->get(), scenery);
+            graph = simulacrum::navigation_graph::map_file(filename.value(), key);
+        }
+
+        if (!graph) {
+            if (is_superseded(generation))
+                return;
+
+            // a graph superseded while it was built is still persisted, so that a build
+            // for the same map waiting on this one maps it rather than building it again
+            graph.emplace(geometry, scenery);
+            if (filename)
+                graph->write_file(filename.value(), key);
+        }
+
+        if (is_superseded(generation))
+            return;
+
+        publish_navigation(std::make_shared<const navigation_state>(std::move(geometry),
+                                                                    std::move(graph.value()),
+                                                                    snapshot->get()),
+                           generation);
+    };
+
+    navigation_builds.push_back(std::async(std::launch::async, std::move(build)).share());
+}
+
+bool maybe_visible(const sentinel::real3d& from, const sentinel::real3d& to)
+{
+    const std::shared_ptr<const navigation_state> navigation
+        = std::atomic_load(&published_navigation);
+    if (!use_visibility_culling || !navigation)
+        return true;
+
+    auto locate_cluster = [&navigation] (const sentinel::real3d& point)
+        -> std::optional<navigation_hierarchy::cluster_index> {
+        auto surface = navigation->geometry.ground_surface(point);
+        if (!surface)
+            return std::nullopt;
+
+        auto vertex = navigation->graph.get_node({{}, navigation_graph_node::type_surface,
+                                                  surface.value()});
+        if (!vertex)
+            return std::nullopt;
+        return navigation->hierarchy.cluster(vertex.value().index());
+    };
+
+    const auto from_cluster = locate_cluster(from);
+    const auto to_cluster   = locate_cluster(to);
+    return !from_cluster || !to_cluster
+        || navigation->visibility.maybe_visible(from_cluster.value(), to_cluster.value());
 }
 
-void update(float seconds, long ticks)
+void update([[maybe_unused]] float seconds,
+            [[maybe_unused]] long  ticks)
 {
     if (!game_context.local_unit || game_context.live_enemies.empty()) {
         control::immediate_goals.clear();
         return;
     }
 
-    [[maybe_unused]]
     sentinel::player& local_player = game_context.local_player.value();
     sentinel::unit&   local_unit   = game_context.local_unit.value();
     sentinel::biped&  local_biped  = reinterpret_cast<sentinel::biped&>(local_unit);
 
-    sentinel::player& nearest_enemy_player = *game_context.live_enemies.begin();
-    sentinel::unit&   nearest_enemy_unit   = *nearest_enemy_player.unit;
-
     auto get_position = [] (const sentinel::unit& unit) -> const sentinel::real3d& {
         return unit.object.parent ? unit.object.parent->object.position
                                   : unit.object.position;
     };
 
-    control::immediate_goals.target_player = std::ref(nearest_enemy_player);
+    auto& candidates = control::immediate_goals.target_players;
+    std::fill(candidates.begin(), candidates.end(), std::nullopt);
+    if (use_target_scoring) {
+        // every live enemy is scored at once from the snapshot, and only the best few
+        // are handed to control to be tested by ray casts
+        perf::scope timing(perf::phase_targeting);
+        const PlayerSnapshot& snapshot = game_context.player_snapshot;
+        const auto first = game_context.live_enemies.begin() - game_context.players.begin();
+        const auto last  = game_context.live_enemies.end() - game_context.players.begin();
+        const sentinel::real3d& source = get_position(local_unit);
+
+        // lines of sight are tested from where control casts its rays
+        const sentinel::real3d camera = local_unit.object.parent
+            ? sentutil::globals::camera_globals->position
+            : sentutil::object::get_unit_camera(local_player.unit);
+
+        // candidates are scored at their bodies where the markers are known
+        candidate_units.clear();
+        for (auto i = first; i < last; ++i)
+            candidate_units.push_back(snapshot.players[game_context.player_order[i]]->unit);
+        candidate_bodies.resize(candidate_units.size());
+        object_markers.get_world_positions(candidate_units.data(), candidate_units.size(),
+                                           "body", candidate_bodies.data());
+
+        target_candidates.clear();
+        for (auto i = first; i < last; ++i) {
+            const std::uint32_t index = game_context.player_order[i];
+            const sentinel::real3d& position
+                = candidate_bodies[i - first].value_or(snapshot.positions[index]);
+            target_candidates.push_back(*snapshot.players[index], position,
+                                        maybe_visible(camera, position));
+        }
+
+        const ProjectileContext* projectile = game_context.projectile_context
+            ? std::addressof(game_context.projectile_context.value().get())
+            : nullptr;
+        const sentinel::real initial_speed = projectile
+            ? norm(math::initial_projectile_velocity(projectile->speed_muzzle,
+                                                     local_unit.unit.aim_forward,
+                                                     local_unit.object.velocity))
+            : 0.0f;
+
+        target_candidates.score(source, game_context.orientation_context,
+                                projectile, initial_speed, target_weights);
+        target_candidates.select(candidates.size(), candidates.begin());
+    } else {
+        candidates.front() = *game_context.live_enemies.begin();
+    }
+
+    sentinel::player& target_player = candidates.front().value();
+    sentinel::unit&   target_unit   = *target_player.unit;
+
+    auto& dest = control::immediate_goals.target_position;
+    const std::shared_ptr<const navigation_state> navigation
+        = std::atomic_load(&published_navigation);
+    if (!navigation) {
+        // steer directly at the target until the navigation graph is built
+        dest.front() = get_position(target_unit);
+        std::fill(std::next(dest.begin()), dest.end(), std::nullopt);
+        return;
+    }
 
-    auto start_vertex = [get_position, local_biped] {
+    const navigation_graph&     nav_graph     = navigation->graph;
+    const navigation_hierarchy& nav_hierarchy = navigation->hierarchy;
+    const landmark_heuristic&   nav_landmarks = navigation->landmarks;
+
+    const utility::compiled_cbsp& geometry = navigation->geometry;
+    auto start_vertex = [get_position, local_biped, &nav_graph, &geometry] {
         const navigation_graph_node node{{},
                                          navigation_graph_node::type_surface,
                                          local_biped.biped.cbsp_surface_index};
         auto opt = nav_graph.get_node(node);
-        return opt ? opt.value() : nav_graph.nearest_node(get_position(local_biped));
+        return opt ? opt : nav_graph.locate_node(geometry, get_position(local_biped));
     }();
-    auto goal_vertex = nav_graph.nearest_node(get_position(nearest_enemy_unit));
+    auto goal_vertex = nav_graph.locate_node(geometry, get_position(target_unit));
 
     if (!start_vertex || !goal_vertex)
         return; // OK to use previous pathing goals
@@ -80,36 +500,302 @@ void update(float seconds, long ticks)
                          const navigation_graph_node& goal)
                          { return norm(goal.point - node.point); };
 
-    auto visitor = [count = 0] (auto&&... ) mutable { return ++count < 30000; };
+    // searches are bounded by the planning budget as well as by expansions, reading the
+    // clock only every few expansions
+    const auto deadline = std::chrono::steady_clock::now()
+                        + std::chrono::microseconds(planning_budget);
+    auto visitor = [count = 0, deadline] (auto&&... ) mutable {
+        return ++count < 30000
+            && (count % 32 != 0 || std::chrono::steady_clock::now() < deadline);
+    };
 
-    auto test_edge = [] (const navigation_graph_node& start,
-                         const navigation_graph_node& end,
+    auto test_edge = [] ([[maybe_unused]] const navigation_graph_node& start,
+                         [[maybe_unused]] const navigation_graph_node& end,
                          const auto& edge) {
-        return std::true_type();
+        return !obstacles.is_blocked(edge);
     };
 
-    auto search_result = astar_search(nav_graph.get_graph(),
-                                      start_vertex.value(),
-                                      goal_vertex.value(),
-                                      heuristic,
-                                      visitor,
-                                      test_edge);
-    auto path_opt = get_path(start_vertex.value(),
-                             goal_vertex.value(),
-                             search_result);
-
-    if (!path_opt)
+    auto cost = [] ([[maybe_unused]] const navigation_graph_node& start,
+                    [[maybe_unused]] const navigation_graph_node& end,
+                    const auto& edge) {
+        return obstacles.is_blocked(edge) ? std::numeric_limits<float>::infinity()
+                                          : edge->distance;
+    };
+
+    if (planned_navigation != navigation) {
+        planner.reset(nav_graph.get_graph());
+        anytime_search.reset(nav_graph.get_graph());
+        obstacles.reset(nav_graph);
+        planned_navigation = navigation;
+        target_field_stale = true;
+    }
+
+    {   // diff the obstacles against the last tick, except those that the bot or its
+        // target are standing within, which cannot be avoided
+        perf::scope timing(perf::phase_obstacles);
+        obstacle_spheres.clear();
+        if (use_dynamic_obstacles)
+            snapshot_obstacles(obstacle_spheres);
+
+        const sentinel::real3d& start_point = get_position(local_biped);
+        const sentinel::real3d& goal_point  = get_position(target_unit);
+        auto contains_endpoint = [&start_point, &goal_point] (const obstacle_sphere& sphere) {
+            return norm(start_point - sphere.center) < sphere.radius
+                || norm(goal_point - sphere.center) < sphere.radius;
+        };
+        obstacle_spheres.erase(std::remove_if(obstacle_spheres.begin(),
+                                              obstacle_spheres.end(),
+                                              contains_endpoint),
+                               obstacle_spheres.end());
+
+        const auto& changed_edges = obstacles.update(obstacle_spheres);
+        for (std::uint32_t edge : changed_edges)
+            planner.notify_edge_changed(nav_graph.get_graph().edge(edge), heuristic, cost);
+        target_field_stale = target_field_stale || !changed_edges.empty();
+        if (!changed_edges.empty())
+            anytime_search.invalidate();
+    }
+
+    auto to_point = [&nav_graph] (const auto& vertex) { return nav_graph.get_graph().node(vertex).point; };
+    auto set_path = [&dest, to_point] (const auto& path) {
+        std::fill(std::transform(path.begin(),
+                                 path.begin() + std::min<std::ptrdiff_t>(path.distance(), std::size(dest)),
+                                 dest.begin(),
+                                 to_point),
+                  dest.end(),
+                  std::nullopt);
+    };
+
+    // every path below returns at the end of the tick, so the rest is planning
+    perf::scope planning_timing(perf::phase_planning);
+
+    auto plan_hierarchically = [&] {
+        using graph_type = navigation_graph::graph_type;
+        auto path_opt = nav_hierarchy.find_path(graph_type::index(start_vertex.value()),
+                                                graph_type::index(goal_vertex.value()),
+                                                hierarchy_search,
+                                                std::size(dest));
+        if (path_opt)
+            set_path(path_opt.value());
+        return path_opt.has_value();
+    };
+
+    if (use_distance_field) {
+        using graph_type = navigation_graph::graph_type;
+        const auto start_index = graph_type::index(start_vertex.value());
+        const auto goal_index  = graph_type::index(goal_vertex.value());
+        if (target_field_stale || target_field.target() != goal_index) {
+            target_field.compute(nav_graph.get_graph(),
+                                 goal_index,
+                                 distance_field_radius > 0.0f ? distance_field_radius
+                                                              : std::numeric_limits<float>::infinity(),
+                                 [] (const auto& edge) { return !obstacles.is_blocked(edge); });
+            target_field_stale = false;
+        }
+
+        std::array<graph_type::vertex_index,
+                   control::immediate_goals_type::position_lookahead> path;
+        const auto count = target_field.get_path(start_index, path.size(), path.begin());
+        if (count != 0 || start_index == goal_index) {
+            set_path(rough_span(path.begin(), path.begin() + count));
+            return;
+        }
+
+        // the bot is outside of the field, so its path is searched for instead
+    }
+
+    if (planner_mode == path_planner::anytime) {
+        using graph_type = navigation_graph::graph_type;
+        anytime_search.set_query(graph_type::index(start_vertex.value()),
+                                  graph_type::index(goal_vertex.value()));
+        anytime_search.improve(std::chrono::microseconds(planning_budget), nav_landmarks, cost);
+
+        // until a path to the target is found, the hierarchy's path is followed, or else
+        // the best partial path
+        if (!anytime_search.has_path() && use_hierarchical_planning && plan_hierarchically())
+            return;
+
+        std::array<graph_type::vertex_index,
+                   control::immediate_goals_type::position_lookahead> path;
+        const auto count = anytime_search.get_path(path.size(), path.begin());
+        if (count != 0)
+            set_path(rough_span(path.begin(), path.begin() + count));
         return;
+    }
 
-    auto& path = path_opt.value();
-    auto& dest = control::immediate_goals.target_position;
-    std::fill(std::transform(path.cbegin(),
-                             path.cbegin() + std::min(std::size(path), std::size(dest)),
-                             dest.begin(),
-                             [] (const auto& vertex) { return vertex->first.point; }),
-              dest.end(),
-              std::nullopt);
+    if (planner_mode == path_planner::incremental) {
+        planner.set_goal(goal_vertex.value(), heuristic);
+        planner.set_start(start_vertex.value(), heuristic, cost);
+        if (!planner.compute(heuristic, cost, visitor)) {
+            // the repair resumes next tick
+            if (use_hierarchical_planning)
+                plan_hierarchically();
+            return;
+        }
+
+        std::array<navigation_graph::graph_type::vertex_index,
+                   control::immediate_goals_type::position_lookahead> path;
+        const auto count = planner.get_path(path.size(), path.begin());
+        if (count == 0 && start_vertex.value() != goal_vertex.value())
+            return;
+
+        set_path(rough_span(path.begin(), path.begin() + count));
+        return;
+    }
+
+    const bool found = astar_search(nav_graph.get_graph(),
+                                    search_workspace,
+                                    start_vertex.value(),
+                                    goal_vertex.value(),
+                                    nav_landmarks,
+                                    visitor,
+                                    test_edge);
+    if (!found && use_hierarchical_planning) {
+        plan_hierarchically();
+        return;
+    }
+
+    auto path_opt = get_path(search_workspace,
+                             start_vertex.value(),
+                             goal_vertex.value());
+
+    if (path_opt)
+        set_path(path_opt.value());
 }
 
 } } // namespace simulacrum::ai
 
+
+namespace {
+
+navigation_state::navigation_state(simulacrum::utility::compiled_cbsp&& geometry_,
+                                   simulacrum::navigation_graph&& graph_,
+                                   const sentinel::tags::collision_bsp& cbsp)
+    : geometry(std::move(geometry_))
+    , graph(std::move(graph_))
+    , hierarchy(graph)
+    , landmarks(graph.get_graph())
+    , visibility(hierarchy, graph, cbsp)
+{
+
+}
+
+void publish_navigation(std::shared_ptr<const navigation_state> state,
+                        unsigned long generation)
+{
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    if (generation == navigation_generation)
+        std::atomic_store(&published_navigation, std::move(state));
+}
+
+bool is_superseded(unsigned long generation)
+{
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    return generation != navigation_generation;
+}
+
+void benchmark_landmarks(std::optional<long> query_count)
+{
+    using clock = std::chrono::steady_clock;
+    using simulacrum::navigation_graph_node;
+
+    const std::shared_ptr<const navigation_state> navigation
+        = std::atomic_load(&published_navigation);
+    if (!navigation || navigation->graph.get_graph().size() == 0) {
+        sentutil::console::cprintf(sentutil::color::red, "no navigation graph");
+        return;
+    }
+
+    const auto& graph         = navigation->graph.get_graph();
+    const auto& nav_landmarks = navigation->landmarks;
+
+    auto straight_line = [] (const navigation_graph_node& node,
+                             const navigation_graph_node& goal)
+                             { return norm(goal.point - node.point); };
+
+    auto test_edge = [] (auto&&...) { return std::true_type(); };
+
+    auto run = [&] (const auto& heuristic, long& expanded, long& found) {
+        std::minstd_rand rng(0x5EED); // same queries for each heuristic
+        std::uniform_int_distribution<std::uint32_t> pick(0, graph.size() - 1);
+
+        const auto start_time = clock::now();
+        for (long i = 0; i < query_count.value_or(1000); ++i) {
+            const auto start = graph.vertex(pick(rng));
+            const auto goal  = graph.vertex(pick(rng));
+            found += simulacrum::astar_search(graph, search_workspace, start, goal,
+                                              heuristic,
+                                              [&expanded] (auto&&...) { ++expanded; return true; },
+                                              test_edge);
+        }
+        return std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+    };
+
+    long straight_expanded = 0, straight_found = 0;
+    long landmark_expanded = 0, landmark_found = 0;
+    const double straight_ms = run(straight_line, straight_expanded, straight_found);
+    const double landmark_ms = run(nav_landmarks, landmark_expanded, landmark_found);
+
+    sentutil::console::cprintf("%u vertices, %u landmarks",
+                               (unsigned)graph.size(), (unsigned)nav_landmarks.landmark_count());
+    sentutil::console::cprintf("straight-line: %ld expanded, %ld found, %.2fms",
+                               straight_expanded, straight_found, straight_ms);
+    sentutil::console::cprintf("landmarks:     %ld expanded, %ld found, %.2fms",
+                               landmark_expanded, landmark_found, landmark_ms);
+}
+
+void benchmark_point_location(std::optional<long> query_count)
+{
+    using clock = std::chrono::steady_clock;
+
+    const std::shared_ptr<const navigation_state> navigation
+        = std::atomic_load(&published_navigation);
+    if (!navigation || navigation->graph.get_graph().size() == 0) {
+        sentutil::console::cprintf(sentutil::color::red, "no navigation graph");
+        return;
+    }
+
+    const auto& nav_graph = navigation->graph;
+    const auto& graph     = nav_graph.get_graph();
+
+    // points are taken a little above the nodes, where units stand
+    std::vector<sentinel::real3d> points;
+    {
+        std::minstd_rand rng(0x5EED);
+        std::uniform_int_distribution<std::uint32_t> pick(0, graph.size() - 1);
+        for (long i = 0; i < query_count.value_or(10000); ++i)
+            points.push_back(graph.node(pick(rng)).point + sentinel::real3d{0.0f, 0.0f, 0.3f});
+    }
+
+    long located = 0;
+    auto start_time = clock::now();
+    for (const auto& point : points) {
+        if (auto surface = navigation->geometry.ground_surface(point))
+            located += nav_graph.get_node({{}, simulacrum::navigation_graph_node::type_surface,
+                                           surface.value()}).has_value();
+    }
+    const double bsp_ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+
+    long nearest = 0;
+    start_time = clock::now();
+    for (const auto& point : points)
+        nearest += nav_graph.nearest_node(point).has_value();
+    const double rtree_ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+
+    sentutil::console::cprintf("%ld points", (long)points.size());
+    sentutil::console::cprintf("collision bsp: %ld located, %.2fms", located, bsp_ms);
+    sentutil::console::cprintf("spatial index: %ld located, %.2fms", nearest, rtree_ms);
+}
+
+std::string navigation_cache_filename(std::string_view cache_name)
+{
+    // keep only the map name, in case a path is supplied
+    if (auto separator = cache_name.find_last_of("\\/"); separator != std::string_view::npos)
+        cache_name.remove_prefix(separator + 1);
+    if (auto extension = cache_name.rfind(".map"); extension != std::string_view::npos)
+        cache_name.remove_suffix(cache_name.size() - extension);
+
+    return "simulacrum\\navigation\\" + std::string(cache_name) + ".nav";
+}
+
+} // namespace (anonymous)
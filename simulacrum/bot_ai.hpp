@@ -9,14 +9,34 @@
 #include <optional>
 #include <string_view>
 
+#include <sentinel/types.hpp>
+
 namespace simulacrum { namespace ai {
 
 void reset();
 
 bool load();
 
+/** \brief Starts building the navigation structures for the current map in the
+ *         background, persisting them under \a cache_name if provided.
+ *
+ * Until the build completes, bots steer directly towards their targets.
+ */
 void recalculate_navigation(std::optional<std::string_view> cache_name);
 
+/** \brief Withdraws the navigation structures of the current map, such that they are
+ *         not used after the map is unloaded.
+ */
+void retire_navigation();
+
+/** \brief Returns `true` if the regions of the map containing \a from and \a to may
+ *         see each other, or if either point could not be located.
+ *
+ * This is a coarse test over sampled lines of sight between navigation clusters, to be
+ * used to skip the exact test when it is bound to fail.
+ */
+bool maybe_visible(const sentinel::real3d& from, const sentinel::real3d& to);
+
 void update(float seconds, long ticks);
 
 } } // namespace simulacrum::ai
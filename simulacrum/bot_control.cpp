@@ -5,8 +5,12 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "bot_control.hpp"
+#include "bot_ai.hpp"
 #include "bot_config.hpp"
 #include "game_context.hpp"
+#include "marker_cache.hpp"
+#include "perf.hpp"
+#include "visibility.hpp"
 
 #include <cmath>
 #include <algorithm>
@@ -19,15 +23,34 @@ namespace simulacrum { namespace control {
 
 immediate_goals_type immediate_goals = {/*ZERO INITIALIZED*/};
 
+namespace {
+
+/** \brief The results of the lines of sight tested to targets over the last few ticks.
+ */
+ray_cache target_rays;
+
+bool use_intercept_solver = true; ///< Lead targets by solving for the intercept rather
+                                  ///< than by advancing the simulation.
+
+} // namespace (anonymous)
+
 void reset()
 {
     immediate_goals = immediate_goals_type();
+    target_rays.clear();
 }
 
 bool load()
 {
     using sentutil::script::install_script_function;
-    return true;
+    return
+        install_script_function<"simulacrum_intercept_solver">(
+            +[] (std::optional<bool> enable) -> bool {
+                if (enable) use_intercept_solver = enable.value();
+                return use_intercept_solver;
+            },
+            "toggles leading targets by solving for the intercept, otherwise the simulation is advanced by the travel time"
+        );
 }
 
 void update(sentinel::digital_controls_state& digital,
@@ -46,6 +69,7 @@ void update(sentinel::digital_controls_state& digital,
 
     sentinel::player& local_player = game_context.local_player.value();
     sentinel::unit&   unit         = game_context.local_unit.value();
+    target_rays.advance(ticks);
 
     sentinel::real3d positional_goal_delta = sentinel::real3d::zero;
     [&analog, &unit, &positional_goal_delta] {   // movement
@@ -89,42 +113,88 @@ void update(sentinel::digital_controls_state& digital,
         if (!target_player.unit)
             return std::nullopt;
 
-        if (game_context.projectile_context) {   // compensate for projectile travel distance
-            const ProjectileContext& projectile_context = game_context.projectile_context.value();
-            const sentinel::real3d initial_velocity = math::initial_projectile_velocity(projectile_context.speed_muzzle,
-                                                                                        unit.unit.aim_forward,
-                                                                                        unit.object.velocity);
-            const sentinel::real initial_projectile_speed = norm(initial_velocity);
+        if (!game_context.projectile_context)
+            return std::nullopt;
+
+        // compensate for projectile travel distance
+        const ProjectileContext& projectile_context = game_context.projectile_context.value();
+        const sentinel::real3d initial_velocity = math::initial_projectile_velocity(projectile_context.speed_muzzle,
+                                                                                    unit.unit.aim_forward,
+                                                                                    unit.object.velocity);
+        const sentinel::real initial_projectile_speed = norm(initial_velocity);
+        constexpr float max_travel_time = 20.0f; // beyond which targets cannot be predicted
+
+        auto get_body_position = [&target_player] () -> std::optional<sentinel::real3d> {
+            auto opt_transform = object_markers.get_world_transform(target_player.unit, "body");
+            if (!opt_transform)
+                return std::nullopt;
+            return opt_transform.value().translation;
+        };
 
-            const auto [in_range, travel_time] = math::projectile_travel_time(
-                game_context.projectile_context.value(),
+        std::optional<sentinel::real3d>           opt_target;
+        std::optional<math::projectile_intercept> intercept;
+        if (use_intercept_solver) {
+            if (!(opt_target = get_body_position()))
+                return std::nullopt;
+
+            // the target is predicted to keep the velocity of what it is riding
+            const sentinel::unit& target_unit = *target_player.unit;
+            const sentinel::real3d& velocity = target_unit.object.parent ? target_unit.object.parent->object.velocity
+                                                                         : target_unit.object.velocity;
+
+            const math::kinematic_trajectory trajectory{opt_target.value(),
+                                                        velocity,
+                                                        sentinel::real3d::zero};
+            intercept = math::solve_projectile_intercept(projectile_context,
+                                                         initial_projectile_speed,
+                                                         camera,
+                                                         trajectory,
+                                                         max_travel_time);
+            if (!intercept)
+                return std::nullopt; // target cannot be hit/predicted within budget
+        } else {
+            const auto [in_range, travel_time] = math::projectile_travel_time_lookup(
+                projectile_context,
                 initial_projectile_speed,
                 norm(target_player.unit->object.node_transforms[0].translation - camera));
 
-            if (!in_range || travel_time > 20.0f)
+            if (!in_range || travel_time > max_travel_time)
                 return std::nullopt; // target cannot be hit/predicted within budget
+            perf::scope timing(perf::phase_simulation);
             sentutil::simulation::advance(static_cast<long>(std::ceil(travel_time)));
-        } else {
-            return std::nullopt;
+            timing.stop();
+
+            if (!(opt_target = get_body_position()))
+                return std::nullopt;
         }
 
-        auto opt_marker_result = sentutil::object::get_object_marker(target_player.unit, "body");
-        if (!opt_marker_result)
+        // the line of sight is tested to where the target is in the simulation
+        const sentinel::real3d target = opt_target.value();
+        const sentinel::real3d delta  = (intercept ? intercept.value().point : target) - camera;
+        const sentinel::real3d sight  = target - camera;
+
+        // the ray is cast only if the regions may see each other and no recent
+        // result for the same endpoints is known
+        if (!ai::maybe_visible(camera, target))
             return std::nullopt;
 
-        const sentinel::real3d target = opt_marker_result.value().world_transform.translation;
-        const sentinel::real3d delta  = target - camera;
+        const std::uint32_t target_key = target_player.unit.raw;
+        if (const bool* visible = target_rays.find(camera, target, target_key))
+            return *visible ? std::optional(delta) : std::nullopt;
 
+        perf::scope cast_timing(perf::phase_raycast);
         auto opt_raycast_result = sentutil::raycast::cast_projectile_ray(camera,
-                                                                         delta,
+                                                                         sight,
                                                                          local_player.unit);
-        if (!opt_raycast_result
-            || opt_raycast_result.value().hit_type != 3
-            || !(opt_raycast_result.value().hit_identity == target_player.unit
-                 || (target_player.unit->object.parent &&
-                     opt_raycast_result.value().hit_identity == target_player.unit->object.parent))) {
+        cast_timing.stop();
+        const bool visible = opt_raycast_result
+            && opt_raycast_result.value().hit_type == 3
+            && (opt_raycast_result.value().hit_identity == target_player.unit
+                || (target_player.unit->object.parent &&
+                    opt_raycast_result.value().hit_identity == target_player.unit->object.parent));
+        target_rays.insert(camera, target, target_key, visible);
+        if (!visible)
             return std::nullopt;
-        }
 
         return delta;
     };
@@ -152,11 +222,11 @@ void update(sentinel::digital_controls_state& digital,
 
     bool do_fire = false;
     [&do_fire, &analog, &unit, local_player, &test_target, &aim_to_delta, &positional_goal_delta, seconds] { // aiming
-        if (!immediate_goals.target_player
-            || !immediate_goals.target_player.value().get().unit)
+        const auto& target_players = immediate_goals.target_players;
+        if (!target_players.front())
             return;
 
-        sentinel::player& target_player = immediate_goals.target_player.value();
+        perf::scope copy_timing(perf::phase_simulation);
         sentutil::simulation restore_point;
 
         // NOTE: (contemplation)
@@ -171,10 +241,25 @@ void update(sentinel::digital_controls_state& digital,
         const sentinel::real3d camera = unit.object.parent ? sentutil::globals::camera_globals->position
                                                            : sentutil::object::get_unit_camera(local_player.unit);
         sentutil::simulation::advance(game_context.get_ticks_until_fire() + lead_ticks);
+        copy_timing.stop();
 
         /*for (int i = std::max((int)aiming_lookahead_ticks, 1); i > 0; --i)*/ {
             std::optional<sentinel::real3d> delta = std::nullopt;
-            if (game_context.projectile_context && (delta = test_target(camera, target_player))) {
+            for (std::size_t i = 0; game_context.projectile_context && !delta && i < target_players.size(); ++i) {
+                if (!target_players[i])
+                    break;
+
+                // without the intercept solver a test advances the simulation, which
+                // must be undone before the next candidate is tested
+                std::optional<sentutil::simulation> candidate_restore_point;
+                if (!use_intercept_solver && i + 1 < target_players.size() && target_players[i + 1]) {
+                    perf::scope timing(perf::phase_simulation);
+                    candidate_restore_point.emplace();
+                }
+                delta = test_target(camera, target_players[i].value());
+            }
+
+            if (delta) {
                 do_fire = aim_to_delta(delta.value());
             } else {
                 aim_to_delta(positional_goal_delta);
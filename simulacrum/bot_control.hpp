@@ -28,9 +28,14 @@ struct immediate_goals_type {
      */
     std::array<std::optional<sentinel::real3d>, position_lookahead> target_position;
 
-    /** \brief Indicates the player to aim and fire upon (if visible).
+    /** \brief The number of players that can be set in #target_players.
      */
-    std::optional<std::reference_wrapper<sentinel::player>> target_player;
+    static constexpr std::size_t target_candidates = 2;
+
+    /** \brief The players to aim and fire upon, the preferred first.
+     *         The first of the players that is visible is aimed at.
+     */
+    std::array<std::optional<std::reference_wrapper<sentinel::player>>, target_candidates> target_players;
 
     /** \brief Sets the goals to a clean, idle state.
      */
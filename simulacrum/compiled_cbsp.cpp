@@ -0,0 +1,270 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "compiled_cbsp.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/** \brief Projects \a point onto the coordinate plane most parallel to the plane
+ *         with \a normal, such that polygons facing along \a normal keep their
+ *         winding.
+ */
+std::array<sentinel::real, 2> project(const sentinel::position3d&  point,
+                                      const sentinel::direction3d& normal) noexcept;
+
+/** \brief Returns the index referred to by a negative BSP child \a child, or `-1` if
+ *         the child refers to nothing.
+ */
+constexpr std::int32_t child_index(std::int32_t child) noexcept
+{
+    return child == -1 ? -1 : child & 0x7FFFFFFF;
+}
+
+} // namespace (anonymous)
+
+namespace simulacrum { namespace utility {
+
+compiled_cbsp::compiled_cbsp(const sentinel::tags::collision_bsp& cbsp)
+{
+    const auto& surfaces = cbsp.surfaces;
+    const auto& edges    = cbsp.edges;
+    const auto& vertices = cbsp.vertices;
+
+    planes.reserve(cbsp.planes.count);
+    for (const auto& plane : cbsp.planes)
+        planes.push_back({plane.normal, plane.d});
+
+    bsp3d_planes.reserve(cbsp.bsp3d_nodes.count);
+    bsp3d_children.reserve(cbsp.bsp3d_nodes.count);
+    for (const auto& node : cbsp.bsp3d_nodes) {
+        const plane3d& plane = planes[node.plane_index()];
+        bsp3d_planes.push_back(node.is_plane_reversed() ? plane3d{-plane.normal, -plane.d} : plane);
+        bsp3d_children.push_back({node.children[0], node.children[1]});
+    }
+
+    leaf_first_references.reserve(cbsp.leaves.count);
+    leaf_reference_counts.reserve(cbsp.leaves.count);
+    for (const auto& leaf : cbsp.leaves) {
+        leaf_first_references.push_back(leaf.first_bsp2d_reference);
+        leaf_reference_counts.push_back(leaf.bsp2d_reference_count);
+    }
+
+    reference_planes.reserve(cbsp.bsp2d_references.count);
+    reference_roots.reserve(cbsp.bsp2d_references.count);
+    for (const auto& reference : cbsp.bsp2d_references) {
+        reference_planes.push_back(reference.plane);
+        reference_roots.push_back(reference.bsp2d_node);
+    }
+
+    bsp2d_planes.reserve(cbsp.bsp2d_nodes.count);
+    bsp2d_children.reserve(cbsp.bsp2d_nodes.count);
+    for (const auto& node : cbsp.bsp2d_nodes) {
+        bsp2d_planes.push_back({{node.plane.normal[0], node.plane.normal[1]}, node.plane.d});
+        bsp2d_children.push_back({node.children[0], node.children[1]});
+    }
+
+    vertex_points.reserve(vertices.count);
+    for (const auto& vertex : vertices)
+        vertex_points.push_back(vertex.point);
+
+    edge_surfaces.reserve(edges.count);
+    edge_midpoints.reserve(edges.count);
+    for (const auto& edge : edges) {
+        edge_surfaces.push_back({edge.surfaces[0], edge.surfaces[1]});
+        edge_midpoints.push_back(0.5f * (vertex_points[edge.vertices[0]]
+                                         + vertex_points[edge.vertices[1]]));
+    }
+
+    surface_normals.reserve(surfaces.count);
+    surface_distances.reserve(surfaces.count);
+    surface_areas.reserve(surfaces.count);
+    surface_centroids.reserve(surfaces.count);
+    ring_offsets.reserve(surfaces.count + 1);
+    ring_edge_indices.reserve(2 * edges.count);
+    ring_vertex_indices.reserve(2 * edges.count);
+    ring_surface_indices.reserve(2 * edges.count);
+
+    ring_offsets.push_back(0);
+    for (index_type s = 0; s < surfaces.count; ++s) {
+        const auto& surface = surfaces[s];
+        const plane3d& plane = planes[surface.plane_index()];
+        surface_normals.push_back(surface.is_reversed() ? -plane.normal : plane.normal);
+        surface_distances.push_back(surface.is_reversed() ? -plane.d : plane.d);
+
+        // every edge appears in the rings of both of its surfaces, so a ring that
+        // does not close within the edge count is malformed and cut short
+        index_type e = surface.first_edge;
+        for (index_type steps = 0; steps < edges.count; ++steps) {
+            const auto&      edge = edges[e];
+            const std::size_t side = edge.surfaces[0] != s ? 1 : 0;
+            ring_edge_indices.push_back(e);
+            ring_vertex_indices.push_back(edge.vertices[side]);
+            ring_surface_indices.push_back(edge.surfaces[1 - side]);
+
+            e = edge.edges[side];
+            if (e == surface.first_edge)
+                break;
+        }
+        ring_offsets.push_back(static_cast<std::uint32_t>(ring_edge_indices.size()));
+
+        // the area and centroid are accumulated over a fan from the first vertex
+        const auto ring = ring_vertices(s);
+        sentinel::real   area     = 0.0f;
+        sentinel::real3d centroid = sentinel::real3d::zero;
+        if (!ring.empty()) {
+            const auto& first = vertex_points[*ring.begin()];
+            auto previous     = first;
+            for (index_type v : ring) {
+                const auto& point    = vertex_points[v];
+                const auto  tri_area = 0.5f * norm(cross(previous - first, point - first));
+                area     += tri_area;
+                centroid += (1.0f / 3.0f) * tri_area * (first + previous + point);
+                previous  = point;
+            }
+
+            // degenerate surfaces have no area to weigh by, so their vertices are averaged
+            if (area > 0.0f) {
+                centroid *= 1.0f / area;
+            } else {
+                centroid = sentinel::real3d::zero;
+                for (index_type v : ring)
+                    centroid += vertex_points[v];
+                centroid *= 1.0f / ring.distance();
+            }
+        }
+
+        surface_areas.push_back(area);
+        surface_centroids.push_back(centroid);
+    }
+}
+
+std::optional<compiled_cbsp::index_type>
+compiled_cbsp::leaf(const sentinel::position3d& point) const noexcept
+{
+    // the depth is bounded so that malformed trees cannot loop
+    std::int32_t node = bsp3d_planes.empty() ? -1 : 0;
+    for (std::size_t depth = 0; node >= 0; ++depth) {
+        if (depth == bsp3d_planes.size() || static_cast<std::size_t>(node) >= bsp3d_planes.size())
+            return std::nullopt;
+
+        const plane3d& plane = bsp3d_planes[node];
+        node = bsp3d_children[node][dot(plane.normal, point) >= plane.d];
+    }
+
+    const std::int32_t leaf_index = child_index(node);
+    if (leaf_index < 0 || static_cast<std::size_t>(leaf_index) >= leaf_first_references.size())
+        return std::nullopt;
+    return leaf_index;
+}
+
+std::optional<compiled_cbsp::index_type>
+compiled_cbsp::ground_surface(const sentinel::position3d& point) const noexcept
+{
+    const auto leaf_index = leaf(point);
+    if (!leaf_index)
+        return std::nullopt;
+
+    std::optional<index_type> ground;
+    sentinel::real ground_height = -std::numeric_limits<sentinel::real>::infinity();
+
+    const std::int32_t first = leaf_first_references[leaf_index.value()];
+    const std::int32_t last  = first + leaf_reference_counts[leaf_index.value()];
+    for (std::int32_t r = std::max(first, 0); r < last && static_cast<std::size_t>(r) < reference_planes.size(); ++r) {
+        const std::int32_t plane_reference = reference_planes[r];
+        const plane3d& stored_plane = planes[plane_reference & 0x7FFFFFFF];
+        const plane3d  plane = plane_reference < 0 ? plane3d{-stored_plane.normal, -stored_plane.d}
+                                                   : stored_plane;
+        if (std::abs(plane.normal[2]) < 1e-4f)
+            continue; // walls are never below a point
+
+        // the point on the plane directly below the point
+        sentinel::position3d below = point;
+        below[2] += (plane.d - dot(plane.normal, point)) / plane.normal[2];
+        if (below[2] > point[2] || below[2] <= ground_height)
+            continue;
+
+        const auto surface = locate_surface(reference_roots[r], plane, below);
+        if (!surface || surface_normals[surface.value()][2] <= 0 || !surface_contains(surface.value(), below))
+            continue;
+
+        ground        = surface;
+        ground_height = below[2];
+    }
+
+    return ground;
+}
+
+std::optional<compiled_cbsp::index_type>
+compiled_cbsp::locate_surface(std::int32_t root,
+                              const plane3d& plane,
+                              const sentinel::position3d& point) const noexcept
+{
+    const auto projected = project(point, plane.normal);
+
+    std::int32_t node = root;
+    for (std::size_t depth = 0; node >= 0; ++depth) {
+        if (depth == bsp2d_planes.size() || static_cast<std::size_t>(node) >= bsp2d_planes.size())
+            return std::nullopt;
+
+        const plane2d& line = bsp2d_planes[node];
+        node = bsp2d_children[node][line.normal[0] * projected[0]
+                                    + line.normal[1] * projected[1] >= line.d];
+    }
+
+    const std::int32_t surface = child_index(node);
+    if (surface < 0 || static_cast<std::size_t>(surface) >= surface_count())
+        return std::nullopt;
+    return surface;
+}
+
+bool compiled_cbsp::surface_contains(index_type surface,
+                                     const sentinel::position3d& point) const noexcept
+{
+    const auto& normal = surface_normals[surface];
+    const auto  vertices = ring_vertices(surface);
+    if (vertices.empty())
+        return false;
+
+    // crossing test, which does not depend on the winding of the polygon
+    const auto q = project(point, normal);
+    bool inside = false;
+    auto a = project(vertex_points[*(vertices.end() - 1)], normal);
+    for (index_type vertex : vertices) {
+        const auto b = project(vertex_points[vertex], normal);
+        if ((a[1] > q[1]) != (b[1] > q[1])
+            && q[0] < a[0] + (q[1] - a[1]) * (b[0] - a[0]) / (b[1] - a[1]))
+            inside = !inside;
+        a = b;
+    }
+
+    return inside;
+}
+
+} } // namespace simulacrum::utility
+
+namespace {
+
+std::array<sentinel::real, 2> project(const sentinel::position3d&  point,
+                                      const sentinel::direction3d& normal) noexcept
+{
+    int axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (std::abs(normal[i]) > std::abs(normal[axis]))
+            axis = i;
+    }
+
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+    return normal[axis] > 0 ? std::array<sentinel::real, 2>{point[u], point[v]}
+                            : std::array<sentinel::real, 2>{point[v], point[u]};
+}
+
+} // namespace (anonymous)
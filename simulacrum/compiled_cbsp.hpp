@@ -0,0 +1,158 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include <sentinel/types.hpp>
+#include <sentinel/tags/collision_bsp.hpp>
+
+#include "utility.hpp"
+
+namespace simulacrum { namespace utility {
+
+/** \brief The geometry of a collision BSP, compiled once per map into flat arrays.
+ *
+ * Where #interface_cbsp follows the tag blocks element by element, this tabulates
+ * the properties that consumers stream over: the oriented plane, area and centroid
+ * of each surface, the vertices, edges and neighbours around each surface, and the
+ * surfaces on either side of each edge. The BSP hierarchy is also compiled, for
+ * point location queries.
+ *
+ * The ring of a surface starts at its first edge and follows its edges in order,
+ * such that `ring_edges(s)[k]` is the `k`-th edge of surface `s`, `ring_vertices(s)[k]`
+ * is the vertex that edge starts from, as the surface is traversed, and
+ * `ring_surfaces(s)[k]` is the surface across it.
+ */
+class compiled_cbsp {
+public:
+    using index_type = long; ///< The index type of surfaces, edges and vertices.
+
+    compiled_cbsp() = default;
+
+    /** \brief Compiles the geometry of \a cbsp.
+     *
+     * The compiled geometry does not refer to \a cbsp, which may be freed afterwards.
+     */
+    explicit compiled_cbsp(const sentinel::tags::collision_bsp& cbsp);
+
+    std::size_t surface_count() const noexcept { return surface_areas.size(); }
+    std::size_t edge_count()    const noexcept { return edge_surfaces.size(); }
+    std::size_t vertex_count()  const noexcept { return vertex_points.size(); }
+
+    /** \brief Returns the normal of \a surface, facing out from the front of the surface.
+     */
+    const sentinel::direction3d& surface_normal(index_type surface) const { return surface_normals[surface]; }
+
+    /** \brief Returns the plane constant of \a surface, such that a point `p` lies on
+     *         the surface plane when `dot(surface_normal(surface), p) == d`.
+     */
+    sentinel::real surface_distance(index_type surface) const { return surface_distances[surface]; }
+
+    sentinel::real          surface_area(index_type surface)     const { return surface_areas[surface]; }
+    const sentinel::real3d& surface_centroid(index_type surface) const { return surface_centroids[surface]; }
+
+    /** \brief Returns the surfaces on either side of \a edge.
+     */
+    const std::array<index_type, 2>& edge_adjacency(index_type edge) const { return edge_surfaces[edge]; }
+
+    /** \brief Returns the midpoint of \a edge.
+     */
+    const sentinel::real3d& edge_midpoint(index_type edge) const { return edge_midpoints[edge]; }
+
+    const sentinel::position3d& vertex_point(index_type vertex) const { return vertex_points[vertex]; }
+
+    rough_span<const index_type*> ring_edges(index_type surface) const { return ring(ring_edge_indices, surface); }
+    rough_span<const index_type*> ring_vertices(index_type surface) const { return ring(ring_vertex_indices, surface); }
+    rough_span<const index_type*> ring_surfaces(index_type surface) const { return ring(ring_surface_indices, surface); }
+
+    /** \brief Returns the index of the BSP leaf containing \a point, or `std::nullopt`
+     *         if \a point lies in solid space or outside the BSP.
+     */
+    std::optional<index_type> leaf(const sentinel::position3d& point) const noexcept;
+
+    /** \brief Returns the upward-facing surface directly below \a point that bounds
+     *         the BSP leaf containing \a point.
+     *
+     * The surface is found by a descent of the 3D BSP to the leaf containing \a point,
+     * followed by a descent of the 2D BSP of each floor plane of that leaf. The surface
+     * is only returned if \a point lies over its polygon.
+     *
+     * This does not allocate and may be called from multiple threads.
+     *
+     * \return The index of the nearest surface below \a point, or `std::nullopt` if
+     *         there is no such surface bounding the leaf, as is the case for points
+     *         far above the ground.
+     */
+    std::optional<index_type> ground_surface(const sentinel::position3d& point) const noexcept;
+
+private:
+    struct plane3d {
+        sentinel::direction3d normal;
+        sentinel::real        d;
+    };
+
+    struct plane2d {
+        sentinel::real normal[2];
+        sentinel::real d;
+    };
+
+    std::vector<plane3d> planes;
+
+    std::vector<plane3d>                     bsp3d_planes;   ///< Oriented node planes.
+    std::vector<std::array<std::int32_t, 2>> bsp3d_children; ///< {back, front}
+
+    std::vector<std::int32_t> leaf_first_references;
+    std::vector<std::int32_t> leaf_reference_counts;
+
+    std::vector<std::int32_t> reference_planes; ///< Plane indices, negative if reversed.
+    std::vector<std::int32_t> reference_roots;  ///< The root 2D BSP node of each plane.
+
+    std::vector<plane2d>                     bsp2d_planes;
+    std::vector<std::array<std::int32_t, 2>> bsp2d_children;
+
+    std::vector<sentinel::direction3d> surface_normals;
+    std::vector<sentinel::real>        surface_distances;
+    std::vector<sentinel::real>        surface_areas;
+    std::vector<sentinel::real3d>      surface_centroids;
+
+    std::vector<std::uint32_t> ring_offsets; ///< Indexes the rings of each surface.
+    std::vector<index_type>    ring_edge_indices;
+    std::vector<index_type>    ring_vertex_indices;
+    std::vector<index_type>    ring_surface_indices;
+
+    std::vector<std::array<index_type, 2>> edge_surfaces;
+    std::vector<sentinel::real3d>          edge_midpoints;
+
+    std::vector<sentinel::position3d> vertex_points;
+
+    /** \brief Returns the surface that \a point lies on in the 2D BSP rooted at
+     *         \a root, where \a point is projected onto the plane \a plane.
+     */
+    std::optional<index_type> locate_surface(std::int32_t root,
+                                             const plane3d& plane,
+                                             const sentinel::position3d& point) const noexcept;
+
+    /** \brief Tests if \a point lies over the polygon of \a surface, when projected
+     *         along the dominant axis of the surface normal.
+     */
+    bool surface_contains(index_type surface, const sentinel::position3d& point) const noexcept;
+
+    rough_span<const index_type*> ring(const std::vector<index_type>& indices,
+                                       index_type surface) const
+    {
+        return {indices.data() + ring_offsets[surface],
+                indices.data() + ring_offsets[surface + 1]};
+    }
+};
+
+} } // namespace simulacrum::utility
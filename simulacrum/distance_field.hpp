@@ -0,0 +1,136 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <limits>
+
+#include "graph.hpp"
+
+namespace simulacrum {
+
+/** \brief The shortest distances to a target vertex of a #navigation_graph, and the
+ *         next vertex to move to from each vertex towards the target.
+ *
+ * The field is computed by a single Dijkstra search over the incoming edges of the
+ * graph from the target, over the whole graph or over the vertices within a bounded
+ * distance of the target. Once computed, the next hop from any vertex in the field is
+ * read in constant time, so any number of paths to the same target may be followed
+ * without further searching.
+ */
+class distance_field {
+public:
+    using graph_type   = navigation_graph::graph_type;
+    using vertex_index = graph_type::vertex_index;
+    using size_type    = std::size_t;
+
+    static constexpr vertex_index no_vertex = static_cast<vertex_index>(-1);
+
+    /** \brief Returns the graph the field was computed over, or `nullptr` if the field
+     *         was never computed.
+     */
+    const graph_type* get_graph() const noexcept { return graph; }
+
+    /** \brief Returns the target vertex, or #no_vertex if the field was never computed.
+     */
+    vertex_index target() const noexcept { return target_vertex; }
+
+    /** \brief Returns `true` if \a vertex has a known path to the target.
+     */
+    bool contains(vertex_index vertex) const noexcept { return workspace.expanded(vertex); }
+
+    /** \brief Returns the distance from \a vertex to the target, or infinity if
+     *         \a vertex is not in the field.
+     */
+    float distance(vertex_index vertex) const noexcept
+    {
+        return contains(vertex) ? workspace.distance(vertex)
+                                : std::numeric_limits<float>::infinity();
+    }
+
+    /** \brief Returns the vertex to move to from \a vertex towards the target, or
+     *         #no_vertex if \a vertex is the target or is not in the field.
+     */
+    vertex_index next_hop(vertex_index vertex) const noexcept
+    {
+        return contains(vertex) && vertex != target_vertex ? workspace.predecessor(vertex)
+                                                           : no_vertex;
+    }
+
+    /** \brief Computes the field towards \a target over \a graph_.
+     *
+     * \param[in] max_distance   The distance from the target beyond which vertices are
+     *                           left out of the field.
+     * \param[in] edge_predicate Invoked as `edge_predicate(edge)`, returns `false` to
+     *                           ignore the edge.
+     * \return The number of vertices in the field.
+     */
+    template<class EdgePredicate>
+    size_type compute(const graph_type& graph_,
+                      vertex_index target,
+                      float max_distance,
+                      const EdgePredicate& edge_predicate)
+    {
+        graph         = std::addressof(graph_);
+        target_vertex = target;
+
+        auto& frontier = workspace.frontier;
+        workspace.begin_search(graph->size());
+        workspace.relax(target, target, 0.0f);
+        frontier.push_or_update(target, 0.0f);
+
+        size_type count = 0;
+        while (!frontier.empty()) {
+            const vertex_index vertex   = frontier.top().vertex;
+            const float        distance = frontier.top().key;
+            if (distance > max_distance)
+                break;
+
+            frontier.pop();
+            workspace.close(vertex);
+            ++count;
+
+            for (const graph_type::edge_type& edge : graph->ingress_edges(vertex)) {
+                if (workspace.expanded(edge.source) || !edge_predicate(edge))
+                    continue;
+
+                const float source_distance = distance + edge->distance;
+                if (workspace.relax(edge.source, vertex, source_distance))
+                    frontier.push_or_update(edge.source, source_distance);
+            }
+        }
+
+        return count;
+    }
+
+    /** \brief Follows the next hops from \a vertex towards the target.
+     *
+     * \param[in]  max_count The maximum number of vertices to follow.
+     * \param[out] out       The output iterator receiving the vertex indices on the
+     *                       path, excluding \a vertex.
+     * \return The number of vertices written to \a out.
+     */
+    template<class OutputIt>
+    size_type get_path(vertex_index vertex, size_type max_count, OutputIt out) const
+    {
+        size_type count = 0;
+        for (vertex = next_hop(vertex); vertex != no_vertex && count < max_count; vertex = next_hop(vertex)) {
+            *out++ = vertex;
+            ++count;
+        }
+        return count;
+    }
+
+private:
+    const graph_type*      graph         = nullptr;
+    vertex_index           target_vertex = no_vertex;
+    astar_workspace<float> workspace;
+};
+
+} // namespace simulacrum
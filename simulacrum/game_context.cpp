@@ -5,13 +5,19 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "game_context.hpp"
+#include "math.hpp"
 
 #include <cmath>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <limits>
+#include <numeric>
+#include <random>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include <sentutil/all.hpp>
@@ -20,11 +26,44 @@ namespace {
 
 std::optional<std::string> ignore_name_prefix;
 
+/** \brief The projectile contexts built for the current map, by projectile tag identity.
+ *
+ * Elements are not erased until the map changes, so references to them remain valid.
+ */
+std::unordered_map<sentinel::identity_raw, simulacrum::ProjectileContext> projectile_contexts;
+
+/** \brief Returns the context for the projectile tag referred to by \a reference,
+ *         building it if it is not cached.
+ */
+const simulacrum::ProjectileContext&
+get_projectile_context(const sentinel::tags::tag_reference<sentinel::tags::projectile>& reference);
+
+/** \brief Compares the tabulated travel times of the projectile of the held weapon to
+ *         the closed form over random speeds and distances.
+ */
+void validate_travel_table(std::optional<long> sample_count);
+
 /** \brief Returns `true` if \a name matches \a string, with non-representable
  *         characters ignored from \a name.
  */
 bool name_matches(const std::wstring_view name, const std::string_view string);
 
+/** \brief Returns the position of \a unit, or of its vehicle if it is in one.
+ */
+const sentinel::real3d& get_unit_position(const sentinel::unit& unit) noexcept;
+
+/** \brief Sorts `[first, last)` by insertion, which is stable and linear for ranges
+ *         that are already nearly sorted.
+ */
+template<class RandomIt, class Compare>
+void insertion_sort(RandomIt first, RandomIt last, Compare comp);
+
+/** \brief Moves the \a count least elements of `[first, last)` to its front, sorted,
+ *         doing no more than a linear scan if they are already there.
+ */
+template<class RandomIt, class Compare>
+void select_least(RandomIt first, RandomIt last, std::size_t count, Compare comp);
+
 } // namespace (anonymous)
 
 #define SIMULACRUM_USE_CLOSED_FORM_TRAVEL_COMPUTATION
@@ -79,7 +118,7 @@ a Taylor expansion of v_i * sqrt(1 + u), where u = (2 * K)/(v_i)^2 * x.
     This may be entirely unnecessary, so only implement it as a last resort.
 */
 
-ProjectileContext::ProjectileContext(const sentinel::tags::projectile& projectile) noexcept
+ProjectileContext::ProjectileContext(const sentinel::tags::projectile& projectile)
     : definition(projectile)
     , destroyed_at_final_speed(projectile.projectile.detonation.maximum_range <= 0.0f)
     , does_lerp(projectile.does_lerp())
@@ -93,8 +132,163 @@ ProjectileContext::ProjectileContext(const sentinel::tags::projectile& projectil
     , lerp_constant(does_lerp ? (speed_final - speed_muzzle) / lerp_time : 0.0f)
     , reciprocal_lerp_constant(does_lerp ? 1 / lerp_constant : 0.0f)
     , half_lerp_constant(lerp_constant / 2)
+    , travel_table(*this)
 { }
 
+ProjectileTravelTable::ProjectileTravelTable(const ProjectileContext& projectile)
+    : final_speed(projectile.speed_final)
+    , reciprocal_lerp_constant(projectile.reciprocal_lerp_constant)
+    , min_speed(0.5f * projectile.speed_muzzle)
+    , max_speed(1.5f * projectile.speed_muzzle)
+{
+    if (!(projectile.speed_muzzle > 0.0f))
+        return;
+
+    // the far end of the table may lie at the maximum range, which is out of range
+    const sentinel::real last_distance = std::nextafter(projectile.max_range, 0.0f);
+    auto closed_form = [&projectile, last_distance] (sentinel::real speed, sentinel::real distance) {
+        return math::projectile_travel_time(projectile, speed, std::min(distance, last_distance)).second;
+    };
+    auto lerp_ticks = [&projectile] (sentinel::real speed) {
+        return static_cast<long>(math::projectile_interpolation_time(projectile, speed).first);
+    };
+
+    // the speeds of each band, fastest first
+    std::vector<std::pair<sentinel::real, sentinel::real>> band_speeds;
+    if (projectile.does_lerp && projectile.lerp_constant < 0.0f) {
+        // speeds in (final + (n - 1) * K, final + n * K] lerp through n ticks
+        const sentinel::real step = -projectile.lerp_constant;
+        auto ticks_at = [&projectile, step] (sentinel::real speed) {
+            return static_cast<long>(std::ceil((speed - projectile.speed_final) / step));
+        };
+
+        long first = std::max(1L, ticks_at(min_speed));
+        long last  = ticks_at(max_speed);
+        if (last - first + 1 > band_count) {
+            first = std::max(1L, ticks_at(projectile.speed_muzzle) - band_count / 2);
+            last  = first + band_count - 1;
+        }
+
+        if (first <= last) {
+            lerp_bands       = true;
+            first_band_ticks = first;
+            min_speed        = projectile.speed_final + (first - 1) * step;
+            max_speed        = projectile.speed_final + last * step;
+
+            // rows are inset from the ends of the band to stay clear of rounding
+            const sentinel::real inset = step / 1024;
+            for (long n = first; n <= last; ++n) {
+                band_speeds.emplace_back(projectile.speed_final + n * step - inset,
+                                         projectile.speed_final + (n - 1) * step + inset);
+            }
+        }
+    }
+
+    if (!lerp_bands) {
+        const int count = band_count / 2;
+        reciprocal_slowness_step = count / (1 / min_speed - 1 / max_speed);
+        for (int b = 0; b < count; ++b) {
+            band_speeds.emplace_back(1 / (1 / max_speed + b / reciprocal_slowness_step),
+                                     1 / (1 / max_speed + (b + 1) / reciprocal_slowness_step));
+        }
+    }
+
+    max_distance = std::min(projectile.max_range, max_ticks * max_speed);
+    if (band_speeds.empty() || !(max_distance > 0.0f))
+        return;
+    reciprocal_distance_step = (distance_count - 1) / max_distance;
+
+    bands.resize(band_speeds.size());
+    times.resize(2 * band_speeds.size() * distance_count);
+    for (std::size_t b = 0; b < band_speeds.size(); ++b) {
+        const auto [fastest, slowest] = band_speeds[b];
+        const std::array<sentinel::real, 2> row_speeds = {slowest, fastest};
+        for (int r = 0; r < 2; ++r) {
+            sentinel::real* row = &times[(2 * b + r) * distance_count];
+            for (int j = 0; j < distance_count; ++j) {
+                row[j] = closed_form(row_speeds[r], j / reciprocal_distance_step);
+                if (j > 0)
+                    row[j] = std::max(row[j], row[j - 1]);
+            }
+        }
+
+        band& current = bands[b];
+        current.slowest          = 1 / slowest;
+        current.reciprocal_width = 1 / (1 / slowest - 1 / fastest);
+        current.accurate         = true;
+
+        // interpolation is least accurate at the centres of the cells
+        const sentinel::real speed = 2 / (1 / slowest + 1 / fastest);
+        sentinel::real band_error = lerp_ticks(slowest) == lerp_ticks(fastest)
+                                  ? 0.0f
+                                  : std::numeric_limits<sentinel::real>::infinity();
+        for (int j = 0; j + 1 < distance_count && band_error <= tolerance; ++j) {
+            const sentinel::real distance = (j + 0.5f) / reciprocal_distance_step;
+            const std::optional<sentinel::real> time = ticks(speed, distance);
+            band_error = std::max(band_error, time ? std::abs(time.value() - closed_form(speed, distance))
+                                                   : std::numeric_limits<sentinel::real>::infinity());
+        }
+
+        current.accurate = band_error <= tolerance;
+        if (current.accurate)
+            error = std::max(error, band_error);
+    }
+
+    if (std::none_of(bands.begin(), bands.end(), [] (const band& b) { return b.accurate; })) {
+        bands.clear();
+        times.clear();
+    }
+}
+
+std::optional<sentinel::real>
+ProjectileTravelTable::ticks(sentinel::real initial_speed,
+                             sentinel::real distance) const noexcept
+{
+    if (empty() || !(initial_speed >= min_speed && initial_speed <= max_speed)
+                || !(distance >= 0.0f && distance <= max_distance))
+        return std::nullopt;
+
+    const sentinel::real slowness = 1 / initial_speed;
+    const long b = lerp_bands
+        ? static_cast<long>(std::ceil((final_speed - initial_speed) * reciprocal_lerp_constant)) - first_band_ticks
+        : static_cast<long>((slowness - 1 / max_speed) * reciprocal_slowness_step);
+    if (b < 0 || b >= static_cast<long>(bands.size()) || !bands[b].accurate)
+        return std::nullopt;
+
+    const sentinel::real u = (bands[b].slowest - slowness) * bands[b].reciprocal_width;
+    const sentinel::real v = distance * reciprocal_distance_step;
+    const int            j = std::min(static_cast<int>(v), distance_count - 2);
+
+    const sentinel::real* slow = &times[2 * b * distance_count + j];
+    const sentinel::real* fast = slow + distance_count;
+    const sentinel::real slow_time = slow[0] + (v - j) * (slow[1] - slow[0]);
+    const sentinel::real fast_time = fast[0] + (v - j) * (fast[1] - fast[0]);
+    return slow_time + u * (fast_time - slow_time);
+}
+
+void PlayerSnapshot::clear() noexcept
+{
+    players.clear();
+    positions.clear();
+    distances2.clear();
+    flags.clear();
+}
+
+void PlayerSnapshot::push_back(sentinel::player& player,
+                               bool ally,
+                               const std::optional<sentinel::real3d>& origin)
+{
+    const bool alive = player.is_alive();
+    const sentinel::real3d position = alive ? get_unit_position(*player.unit)
+                                            : sentinel::real3d::zero;
+
+    players.push_back(std::addressof(player));
+    positions.push_back(position);
+    distances2.push_back(alive && origin ? norm2(position - origin.value())
+                                         : std::numeric_limits<sentinel::real>::infinity());
+    flags.push_back((ally ? flag_ally : 0) | (alive ? flag_alive : 0));
+}
+
 bool GameContext::load()
 {
     using sentutil::script::install_script_function;
@@ -118,7 +312,16 @@ bool GameContext::load()
                 const sentinel::tag_array_element& element = *game_context.weapon_id->object.tag;
                 sentutil::console::cprintf("id: %08X", element.identity.raw);
                 sentutil::console::cprintf("path: \"%s\"", element.name);
-            });
+            }) &&
+        install_script_function<"simulacrum_validate_travel_table">(
+            validate_travel_table,
+            "compares tabulated projectile travel times for the held weapon to the closed form");
+}
+
+void GameContext::clear_projectile_contexts()
+{
+    projectile_context = std::nullopt;
+    projectile_contexts.clear();
 }
 
 void GameContext::preupdate(long ticks)
@@ -138,25 +341,21 @@ void GameContext::preupdate(long ticks)
     local_player = std::nullopt;
     local_unit   = std::nullopt;
     orientation_context = {};
-    players.clear();
     allies = {};
     enemies = {};
     live_allies = {};
     live_enemies = {};
 
-    auto player_filter = [] (sentinel::player& player) {
-        return (!ignore_name_prefix || !name_matches(player.name, ignore_name_prefix.value()));
-    };
-
     for (sentinel::player& player : sentutil::globals::players) {
         if (player.is_local())
             local_player = player;
-        else if (player_filter(player))
-            players.push_back(player);
     }
 
-    if (!local_player)
+    if (!local_player) {
+        players.clear();
+        player_order.clear();
         return;
+    }
 
     if (local_player.value().get().unit) {
         local_unit = std::ref(*local_player.value().get().unit);
@@ -172,46 +371,86 @@ void GameContext::preupdate(long ticks)
             if (weapon_def.weapon.triggers.count) {
                 sentinel::tags::weapon_definition::trigger& trigger = weapon_def.weapon.triggers[0]; // works for most cases
                 if (trigger.projectile.projectile)
-                    projectile_context = ProjectileContext(*trigger.projectile.projectile);
+                    projectile_context = std::cref(get_projectile_context(trigger.projectile.projectile));
             }
         }
     }
     weapon_config = std::ref(config::get_config_state().get_weapon_config(weapon_id));
 
-    {   // sort players into ally/enemy partitions
-        auto is_ally = [team = local_player.value().get().team]
-                       (const sentinel::player& player)
-                       { return team == player.team; };
-        auto it = std::partition(players.begin(), players.end(), is_ally);
-        allies = {players.begin(), it};
-        enemies = {it, players.end()};
+    {   // snapshot the remote players, reading their positions once
+        auto player_filter = [] (sentinel::player& player) {
+            return (!ignore_name_prefix || !name_matches(player.name, ignore_name_prefix.value()));
+        };
+
+        const sentinel::index_long team = local_player.value().get().team;
+        const std::optional<sentinel::real3d> origin
+            = local_unit ? std::make_optional(get_unit_position(local_unit.value())) : std::nullopt;
+
+        player_snapshot.clear();
+        for (sentinel::player& player : sentutil::globals::players) {
+            if (!player.is_local() && player_filter(player))
+                player_snapshot.push_back(player, player.team == team, origin);
+        }
     }
 
-    {   // sort ally/enemy partitions into alive/dead partitions
-        auto is_alive = [] (sentinel::player& player) { return player.is_alive(); };
-        live_allies = {allies.begin(),
-                       std::partition(allies.begin(), allies.end(), is_alive)};
-        live_enemies = {enemies.begin(),
-                        std::partition(enemies.begin(), enemies.end(), is_alive)};
+    const std::size_t player_count = player_snapshot.size();
+    {   // the previous order is kept while the same players are present
+        bool same_players = players.size() == player_count
+                         && player_order.size() == player_count;
+        for (std::size_t i = 0; same_players && i < player_count; ++i)
+            same_players = std::addressof(players[i].get()) == player_snapshot.players[player_order[i]];
+
+        if (!same_players) {
+            player_order.resize(player_count);
+            std::iota(player_order.begin(), player_order.end(), std::uint32_t(0));
+        }
     }
 
-    if (local_unit) {
-        {   // sort live allies/enemies based on (square) distance
-            auto get_position = [] (const sentinel::player& p) {
-                const sentinel::unit& unit = *p.unit;
-                return unit.object.parent ? unit.object.parent->object.position
-                                          : unit.object.position;
-            };
-            auto cmp = [get_position, pos = get_position(local_player.value())]
-                       (const sentinel::player& a, const sentinel::player& b)
-                       { return norm2(get_position(a) - pos) < norm2(get_position(b) - pos); };
-            std::sort(live_allies.begin(), live_allies.end(), cmp);
-            std::sort(live_enemies.begin(), live_enemies.end(), cmp);
+    // players are grouped as live allies, dead allies, live enemies then dead enemies
+    auto group = [&flags = player_snapshot.flags] (std::uint32_t i) {
+        return (flags[i] & PlayerSnapshot::flag_ally  ? 0 : 2)
+             + (flags[i] & PlayerSnapshot::flag_alive ? 0 : 1);
+    };
+
+    {   // order players by group, then the nearest live players by distance
+        insertion_sort(player_order.begin(), player_order.end(),
+                       [group] (std::uint32_t a, std::uint32_t b) { return group(a) < group(b); });
+
+        auto group_end = [this, group] (int g) {
+            return std::partition_point(player_order.begin(), player_order.end(),
+                                        [group, g] (std::uint32_t i) { return group(i) <= g; });
+        };
+        auto nearer = [&distances2 = player_snapshot.distances2]
+                      (std::uint32_t a, std::uint32_t b)
+                      { return distances2[a] < distances2[b]; };
+
+        const auto live_allies_end  = group_end(0);
+        const auto allies_end       = group_end(1);
+        const auto live_enemies_end = group_end(2);
+        select_least(player_order.begin(), live_allies_end, sorted_player_count, nearer);
+        select_least(allies_end, live_enemies_end, sorted_player_count, nearer);
+
+        if (players.size() != player_count) {
+            players.clear();
+            for (std::uint32_t i : player_order)
+                players.push_back(*player_snapshot.players[i]);
+        } else {
+            for (std::size_t i = 0; i < player_count; ++i)
+                players[i] = *player_snapshot.players[player_order[i]];
         }
-    } else { // player is dead
-        ticks_since_fired = 1000L;
+
+        auto to_player = [this] (std::vector<std::uint32_t>::iterator it) {
+            return players.begin() + (it - player_order.begin());
+        };
+        allies       = {players.begin(), to_player(allies_end)};
+        enemies      = {to_player(allies_end), players.end()};
+        live_allies  = {players.begin(), to_player(live_allies_end)};
+        live_enemies = {to_player(allies_end), to_player(live_enemies_end)};
     }
 
+    if (!local_unit) // player is dead
+        ticks_since_fired = 1000L;
+
     can_fire_primary_trigger = weapon && ticks_since_fired >= weapon_config.value().get().firing_interval;
 
     orientation_context = OrientationContext(sentutil::globals::local_player_globals->players[0].yaw,
@@ -263,4 +502,106 @@ bool name_matches(const std::wstring_view name, const std::string_view str)
     return str_first == str_last;
 }
 
+const simulacrum::ProjectileContext&
+get_projectile_context(const sentinel::tags::tag_reference<sentinel::tags::projectile>& reference)
+{
+    auto it = projectile_contexts.find(reference.tag.raw);
+    if (it == projectile_contexts.end())
+        it = projectile_contexts.try_emplace(reference.tag.raw, *reference).first;
+    return it->second;
+}
+
+void validate_travel_table(std::optional<long> sample_count)
+{
+    using clock = std::chrono::steady_clock;
+    using simulacrum::game_context;
+
+    if (!game_context.projectile_context) {
+        sentutil::console::cprint("no active projectile");
+        return;
+    }
+
+    const simulacrum::ProjectileContext& projectile = game_context.projectile_context.value();
+    const simulacrum::ProjectileTravelTable& table = projectile.travel_table;
+    if (table.empty()) {
+        sentutil::console::cprintf(sentutil::color::red,
+                                   "no accurate travel table");
+        return;
+    }
+
+    std::vector<std::pair<float, float>> samples;
+    {
+        std::minstd_rand rng(0x5EED);
+        std::uniform_real_distribution<float> speed(table.min_speed, table.max_speed);
+        std::uniform_real_distribution<float> distance(0.0f, table.max_distance);
+        for (long i = 0; i < sample_count.value_or(100000); ++i)
+            samples.emplace_back(speed(rng), distance(rng));
+    }
+
+    double closed_sum = 0.0, table_sum = 0.0, max_error = 0.0;
+    auto start_time = clock::now();
+    for (const auto& [speed, distance] : samples)
+        closed_sum += simulacrum::math::projectile_travel_time(projectile, speed, distance).second;
+    const double closed_ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+
+    start_time = clock::now();
+    for (const auto& [speed, distance] : samples)
+        table_sum += simulacrum::math::projectile_travel_time_lookup(projectile, speed, distance).second;
+    const double table_ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+
+    for (const auto& [speed, distance] : samples) {
+        const auto closed = simulacrum::math::projectile_travel_time(projectile, speed, distance);
+        const auto table  = simulacrum::math::projectile_travel_time_lookup(projectile, speed, distance);
+        if (closed.first && table.first)
+            max_error = std::max(max_error, double(std::abs(closed.second - table.second)));
+    }
+
+    const long accurate_bands = std::count_if(table.bands.begin(), table.bands.end(),
+                                              [] (const auto& band) { return band.accurate; });
+    sentutil::console::cprintf("%ld samples, %ld/%ld bands, %.0f world units, cell error %.4f ticks",
+                               (long)samples.size(), accurate_bands, (long)table.bands.size(),
+                               table.max_distance, table.error);
+    sentutil::console::cprintf("closed form: %.2fms (sum %.1f)", closed_ms, closed_sum);
+    sentutil::console::cprintf("table:       %.2fms (sum %.1f), max error %.4f ticks",
+                               table_ms, table_sum, max_error);
+}
+
+const sentinel::real3d& get_unit_position(const sentinel::unit& unit) noexcept
+{
+    return unit.object.parent ? unit.object.parent->object.position
+                              : unit.object.position;
+}
+
+template<class RandomIt, class Compare>
+void insertion_sort(RandomIt first, RandomIt last, Compare comp)
+{
+    if (first == last)
+        return;
+
+    for (RandomIt it = std::next(first); it != last; ++it) {
+        auto value = std::move(*it);
+        RandomIt hole = it;
+        for (; hole != first && comp(value, *std::prev(hole)); --hole)
+            *hole = std::move(*std::prev(hole));
+        *hole = std::move(value);
+    }
+}
+
+template<class RandomIt, class Compare>
+void select_least(RandomIt first, RandomIt last, std::size_t count, Compare comp)
+{
+    const RandomIt middle = first + std::min<std::ptrdiff_t>(count, last - first);
+    if (first == middle)
+        return;
+
+    const bool selected = std::is_sorted(first, middle, comp)
+                       && (middle == last || !comp(*std::min_element(middle, last, comp),
+                                                   *std::prev(middle)));
+    if (selected)
+        return;
+
+    std::nth_element(first, std::prev(middle), last, comp);
+    std::sort(first, std::prev(middle), comp);
+}
+
 } // namespace (anonymous)
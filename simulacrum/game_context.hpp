@@ -6,9 +6,13 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 #include <functional>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include <sentinel/structures/controls.hpp>
 #include <sentinel/structures/object.hpp>
@@ -40,6 +44,81 @@ struct OrientationContext {
     float sin_pitch;
 };
 
+struct ProjectileContext;
+
+/** \brief Projectile travel times tabulated over initial speeds and distances, such that
+ *         the travel time to many targets may be looked up rather than computed.
+ *
+ * The speeds tabulated are divided into *bands*, over each of which travel time is
+ * smooth. Each band is tabulated at its slowest and fastest speeds, and times within
+ * a band are interpolated linearly in distance and in the reciprocal of speed, in
+ * which travel time is linear for projectiles that do not lerp.
+ *
+ * The number of ticks a projectile lerps through is rounded up, so for projectiles
+ * that slow down, travel time jumps between speeds that lerp through a different
+ * number of ticks. The bands of such projectiles are the speeds that lerp through
+ * the same number of ticks. Otherwise, the bands divide the speeds evenly.
+ *
+ * Each band is validated against the closed form at the centres of its cells, and
+ * bands that are not accurate within #tolerance are not used.
+ */
+struct ProjectileTravelTable {
+    struct band {
+        sentinel::real slowest;             ///< The reciprocal of the slowest speed.
+        sentinel::real reciprocal_width;    ///< The reciprocal of the range of the
+                                            ///< reciprocals of the speeds.
+        bool           accurate;
+    };
+
+    static constexpr int            band_count     = 32; ///< The most bands tabulated.
+    static constexpr int            distance_count = 128;
+    static constexpr sentinel::real max_ticks      = 32.0f; ///< The longest travel time at
+                                                            ///< the fastest speed tabulated.
+    static constexpr sentinel::real tolerance      = 0.05f; ///< The largest error in ticks
+                                                            ///< of the bands used.
+
+    std::vector<band>           bands;
+    std::vector<sentinel::real> times; ///< The rows of each band, slowest first. The times
+                                       ///< are nondecreasing along each row.
+
+    bool           lerp_bands = false; ///< The bands are by the number of ticks lerped through.
+    long           first_band_ticks;   ///< The number of ticks lerped through in the first
+                                       ///< band, if #lerp_bands is set.
+    sentinel::real final_speed;              ///< ProjectileContext::speed_final.
+    sentinel::real reciprocal_lerp_constant; ///< ProjectileContext::reciprocal_lerp_constant.
+    sentinel::real min_speed;
+    sentinel::real max_speed;
+    sentinel::real max_distance;
+    sentinel::real reciprocal_slowness_step; ///< The bands per unit of reciprocal speed,
+                                             ///< if #lerp_bands is not set.
+    sentinel::real reciprocal_distance_step; ///< The columns per world unit.
+    sentinel::real error = 0.0f;             ///< The largest error in ticks of the bands
+                                             ///< used, found at the centres of their cells.
+
+    ProjectileTravelTable() = default;
+
+    /** \brief Tabulates the travel times of \a projectile, of which all members but its
+     *         travel table must be initialized.
+     *
+     * The speeds span half to one and a half times the muzzle speed, and the distances
+     * span from `0` to the lesser of the maximum range and the distance travelled
+     * within #max_ticks.
+     */
+    explicit ProjectileTravelTable(const ProjectileContext& projectile);
+
+    /** \brief Returns `true` if no band is used.
+     */
+    bool empty() const noexcept { return times.empty(); }
+
+    /** \brief Looks up the number of partial ticks for the projectile to travel
+     *         \a distance from \a initial_speed.
+     *
+     * \return The travel time, or `std::nullopt` if it is not tabulated accurately.
+     */
+    std::optional<sentinel::real> ticks(sentinel::real initial_speed,
+                                        sentinel::real distance) const noexcept;
+};
+
 /** \brief A utility class that captures lead from projectile travel time.
  *
  * Normally, in calculating a Halo-accurate travel time for a projectile, a number of
@@ -67,9 +146,42 @@ struct ProjectileContext {
     sentinel::real reciprocal_lerp_constant; ///< The multiplicative inverse of #lerp_constant.
     sentinel::real half_lerp_constant; ///< Half of #lerp_constant.
 
+    ProjectileTravelTable travel_table; ///< Built last, from the parameters above.
+
     /** \brief Stores various parameters for a given projectile definition.
      */
-    ProjectileContext(const sentinel::tags::projectile& projectile) noexcept;
+    ProjectileContext(const sentinel::tags::projectile& projectile);
+};
+
+/** \brief The state of the remote players of a tick, stored by field.
+ *
+ * Each field is indexed alike, in the order the players were visited in the player
+ * table. Positions are those of the units or, for units in vehicles, of the vehicles,
+ * and are read once per tick.
+ */
+struct PlayerSnapshot {
+    static constexpr std::uint8_t flag_ally  = 1; ///< The player is on the local team.
+    static constexpr std::uint8_t flag_alive = 2; ///< The player controls a unit.
+
+    std::vector<sentinel::player*> players;
+    std::vector<sentinel::real3d>  positions;  ///< Unspecified for dead players.
+    std::vector<sentinel::real>    distances2; ///< The square distance to the local unit,
+                                               ///< or infinity if unknown.
+    std::vector<std::uint8_t>      flags;
+
+    /** \brief Discards the players, keeping the storage of the fields.
+     */
+    void clear() noexcept;
+
+    /** \brief Appends \a player, reading its state and its distance from \a origin.
+     */
+    void push_back(sentinel::player& player,
+                   bool ally,
+                   const std::optional<sentinel::real3d>& origin);
+
+    /** \brief Returns the number of players.
+     */
+    std::size_t size() const noexcept { return players.size(); }
 };
 
 /** \brief Encapsulates partial game state to be used by the AI and control modules.
@@ -81,22 +193,40 @@ struct GameContext {
     using WeaponDefinitionReference = std::reference_wrapper<sentinel::tags::weapon>;
     using PlayerReferenceContainer  = std::vector<PlayerReference>;
     using WeaponConfigReference = std::reference_wrapper<const config::WeaponConfig>;
+    using ProjectileContextReference = std::reference_wrapper<const ProjectileContext>;
 
     std::optional<PlayerReference> local_player;
     std::optional<UnitReference>   local_unit;
     OrientationContext             orientation_context;
 
-    sentinel::identity<sentinel::weapon>     weapon_id;
-    std::optional<WeaponReference>           weapon;
-    std::optional<WeaponDefinitionReference> weapon_definition;
-    std::optional<ProjectileContext>         projectile_context;
-    std::optional<WeaponConfigReference>     weapon_config;
+    sentinel::identity<sentinel::weapon>      weapon_id;
+    std::optional<WeaponReference>            weapon;
+    std::optional<WeaponDefinitionReference>  weapon_definition;
+    std::optional<ProjectileContextReference> projectile_context; ///< Owned by the cache
+                                                                  ///< of projectile contexts.
+    std::optional<WeaponConfigReference>      weapon_config;
+
+    /** \brief The number of the nearest live allies and enemies that are kept sorted on
+     *         distance from the local unit.
+     */
+    static constexpr std::size_t sorted_player_count = 4;
+
+    PlayerSnapshot player_snapshot;
+
+    /** \brief The indices into #player_snapshot in the order of #players, which is
+     *         carried over between ticks for as long as the same players are present.
+     */
+    std::vector<std::uint32_t> player_order;
 
     PlayerReferenceContainer players;
     rough_span<PlayerReferenceContainer::iterator> allies;
     rough_span<PlayerReferenceContainer::iterator> enemies;
-    rough_span<PlayerReferenceContainer::iterator> live_allies;  // sorted on distance from player
-    rough_span<PlayerReferenceContainer::iterator> live_enemies; // sorted on distance from player
+
+    /** \brief The live allies and enemies, the first #sorted_player_count of which are
+     *         the nearest to the local unit, sorted on distance.
+     */
+    rough_span<PlayerReferenceContainer::iterator> live_allies;
+    rough_span<PlayerReferenceContainer::iterator> live_enemies;
 
     long ticks_since_fired;
 
@@ -112,6 +242,10 @@ struct GameContext {
 
     const config::WeaponConfig& get_current_weapon_config() const;
 
+    /** \brief Discards the projectile contexts built for the tags of the current map.
+     */
+    void clear_projectile_contexts();
+
     static bool load();
 };
 
@@ -5,11 +5,12 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "graph.hpp"
-#include "utility.hpp"
+#include "math.hpp"
 
 #include <cmath>
 
 #include <algorithm>
+#include <future>
 #include <vector>
 
 #include <boost/geometry.hpp>
@@ -17,47 +18,58 @@
 #include <boost/container_hash/hash.hpp>
 #include <boost/range/iterator_range_core.hpp>
 
-#include <sentutil/all.hpp>
-
 namespace {
 
-bool is_surface_navigable(const simulacrum::utility::interface_cbsp_surface& surface);
+/** \brief The revision of the graph builder, which must be incremented whenever the
+ *         graphs built change other than through the parameters below.
+ */
+constexpr std::uint32_t builder_revision = 1;
+
+/** \brief The steepest slope of a navigable surface, in radians.
+ */
+constexpr float max_navigable_slope = 0x1.921FB6p1 / 4;
+
+bool is_surface_navigable(const sentinel::direction3d& normal);
 
 
 } // namespace (anonymous)
 
 namespace simulacrum {
 
-boost::geometry::index::rtree<
-    std::pair<
-        boost::geometry::model::box<sentinel::real3d>,
-        collision_hierarchy_entry>,
-    boost::geometry::index::rstar<8>>
-build_dynamic_collision_hierarchy()
+collision_bsp_snapshot::collision_bsp_snapshot(const sentinel::tags::collision_bsp& source)
+    : bsp3d_nodes(source.bsp3d_nodes.begin(), source.bsp3d_nodes.end())
+    , planes(source.planes.begin(), source.planes.end())
+    , leaves(source.leaves.begin(), source.leaves.end())
+    , bsp2d_references(source.bsp2d_references.begin(), source.bsp2d_references.end())
+    , bsp2d_nodes(source.bsp2d_nodes.begin(), source.bsp2d_nodes.end())
+    , surfaces(source.surfaces.begin(), source.surfaces.end())
+    , edges(source.edges.begin(), source.edges.end())
+    , vertices(source.vertices.begin(), source.vertices.end())
+    , cbsp(source)
 {
-    using box_type   = boost::geometry::model::box<sentinel::real3d>;
-    using value_type = std::pair<box_type, collision_hierarchy_entry>;
-    using policy     = boost::geometry::index::rstar<8>;
-    using index_type = boost::geometry::index::rtree<value_type, policy>;
-
-    std::vector<value_type> collidables;
-
-    auto visitor = [&collidables] (sentinel::object&       object,
-                                   sentinel::tags::object& definition)
-    {
-        if (!definition.object.collision_model)
-            return;
-
-        collidables.emplace_back(box_type{object.object.bound_center - sentinel::real3d::filled(object.object.bound_radius),
-                                          object.object.bound_center + sentinel::real3d::filled(object.object.bound_radius)},
-                                 collision_hierarchy_entry{std::ref(object),
-                                                           std::ref(definition),
-                                                           std::ref(*definition.object.collision_model)});
+    auto point_to = [] (auto& block, auto& container) {
+        block.count = static_cast<decltype(block.count)>(container.size());
+        block.data  = container.data();
     };
 
-    visit_map_scenery(visitor);
+    point_to(cbsp.bsp3d_nodes,      bsp3d_nodes);
+    point_to(cbsp.planes,           planes);
+    point_to(cbsp.leaves,           leaves);
+    point_to(cbsp.bsp2d_references, bsp2d_references);
+    point_to(cbsp.bsp2d_nodes,      bsp2d_nodes);
+    point_to(cbsp.surfaces,         surfaces);
+    point_to(cbsp.edges,            edges);
+    point_to(cbsp.vertices,         vertices);
+}
 
-    return index_type(collidables.cbegin(), collidables.cend());
+std::uint64_t navigation_builder_fingerprint()
+{
+    std::size_t seed = 0;
+    boost::hash_combine(seed, builder_revision);
+    boost::hash_combine(seed, max_navigable_slope);
+    boost::hash_combine(seed, sizeof(navigation_graph_node));
+    boost::hash_combine(seed, sizeof(navigation_graph_edge));
+    return seed;
 }
 
 std::size_t navigation_graph_node::hash_value() const
@@ -68,77 +80,107 @@ std::size_t navigation_graph_node::hash_value() const
     return seed;
 }
 
-navigation_graph::navigation_graph(this_collision_bsp_tag)
-    : navigation_graph(utility::interface_cbsp{*sentutil::globals::map_globals->collision_bsp})
-{
-
-}
-
-navigation_graph::navigation_graph(const utility::interface_cbsp& cbsp)
+navigation_graph::navigation_graph(const utility::compiled_cbsp& geometry,
+                                   const scenery_snapshot& scenery)
     : graph()
     , spatial_index()
+    , surface_vertices()
+    , edge_vertices()
 {
     using Node = navigation_graph_node;
 
-    std::vector<std::pair<Node, Node>> node_pairs;
-
-    for (const auto& surface : cbsp.surfaces) {
-        if (!(is_surface_navigable)(surface))
-            continue;
-
-        const Node surface_node {
-            surface.centroid(),
-            Node::type_surface, surface.index
-        };
+    // the work below is split over threads in chunks, each chunk producing its
+    // results in order, so that the graph is identical to one built sequentially
+    const parallel_chunks for_chunks;
+
+    // the scenery hierarchy is packed while the node pairs are generated
+    using box_type = boost::geometry::model::box<sentinel::real3d>;
+    using collidable_value_type = std::pair<box_type, std::uint32_t>;
+    using collidables_type = boost::geometry::index::rtree<collidable_value_type,
+                                                           boost::geometry::index::rstar<8>>;
+    auto collidables_future = std::async(std::launch::async, [&scenery] {
+        std::vector<collidable_value_type> collidables;
+        collidables.reserve(scenery.objects.size());
+        for (std::uint32_t i = 0; i < scenery.objects.size(); ++i)
+            collidables.emplace_back(scenery.objects[i].bounds, i);
+        return collidables_type(collidables.cbegin(), collidables.cend());
+    });
 
-        for (const auto& edge : surface.edges()) {
-            [[maybe_unused]]
-            const Node other_surface_node {
-                edge.next_surface(surface).centroid(),
-                Node::type_surface, edge.next_surface(surface).index
-            };
-
-            [[maybe_unused]]
-            const Node edge_node {
-                edge.centroid(),
-                Node::type_edge, edge.index
-            };
-
-            node_pairs.push_back({surface_node, edge_node});
-            node_pairs.push_back({edge_node, surface_node});
-        }
+    std::vector<std::pair<Node, Node>> node_pairs;
+    {
+        const std::size_t surface_count = geometry.surface_count();
+        std::vector<std::vector<std::pair<Node, Node>>> chunk_pairs(for_chunks.chunk_count(surface_count));
+        for_chunks(surface_count, [&geometry, &chunk_pairs] (std::size_t chunk, std::size_t first, std::size_t last) {
+            auto& pairs = chunk_pairs[chunk];
+            for (long surface = first; surface < static_cast<long>(last); ++surface) {
+                if (!(is_surface_navigable)(geometry.surface_normal(surface)))
+                    continue;
+
+                const Node surface_node {
+                    geometry.surface_centroid(surface),
+                    Node::type_surface, surface
+                };
+
+                for (long edge : geometry.ring_edges(surface)) {
+                    const Node edge_node {
+                        geometry.edge_midpoint(edge),
+                        Node::type_edge, edge
+                    };
+
+                    pairs.push_back({surface_node, edge_node});
+                    pairs.push_back({edge_node, surface_node});
+                }
+            }
+        });
+
+        std::size_t pair_count = 0;
+        for (const auto& pairs : chunk_pairs)
+            pair_count += pairs.size();
+        node_pairs.reserve(pair_count);
+        for (const auto& pairs : chunk_pairs)
+            node_pairs.insert(node_pairs.end(), pairs.begin(), pairs.end());
     }
 
     {   // filter out edges that intersect static scenery
-        auto collidables = build_dynamic_collision_hierarchy();
-        auto intersects_collidable = [&collidables] (const auto& node_pair) -> bool {
-            using box_type   = boost::geometry::model::box<sentinel::real3d>;
-            using collidable_value_type = std::pair<box_type, collision_hierarchy_entry>;
-
+        const auto collidables = collidables_future.get();
+        auto intersects_collidable = [&collidables, &scenery] (const auto& node_pair) -> bool {
             const Node& a = node_pair.first;
             const Node& b = node_pair.second;
             const boost::geometry::model::segment<sentinel::real3d> segment(a.point, b.point);
 
             auto test_spheres
-                = [segment_begin = a.point,
+                = [&scenery,
+                   segment_begin = a.point,
                    segment_direction = normalized(b.point - a.point),
                    segment_length = norm(b.point - a.point)]
                   (const collidable_value_type& indexable) -> bool {
-                      const collision_hierarchy_entry& e = indexable.second;
-                      const sentinel::object& object = e.object;
-                      const sentinel::tags::collision_model& coll = e.collision_model;
-                      return intersects_coll_pathfinding_spheres(segment_begin,
-                                                                 segment_direction,
-                                                                 segment_length,
-                                                                 object,
-                                                                 coll);
+                      const auto& object = scenery.objects[indexable.second];
+                      const std::size_t first = object.first_sphere;
+                      return math::intersects_segment_spheres(segment_begin,
+                                                              segment_direction,
+                                                              segment_length,
+                                                              scenery.sphere_x.data() + first,
+                                                              scenery.sphere_y.data() + first,
+                                                              scenery.sphere_z.data() + first,
+                                                              scenery.sphere_radius.data() + first,
+                                                              object.sphere_count);
                   };
             auto it = collidables.qbegin(boost::geometry::index::intersects(segment));
             return std::any_of(it, collidables.qend(), test_spheres);
         };
 
-        node_pairs.erase(std::remove_if(node_pairs.begin(), node_pairs.end(), intersects_collidable),
-                         node_pairs.end());
+        std::vector<char> intersects(node_pairs.size());
+        for_chunks(node_pairs.size(), [&] (std::size_t, std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i)
+                intersects[i] = intersects_collidable(node_pairs[i]);
+        });
+
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < node_pairs.size(); ++i) {
+            if (!intersects[i])
+                node_pairs[kept++] = node_pairs[i];
+        }
+        node_pairs.erase(node_pairs.begin() + kept, node_pairs.end());
     }
 
     // construct the graph
@@ -146,21 +188,54 @@ navigation_graph::navigation_graph(const utility::interface_cbsp& cbsp)
                        [] (const Node& a, const Node& b) -> navigation_graph_edge {
                            const auto delta = b.point - a.point;
                            return {normalized(delta), norm(delta)};
-                       });
+                       },
+                       for_chunks);
 
+    // the spatial index is packed while the CBSP elements are indexed
+    auto spatial_index_future = std::async(std::launch::async, [this] { index_spatially(); });
+    index_cbsp_elements();
+    spatial_index_future.get();
+}
 
-    { // construct the spatial index
-        auto node_to_indexable = [this] (const Node& node) -> spatial_indexable {
-            return {{node.point[0], node.point[1], node.point[2]}, graph.find(node)};
-        };
+void navigation_graph::index_cbsp_elements()
+{
+    surface_vertices.clear();
+    edge_vertices.clear();
+    for (auto it = graph.begin(); it != graph.end(); ++it) {
+        const node_type& node = graph.node(graph.index(it));
+        auto& vertices = node.cbsp_type == node_type::type_surface ? surface_vertices
+                                                                   : edge_vertices;
+        if (node.cbsp_index < 0)
+            continue;
+        else if (static_cast<std::size_t>(node.cbsp_index) >= vertices.size())
+            vertices.resize(node.cbsp_index + 1, no_vertex);
+        vertices[node.cbsp_index] = graph.index(it);
+    }
+}
 
-        std::vector<spatial_indexable> spatial_indices;
-        spatial_indices.reserve(graph.size());
-        for (const auto& [node, edge] : graph)
-            spatial_indices.push_back(node_to_indexable(node));
-        spatial_index = spatial_index_type(spatial_indices.cbegin(),
-                                           spatial_indices.cend());
+void navigation_graph::index_spatially()
+{
+    std::vector<spatial_indexable> spatial_indices;
+    spatial_indices.reserve(graph.size());
+    for (auto it = graph.begin(); it != graph.end(); ++it) {
+        const node_type& node = graph.node(graph.index(it));
+        spatial_indices.push_back({{node.point[0], node.point[1], node.point[2]},
+                                   graph.index(it)});
     }
+    spatial_index = spatial_index_type(spatial_indices.cbegin(),
+                                       spatial_indices.cend());
+
+    const std::uint32_t edge_count = graph.storage().edge_count;
+    std::vector<edge_indexable> edge_indices;
+    edge_indices.reserve(edge_count);
+    for (std::uint32_t i = 0; i < edge_count; ++i) {
+        const graph_type::edge_type& edge = graph.edge(i);
+        box_type bounds(graph.node(edge.source).point, graph.node(edge.source).point);
+        boost::geometry::expand(bounds, graph.node(edge.target).point);
+        edge_indices.push_back({bounds, i});
+    }
+    edge_spatial_index = edge_index_type(edge_indices.cbegin(),
+                                         edge_indices.cend());
 }
 
 std::optional<navigation_graph::iterator>
@@ -168,28 +243,51 @@ navigation_graph::nearest_node(const sentinel::real3d& pos) const
 {
     spatial_indexable out = {};
     if (spatial_index.query(boost::geometry::index::nearest(pos, 1), &out))
-        return out.second;
+        return graph.vertex(out.second);
     return std::nullopt;
 }
 
+void navigation_graph::find_edges(const box_type& bounds,
+                                  std::vector<std::uint32_t>& out) const
+{
+    for (auto it = edge_spatial_index.qbegin(boost::geometry::index::intersects(bounds));
+         it != edge_spatial_index.qend();
+         ++it)
+        out.push_back(it->second);
+}
+
 std::optional<navigation_graph::iterator>
 navigation_graph::get_node(const navigation_graph::node_type& node) const
 {
-    auto it = graph.find(node);
-    return it != graph.end() ? std::make_optional(it) : std::nullopt;
+    const auto& vertices = node.cbsp_type == node_type::type_surface ? surface_vertices
+                                                                     : edge_vertices;
+    if (node.cbsp_index < 0 || static_cast<std::size_t>(node.cbsp_index) >= vertices.size()
+        || vertices[node.cbsp_index] == no_vertex)
+        return std::nullopt;
+    return graph.vertex(vertices[node.cbsp_index]);
+}
+
+std::optional<navigation_graph::iterator>
+navigation_graph::locate_node(const utility::compiled_cbsp& geometry,
+                              const sentinel::real3d& pos) const
+{
+    if (auto surface = geometry.ground_surface(pos)) {
+        if (auto vertex = get_node({{}, node_type::type_surface, surface.value()}))
+            return vertex;
+    }
+
+    return nearest_node(pos);
 }
 
 } // namespace simulacrum
 
 namespace {
 
-bool is_surface_navigable(const simulacrum::utility::interface_cbsp_surface& surface)
+bool is_surface_navigable(const sentinel::direction3d& normal)
 {
     // todo: calculate from biped tag
     // todo: ladder flag
-    constexpr float pi = 0x1.921FB6p1;
-    const auto [normal, d] = surface.plane();
-    return dot(normal, {0, 0, 1}) >= std::cos(pi / 4);
+    return dot(normal, {0, 0, 1}) >= std::cos(max_navigable_slope);
 }
 
 } // namespace (anonymous)
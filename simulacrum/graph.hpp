@@ -7,78 +7,143 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 #include <algorithm>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <numeric>
 #include <optional>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <boost/geometry/geometries/box.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/index/rtree.hpp>
-#include <boost/iterator/transform_iterator.hpp>
+#include <boost/iterator/permutation_iterator.hpp>
 
-#include <sentinel/structures/object.hpp>
-#include <sentinel/tags/object.hpp>
-#include <sentinel/tags/collision_model.hpp>
+#include <sentinel/tags/collision_bsp.hpp>
 
 #include "utility.hpp"
-#include "bsp_interface.hpp"
+#include "compiled_cbsp.hpp"
+#include "parallel.hpp"
+
+namespace simulacrum { namespace utility {
+    struct interface_cbsp;
+} } // namespace simulacrum::utility
 
 namespace simulacrum {
 
 struct this_collision_bsp_tag { };
 inline constexpr this_collision_bsp_tag this_collision_bsp = {};
 
-struct collision_hierarchy_entry {
-    std::reference_wrapper<sentinel::object> object;
-    std::reference_wrapper<sentinel::tags::object> object_definition;
-    std::reference_wrapper<sentinel::tags::collision_model> collision_model;
+/** \brief An owned copy of collision BSP tag data, which remains valid after the map
+ *         it was taken from is unloaded.
+ *
+ * The tag blocks of the copy refer to storage owned by the snapshot, so snapshots
+ * cannot be copied or moved.
+ */
+class collision_bsp_snapshot {
+public:
+    explicit collision_bsp_snapshot(const sentinel::tags::collision_bsp& cbsp);
+
+    collision_bsp_snapshot(const collision_bsp_snapshot&)            = delete; ///< DELETED
+    collision_bsp_snapshot& operator=(const collision_bsp_snapshot&) = delete; ///< DELETED
+
+    /** \brief Returns the copy of the tag data.
+     */
+    sentinel::tags::collision_bsp& get() noexcept { return cbsp; }
+
+private:
+    using tag_type = sentinel::tags::collision_bsp;
+
+    std::vector<tag_type::bsp3d_node>      bsp3d_nodes;
+    std::vector<tag_type::plane>           planes;
+    std::vector<tag_type::leaf>            leaves;
+    std::vector<tag_type::bsp2d_reference> bsp2d_references;
+    std::vector<tag_type::bsp2d_node>      bsp2d_nodes;
+    std::vector<tag_type::surface>         surfaces;
+    std::vector<tag_type::edge>            edges;
+    std::vector<tag_type::vertex>          vertices;
+
+    tag_type cbsp; ///< The tag data, with blocks referring to the containers above.
 };
 
-boost::geometry::index::rtree<
-    std::pair<
-        boost::geometry::model::box<sentinel::real3d>,
-        collision_hierarchy_entry>,
-    boost::geometry::index::rstar<8>>
-build_dynamic_collision_hierarchy();
+/** \brief The pathfinding spheres of the scenery on a map, in world space, such that
+ *         navigation can be computed without accessing the object table.
+ */
+struct scenery_snapshot {
+    struct object_entry {
+        boost::geometry::model::box<sentinel::real3d> bounds; ///< The object bounds.
+        std::uint32_t first_sphere; ///< The index of the first sphere of the object.
+        std::uint32_t sphere_count; ///< The number of spheres of the object.
+    };
+
+    std::vector<object_entry> objects;
+
+    // the spheres of all objects, in structure-of-arrays form for batched tests
+    std::vector<sentinel::real> sphere_x;
+    std::vector<sentinel::real> sphere_y;
+    std::vector<sentinel::real> sphere_z;
+    std::vector<sentinel::real> sphere_radius;
+};
+
+/** \brief Takes a snapshot of the scenery on the current map.
+ *
+ * This accesses the object table, so it must be called from the game thread.
+ */
+scenery_snapshot snapshot_scenery();
 
 /** \brief Implements an adjacency list that cannot be modified once constructed.
  *
  * The user is required to implement the equality comparison operator for \a Node and
  * the specialization `std::hash<Node>`.
+ *
+ * Internally, the nodes are assigned dense indices in the order they are first
+ * encountered during construction and the edges are stored contiguously, grouped
+ * by source node (compressed sparse row form).
+ * This allows per-vertex search state to be kept in flat arrays indexed through
+ * #index, rather than in associative containers.
  */
 template<
     class Node,
     class Edge = empty_struct
 > class compiled_adjacency_list {
 public:
+    /** \brief The type of the dense indices assigned to the nodes of the graph.
+     */
+    using vertex_index = std::uint32_t;
+
     struct edge_type;
+    class  vertex_iterator;
     using edge_iterator  = const edge_type*;
     using edge_list_type = rough_span<edge_iterator>;
-    using nodes_container_type = std::unordered_map<Node, edge_list_type>;
+    using ingress_edge_iterator  = boost::permutation_iterator<edge_iterator, const std::uint32_t*>;
+    using ingress_edge_list_type = rough_span<ingress_edge_iterator>;
+    using nodes_container_type = std::vector<Node>;
     using edge_container_type  = std::vector<edge_type>;
+    using lookup_container_type = std::unordered_map<Node, vertex_index>;
 
-    using hasher     = typename nodes_container_type::hasher;
-    using size_type  = typename nodes_container_type::size_type;
-    using value_type = typename nodes_container_type::value_type;
+    using hasher     = typename lookup_container_type::hasher;
+    using size_type  = std::size_t;
+    using value_type = std::pair<const Node&, edge_list_type>;
 
     /** \brief The iterator type for the elements of the adjacency structure.
      *         Elements referred to by such iterators are constant pairings of
      *         `(Node, edge_list_type)`.
      */
-    using iterator  = typename nodes_container_type::const_iterator;
-
+    using iterator = vertex_iterator;
 
     /** \brief Represents a directed edge in the graph.
      */
     struct edge_type {
-        iterator source; ///< The node the edge starts from.
-        iterator target; ///< The node the edge goes to.
-        Edge     user;   ///< User data for the edge.
+        vertex_index source; ///< The index of the node the edge starts from.
+        vertex_index target; ///< The index of the node the edge goes to.
+        Edge         user;   ///< User data for the edge.
 
         /** \brief Conversion to user edge data.
          */
@@ -97,10 +162,100 @@ public:
         const Edge* operator->() const noexcept { return std::addressof(user); }
     };
 
+    /** \brief A random-access handle to a vertex of the graph.
+     *
+     * Dereferencing yields a `(Node, edge_list_type)` pairing by value, the node
+     * being referenced in place.
+     */
+    class vertex_iterator {
+    public:
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = compiled_adjacency_list::value_type;
+        using reference         = value_type;
+        using iterator_category = std::random_access_iterator_tag;
+
+        struct pointer {
+            value_type value;
+            const value_type* operator->() const noexcept { return std::addressof(value); }
+        };
+
+        vertex_iterator() = default;
+
+        vertex_iterator(const compiled_adjacency_list& graph, vertex_index index) noexcept
+            : graph_(std::addressof(graph))
+            , index_(index) { }
+
+        reference operator*() const { return {graph_->node(index_), graph_->egress_edges(index_)}; }
+        pointer   operator->() const { return {**this}; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        /** \brief Returns the dense index of the vertex.
+         */
+        vertex_index index() const noexcept { return index_; }
+
+        vertex_iterator& operator++() noexcept { ++index_; return *this; }
+        vertex_iterator& operator--() noexcept { --index_; return *this; }
+        vertex_iterator  operator++(int) noexcept { auto copy = *this; ++index_; return copy; }
+        vertex_iterator  operator--(int) noexcept { auto copy = *this; --index_; return copy; }
+
+        vertex_iterator& operator+=(difference_type n) noexcept { index_ += n; return *this; }
+        vertex_iterator& operator-=(difference_type n) noexcept { index_ -= n; return *this; }
+
+        friend vertex_iterator operator+(vertex_iterator it, difference_type n) noexcept { return it += n; }
+        friend vertex_iterator operator+(difference_type n, vertex_iterator it) noexcept { return it += n; }
+        friend vertex_iterator operator-(vertex_iterator it, difference_type n) noexcept { return it -= n; }
+        friend difference_type operator-(const vertex_iterator& a, const vertex_iterator& b) noexcept
+        { return static_cast<difference_type>(a.index_) - static_cast<difference_type>(b.index_); }
+
+        bool operator==(const vertex_iterator& other) const noexcept { return index_ == other.index_; }
+        bool operator!=(const vertex_iterator& other) const noexcept { return index_ != other.index_; }
+        bool operator< (const vertex_iterator& other) const noexcept { return index_ <  other.index_; }
+        bool operator> (const vertex_iterator& other) const noexcept { return index_ >  other.index_; }
+        bool operator<=(const vertex_iterator& other) const noexcept { return index_ <= other.index_; }
+        bool operator>=(const vertex_iterator& other) const noexcept { return index_ >= other.index_; }
+
+    private:
+        const compiled_adjacency_list* graph_ = nullptr;
+        vertex_index                   index_ = 0;
+    };
+
+    /** \brief Refers to the flat arrays that make up a graph.
+     *
+     * The arrays may be owned by the graph or by external storage adopted by the graph,
+     * such as a mapped file. For the latter, \a Node and \a Edge must be trivially
+     * copyable.
+     */
+    struct storage_view {
+        const Node*          nodes                = nullptr; ///< `node_count` nodes.
+        const edge_type*     edges                = nullptr; ///< `edge_count` edges.
+        const vertex_index*  edge_offsets         = nullptr; ///< `node_count + 1` offsets.
+        const std::uint32_t* ingress_edge_indices = nullptr; ///< `edge_count` edge indices.
+        const vertex_index*  ingress_offsets      = nullptr; ///< `node_count + 1` offsets.
+        vertex_index         node_count           = 0;
+        std::uint32_t        edge_count           = 0;
+    };
+
     /** \brief Constructs to an empty graph.
      */
     compiled_adjacency_list() = default;
 
+    compiled_adjacency_list(const compiled_adjacency_list& other);
+    compiled_adjacency_list(compiled_adjacency_list&& other) noexcept;
+
+    compiled_adjacency_list& operator=(const compiled_adjacency_list& other);
+    compiled_adjacency_list& operator=(compiled_adjacency_list&& other) noexcept;
+
+    /** \brief Constructs a graph that refers to the arrays of \a view in place.
+     *
+     * Only the node lookup table is built, in linear time, so that lookups by \a Node
+     * have the same time-complexity as for a graph constructed from node pairings.
+     *
+     * \param[in] view       The arrays of the graph, as obtained through #storage of
+     *                       another graph.
+     * \param[in] keep_alive Shares ownership of the storage referred to by \a view.
+     */
+    compiled_adjacency_list(const storage_view& view, std::shared_ptr<const void> keep_alive);
+
     /** \brief Constructs a graph where the structure is taken in as node pairings.
      *
      * The edges are described as \a Node pairings `(x,y)`, with the range of pairings
@@ -108,12 +263,25 @@ public:
      * Every node `x` and `y` is interned and the edges are formed by the expression
      * `form_edge(u, v)` where `u`, `v` and the interned counterparts of `x`, `y`.
      *
+     * Nodes are indexed in the order they first appear in the pairings.
      * From the time the edges are formed, it is guaranteed that references to the
      * interned nodes will not be invalidated, until the destructor is called.
      */
     template<class ForwardIt, class FormEdge>
     compiled_adjacency_list(ForwardIt neighbors_begin, ForwardIt neighbors_end,
-                            const FormEdge& form_edge);
+                            const FormEdge& form_edge)
+        : compiled_adjacency_list(neighbors_begin, neighbors_end, form_edge, sequential_chunks{}) { }
+
+    /** \brief Constructs a graph as above, where edge formation and sorting are split
+     *         into chunks by \a for_chunks, such as #parallel_chunks.
+     *
+     * If \a for_chunks processes chunks concurrently, then \a form_edge must be safe
+     * to invoke concurrently. The resulting graph does not depend on \a for_chunks.
+     */
+    template<class ForwardIt, class FormEdge, class ForChunks>
+    compiled_adjacency_list(ForwardIt neighbors_begin, ForwardIt neighbors_end,
+                            const FormEdge& form_edge,
+                            const ForChunks& for_chunks);
 
     /** \brief Accesses the internal node counterpart for \a node.
      *
@@ -141,7 +309,6 @@ public:
     /** \brief Accesses the outgoing edges of a node.
      *
      * Has constant (on average) time-complexity.
-     * Unlike #adjacent, the
      *
      * \return An iterable span of the outgoing edges of \a node, or
      *         an empty span if \a node is not in the graph.
@@ -149,35 +316,131 @@ public:
     edge_list_type
     egress_edges(const Node& node) const;
 
+    /** \brief Accesses the outgoing edges of the node with index \a index.
+     *
+     * Has constant time-complexity.
+     */
+    edge_list_type
+    egress_edges(vertex_index index) const noexcept
+    {
+        return {view.edges + view.edge_offsets[index],
+                view.edges + view.edge_offsets[index + 1]};
+    }
+
+    /** \brief Accesses the incoming edges of the node with index \a index.
+     *
+     * Has constant time-complexity.
+     * The edges referred to are the same edges as those found through #egress_edges.
+     */
+    ingress_edge_list_type
+    ingress_edges(vertex_index index) const noexcept
+    {
+        return {ingress_edge_iterator(view.edges, view.ingress_edge_indices + view.ingress_offsets[index]),
+                ingress_edge_iterator(view.edges, view.ingress_edge_indices + view.ingress_offsets[index + 1])};
+    }
+
+    /** \brief Returns the position of \a edge in the edge storage of the graph,
+     *         which uniquely identifies the edge.
+     */
+    std::uint32_t edge_index(const edge_type& edge) const noexcept
+    { return static_cast<std::uint32_t>(std::addressof(edge) - view.edges); }
+
+    /** \brief Accesses the edge identified by \a index.
+     */
+    const edge_type& edge(std::uint32_t index) const noexcept { return view.edges[index]; }
+
+    /** \brief Accesses the node with index \a index.
+     */
+    const Node& node(vertex_index index) const noexcept { return view.nodes[index]; }
+
+    /** \brief Returns the dense index of the vertex referred to by \a it.
+     */
+    static vertex_index index(const iterator& it) noexcept { return it.index(); }
+
+    /** \brief Returns the dense index of \a node, which must be a reference to an
+     *         interned node, such as one obtained through #node or #intern.
+     *
+     * Has constant time-complexity.
+     */
+    vertex_index index(const Node& node) const noexcept
+    { return static_cast<vertex_index>(std::addressof(node) - view.nodes); }
+
+    /** \brief Returns an iterator to the vertex with index \a index.
+     */
+    iterator vertex(vertex_index index) const noexcept { return iterator(*this, index); }
+
     /** \brief Returns an iterator to the first element of the adjacency structure.
      */
-    iterator begin() const noexcept { return nodes.begin(); }
+    iterator begin() const noexcept { return vertex(0); }
 
     /** \brief Returns an iterator to the element following the last element of the
      *         adjacency structure.
      */
-    iterator end() const noexcept { return nodes.end(); }
+    iterator end() const noexcept { return vertex(view.node_count); }
 
     /** \brief Gets an iterator to a given node.
      *
      * \return An iterator to the graph vertex of \a node if it is in the graph, or
      *         `end()` if \a node is not in the graph.
      */
-    iterator find(const Node& node) const noexcept { return nodes.find(node); }
+    iterator find(const Node& node) const noexcept
+    {
+        auto index = find_index(node);
+        return index ? vertex(index.value()) : end();
+    }
 
     /** \brief Returns the number of nodes in the graph.
      */
-    size_type size() const noexcept { return nodes.size(); }
+    size_type size() const noexcept { return view.node_count; }
+
+    /** \brief Returns the number of edges in the graph.
+     */
+    size_type edge_count() const noexcept { return view.edge_count; }
 
     /** \brief Returns the function that hashes the nodes.
      */
-    hasher hash_function() const { return nodes.hash_function(); }
+    hasher hash_function() const { return lookup.hash_function(); }
+
+    /** \brief Returns the arrays that make up the graph.
+     */
+    const storage_view& storage() const noexcept { return view; }
 
 private:
-    nodes_container_type nodes; ///< A mapping between nodes and sorted, contiguous
-                                ///< regions in #edges consisting of node out-edges.
-    edge_container_type  edges; ///< A collection of edges between the graph nodes.
-                                ///< Internally sorted by
+    nodes_container_type      nodes;        ///< The interned nodes, by index.
+    edge_container_type       edges;        ///< A collection of edges between the graph
+                                            ///< nodes, grouped by source and sorted by
+                                            ///< target within each group.
+    std::vector<vertex_index> edge_offsets; ///< The offset into #edges of the egress
+                                            ///< edges of each node, with a terminal
+                                            ///< entry for the end of #edges.
+    std::vector<std::uint32_t> ingress_edge_indices; ///< Indices into #edges, grouped by
+                                                     ///< target node.
+    std::vector<vertex_index>  ingress_offsets;      ///< The offset into
+                                                     ///< #ingress_edge_indices of the
+                                                     ///< ingress edges of each node.
+    lookup_container_type     lookup;       ///< A mapping from nodes to their indices.
+
+    storage_view                view;          ///< The arrays in use, which are either
+                                               ///< the containers above or adopted.
+    std::shared_ptr<const void> adopted_owner; ///< Keeps adopted storage alive.
+
+    /** \brief Points #view to the containers owned by the graph.
+     */
+    void view_owned_storage() noexcept
+    {
+        view = storage_view{nodes.data(), edges.data(), edge_offsets.data(),
+                            ingress_edge_indices.data(), ingress_offsets.data(),
+                            static_cast<vertex_index>(nodes.size()),
+                            static_cast<std::uint32_t>(edges.size())};
+    }
+
+    /** \brief Finds the index of \a node through #lookup.
+     */
+    std::optional<vertex_index> find_index(const Node& node) const
+    {
+        auto it = lookup.find(node);
+        return it != lookup.end() ? std::make_optional(it->second) : std::nullopt;
+    }
 };
 
 struct navigation_graph_node {
@@ -225,17 +488,46 @@ struct navigation_graph_edge {
     float                 distance;
 };
 
+/** \brief Returns a fingerprint of the parameters that navigation graphs are built
+ *         with, which changes whenever the graphs built would change for the same
+ *         collision BSP and scenery.
+ */
+std::uint64_t navigation_builder_fingerprint();
+
+/** \brief Computes a key identifying the navigation graph built from \a cbsp and
+ *         \a scenery, for identifying persisted navigation graphs.
+ *
+ * The key covers the collision BSP geometry, the scenery spheres and
+ * #navigation_builder_fingerprint, which are all that a built graph depends on.
+ */
+std::uint64_t navigation_graph_key(const sentinel::tags::collision_bsp& cbsp,
+                                   const scenery_snapshot& scenery);
+
 class navigation_graph {
 public:
     using node_type = navigation_graph_node;
     using edge_type = navigation_graph_edge;
     using graph_type = compiled_adjacency_list<node_type, edge_type>;
     using iterator = graph_type::iterator;
+    using box_type = boost::geometry::model::box<sentinel::real3d>;
 
     navigation_graph() = default;
 
     navigation_graph(const utility::interface_cbsp& cbsp);
 
+    /** \brief Builds the graph for \a cbsp, avoiding the spheres of \a scenery.
+     *
+     * Neither the object table nor the map tag data is accessed, other than through
+     * \a cbsp, so the graph of a #collision_bsp_snapshot may be built off the game
+     * thread.
+     */
+    navigation_graph(const utility::interface_cbsp& cbsp, const scenery_snapshot& scenery);
+
+    /** \brief Builds the graph for the compiled \a geometry of a collision BSP,
+     *         avoiding the spheres of \a scenery.
+     */
+    navigation_graph(const utility::compiled_cbsp& geometry, const scenery_snapshot& scenery);
+
     navigation_graph(this_collision_bsp_tag);
 
     iterator begin() const noexcept { return graph.begin(); }
@@ -247,230 +539,1017 @@ public:
     std::optional<iterator>
     get_node(const node_type& node) const;
 
+    /** \brief Returns the vertex of the ground surface below \a pos in \a geometry,
+     *         or the nearest vertex to \a pos if there is no navigable surface below.
+     *
+     * The ground surface is found by a descent of the collision BSP, which is cheaper
+     * than the nearest neighbour query that it falls back on.
+     */
+    std::optional<iterator>
+    locate_node(const utility::compiled_cbsp& geometry, const sentinel::real3d& pos) const;
+
+    /** \brief Appends to \a out the index of each edge whose bounding box intersects
+     *         \a bounds.
+     *
+     * The edges appended are candidates only, to be tested against the exact query.
+     */
+    void find_edges(const box_type& bounds, std::vector<std::uint32_t>& out) const;
+
     const graph_type&
     get_graph() const { return graph; }
 
+    /** \brief Writes the graph to \a filename, such that it can be mapped in place by
+     *         #map_file.
+     *
+     * The parent directories of \a filename are created if they do not exist.
+     * The file is written in full to a temporary file unique to the calling thread
+     * before it replaces any existing file, so concurrent writes do not interleave.
+     *
+     * \param[in] key Identifies the source of the graph, such as a key obtained
+     *                through #navigation_graph_key.
+     * \return `true` if the file was written, otherwise `false`.
+     */
+    bool write_file(const std::string& filename, std::uint64_t key) const;
+
+    /** \brief Maps a graph written by #write_file, such that the graph is used in
+     *         place rather than parsed or rebuilt.
+     *
+     * Every index stored in the file is validated before the graph is used, so a
+     * truncated or corrupt file is rejected rather than read out of bounds.
+     * The node lookup table and the spatial indices are not stored, and are built from
+     * the mapped arrays in `O(n log n)` time, which is still far less than building the
+     * graph.
+     *
+     * \return An optional containing the mapped graph, or `std::nullopt` if the file
+     *         could not be mapped, was written by an incompatible version, was
+     *         written under a different \a key, or is inconsistent.
+     */
+    static std::optional<navigation_graph>
+    map_file(const std::string& filename, std::uint64_t key);
+
 private:
     using spatial_point_type
         = sentinel::real3d;
     using spatial_indexable
-        = std::pair<spatial_point_type, iterator>;
+        = std::pair<spatial_point_type, graph_type::vertex_index>;
     using spatial_index_type
         = boost::geometry::index::rtree<spatial_indexable,
                                         boost::geometry::index::rstar<8>>;
 
+    using edge_indexable
+        = std::pair<box_type, std::uint32_t>;
+    using edge_index_type
+        = boost::geometry::index::rtree<edge_indexable,
+                                        boost::geometry::index::rstar<8>>;
+
     graph_type         graph;
     spatial_index_type spatial_index;
+    edge_index_type    edge_spatial_index; ///< The bounds of each edge.
+
+    static constexpr graph_type::vertex_index no_vertex = static_cast<graph_type::vertex_index>(-1);
+
+    std::vector<graph_type::vertex_index> surface_vertices; ///< The vertex of each CBSP
+                                                            ///< surface, or #no_vertex.
+    std::vector<graph_type::vertex_index> edge_vertices;    ///< The vertex of each CBSP
+                                                            ///< edge, or #no_vertex.
+
+    /** \brief Builds #surface_vertices and #edge_vertices from the graph nodes.
+     */
+    void index_cbsp_elements();
+
+    /** \brief Builds #spatial_index from the graph nodes and #edge_spatial_index
+     *         from the graph edges.
+     */
+    void index_spatially();
 };
 
 template<class Node, class Edge>
-template<class ForwardIt, class FormEdge>
+template<class ForwardIt, class FormEdge, class ForChunks>
 compiled_adjacency_list<Node, Edge>::compiled_adjacency_list(
         ForwardIt neighbors_begin, ForwardIt neighbors_end,
-        const FormEdge& form_edge)
+        const FormEdge& form_edge,
+        const ForChunks& for_chunks)
     : nodes()
     , edges()
+    , edge_offsets()
+    , ingress_edge_indices()
+    , ingress_offsets()
+    , lookup()
+    , view()
+    , adopted_owner()
 {
-    // insert nodes with empty spans, to allocate
-    for (auto it = neighbors_begin; it != neighbors_end; ++it) {
-        const auto& [node, neighbor] = *it;
-
-        nodes.insert({node,     edge_list_type{nullptr, nullptr}});
-        nodes.insert({neighbor, edge_list_type{nullptr, nullptr}});
-    }
+    auto intern_node = [this] (const Node& node) -> vertex_index {
+        const auto [it, inserted] = lookup.try_emplace(node, static_cast<vertex_index>(nodes.size()));
+        if (inserted)
+            nodes.push_back(node);
+        return it->second;
+    };
 
-    // form edges
-    edges.reserve(std::distance(neighbors_begin, neighbors_end));
+    // intern nodes in order of appearance, counting the egress edges of each node
+    std::vector<std::pair<vertex_index, vertex_index>> index_pairs;
+    index_pairs.reserve(std::distance(neighbors_begin, neighbors_end));
     for (auto it = neighbors_begin; it != neighbors_end; ++it) {
         const auto& [node, neighbor] = *it;
-        const auto interned_node_it = nodes.find(node);
-        const auto interned_neighbor_it = nodes.find(neighbor);
-        edges.push_back({interned_node_it,
-                         interned_neighbor_it,
-                         form_edge(interned_node_it->first,
-                                   interned_neighbor_it->first)});
+        const vertex_index source = intern_node(node);
+        const vertex_index target = intern_node(neighbor);
+        index_pairs.emplace_back(source, target);
     }
 
-    auto edge_source = [] (const edge_type& edge) -> const Node& { return edge.source->first; };
-    auto edge_target = [] (const edge_type& edge) -> const Node& { return edge.target->first; };
-    auto interned_cmp = [] (const Node& a, const Node& b) -> bool { return std::addressof(a) < std::addressof(b); };
+    edge_offsets.assign(nodes.size() + 1, 0);
+    for (const auto& [source, target] : index_pairs)
+        ++edge_offsets[source + 1];
+    std::partial_sum(edge_offsets.begin(), edge_offsets.end(), edge_offsets.begin());
+
+    // place edges in the span of their source node, then form them
+    std::vector<vertex_index> cursor(edge_offsets.begin(), edge_offsets.end() - 1);
+    edges.resize(index_pairs.size(), edge_type{0, 0, Edge()});
+    for (const auto& [source, target] : index_pairs)
+        edges[cursor[source]++] = edge_type{source, target, Edge()};
+
+    for_chunks(edges.size(), [this, &form_edge] (std::size_t, std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            edges[i].user = form_edge(nodes[edges[i].source], nodes[edges[i].target]);
+    });
+
+    // put the edge lists in sorted order, for lookup later
+    for_chunks(nodes.size(), [this] (std::size_t, std::size_t first, std::size_t last) {
+        auto cmp_edge_targets = [] (const edge_type& a, const edge_type& b) { return a.target < b.target; };
+        for (std::size_t i = first; i < last; ++i) {
+            std::stable_sort(edges.begin() + edge_offsets[i],
+                             edges.begin() + edge_offsets[i + 1],
+                             cmp_edge_targets);
+        }
+    });
+
+    // group edge indices by target for reverse traversal
+    ingress_offsets.assign(nodes.size() + 1, 0);
+    for (const edge_type& edge : edges)
+        ++ingress_offsets[edge.target + 1];
+    std::partial_sum(ingress_offsets.begin(), ingress_offsets.end(), ingress_offsets.begin());
+
+    cursor.assign(ingress_offsets.begin(), ingress_offsets.end() - 1);
+    ingress_edge_indices.resize(edges.size());
+    for (std::uint32_t i = 0; i < edges.size(); ++i)
+        ingress_edge_indices[cursor[edges[i].target]++] = i;
+
+    view_owned_storage();
+}
 
-    auto cmp_edge_sources = [&edge_source, &interned_cmp] (const edge_type& a, const edge_type& b) {
-        return interned_cmp(edge_source(a), edge_source(b));
-    };
-    auto cmp_edge_targets = [&edge_target, &interned_cmp] (const edge_type& a, const edge_type& b) {
-        return interned_cmp(edge_target(a), edge_target(b));
-    };
+template<class Node, class Edge>
+compiled_adjacency_list<Node, Edge>::compiled_adjacency_list(
+        const storage_view& view_,
+        std::shared_ptr<const void> keep_alive)
+    : nodes()
+    , edges()
+    , edge_offsets()
+    , ingress_edge_indices()
+    , ingress_offsets()
+    , lookup()
+    , view(view_)
+    , adopted_owner(std::move(keep_alive))
+{
+    lookup.reserve(view.node_count);
+    for (vertex_index i = 0; i < view.node_count; ++i)
+        lookup.try_emplace(view.nodes[i], i);
+}
 
-    // sort edges into spans sorted on the source node
-    std::sort(edges.begin(), edges.end(), cmp_edge_sources);
-
-    // properly set the edge list spans in the map
-    for (auto& [node, span] : nodes) {
-        auto [begin, end] = std::equal_range(boost::transform_iterator(edges.begin(), edge_source),
-                                             boost::transform_iterator(edges.end(),   edge_source),
-                                             node, interned_cmp);
-        span = edge_list_type {
-            std::addressof(*(begin.base())),
-            std::addressof(*(end.base()))
-        };
+template<class Node, class Edge>
+compiled_adjacency_list<Node, Edge>::compiled_adjacency_list(const compiled_adjacency_list& other)
+    : nodes(other.nodes)
+    , edges(other.edges)
+    , edge_offsets(other.edge_offsets)
+    , ingress_edge_indices(other.ingress_edge_indices)
+    , ingress_offsets(other.ingress_offsets)
+    , lookup(other.lookup)
+    , view(other.view)
+    , adopted_owner(other.adopted_owner)
+{
+    if (!adopted_owner)
+        view_owned_storage();
+}
 
-        // put the edge list in sorted order, for lookup later
-        std::sort(begin.base(), end.base(), cmp_edge_targets);
-    }
+template<class Node, class Edge>
+compiled_adjacency_list<Node, Edge>::compiled_adjacency_list(compiled_adjacency_list&& other) noexcept
+    : nodes(std::move(other.nodes))
+    , edges(std::move(other.edges))
+    , edge_offsets(std::move(other.edge_offsets))
+    , ingress_edge_indices(std::move(other.ingress_edge_indices))
+    , ingress_offsets(std::move(other.ingress_offsets))
+    , lookup(std::move(other.lookup))
+    , view(std::exchange(other.view, storage_view{}))
+    , adopted_owner(std::move(other.adopted_owner))
+{
+    if (!adopted_owner)
+        view_owned_storage();
+}
+
+template<class Node, class Edge>
+compiled_adjacency_list<Node, Edge>&
+compiled_adjacency_list<Node, Edge>::operator=(const compiled_adjacency_list& other)
+{
+    if (this != std::addressof(other))
+        *this = compiled_adjacency_list(other);
+    return *this;
+}
+
+template<class Node, class Edge>
+compiled_adjacency_list<Node, Edge>&
+compiled_adjacency_list<Node, Edge>::operator=(compiled_adjacency_list&& other) noexcept
+{
+    nodes                = std::move(other.nodes);
+    edges                = std::move(other.edges);
+    edge_offsets         = std::move(other.edge_offsets);
+    ingress_edge_indices = std::move(other.ingress_edge_indices);
+    ingress_offsets      = std::move(other.ingress_offsets);
+    lookup               = std::move(other.lookup);
+    view                 = std::exchange(other.view, storage_view{});
+    adopted_owner        = std::move(other.adopted_owner);
+    if (!adopted_owner)
+        view_owned_storage();
+    return *this;
 }
 
 template<class Node, class Edge>
 std::optional<std::reference_wrapper<const Node>>
 compiled_adjacency_list<Node, Edge>::intern(const Node& node) const
 {
-    if (auto it = nodes.find(node); it != nodes.end())
-        return std::ref(it->first);
+    if (auto index = find_index(node))
+        return std::cref(view.nodes[index.value()]);
     return std::nullopt;
 }
 
 template<class Node, class Edge>
 std::optional<std::reference_wrapper<const Edge>>
-compiled_adjacency_list<Node, Edge>::adjacent(const Node& from, const Node& to_) const
+compiled_adjacency_list<Node, Edge>::adjacent(const Node& from, const Node& to) const
 {
-    auto to = intern(to_);
-    auto source_it = nodes.find(from);
+    auto source_index = find_index(from);
+    auto target_index = find_index(to);
 
-    if (source_it == nodes.end() || !to)
+    if (!source_index || !target_index)
         return std::nullopt;
 
-    const auto& [node, span] = *source_it;
-    auto cmp = [] (const edge_type& edge, const Node& node) {
-        return std::addressof(edge.target->first) < std::addressof(node);
-    };
-    auto edge_it = std::lower_bound(span.begin(), span.end(), to.value(), cmp);
-    return edge_it != span.end() ? std::ref(edge_it->user) : std::nullopt;
+    const edge_list_type span = egress_edges(source_index.value());
+    auto cmp = [] (const edge_type& edge, vertex_index target) { return edge.target < target; };
+    auto edge_it = std::lower_bound(span.begin(), span.end(), target_index.value(), cmp);
+    if (edge_it == span.end() || edge_it->target != target_index.value())
+        return std::nullopt;
+    return std::cref(edge_it->user);
 }
 
 template<class Node, class Edge>
 typename compiled_adjacency_list<Node, Edge>::edge_list_type
 compiled_adjacency_list<Node, Edge>::egress_edges(const Node& node) const
 {
-    auto it = nodes.find(node);
-    return it != nodes.end() ? it->second
-                             : edge_list_type{edges.end(), edges.end()};
+    auto index = find_index(node);
+    return index ? egress_edges(index.value())
+                 : edge_list_type{view.edges + view.edge_count,
+                                  view.edges + view.edge_count};
 }
 
-template<
-    class MapIterator,
-    class ValueKeyHasher = void
-> struct map_iterator_hasher {
-    using key_reference  = decltype(std::declval<MapIterator>()->first);
-    using key_value_type = std::remove_cv_t<std::remove_reference_t<key_reference>>;
-    using hasher_type = std::conditional_t<
-                            std::is_void_v<ValueKeyHasher>,
-                            std::hash<key_value_type>,
-                            ValueKeyHasher>;
+/** \brief A binary-heap generalization with \a Arity children per node, where each
+ *         element is a vertex index that can be located within the heap.
+ *
+ * Element positions are tracked in a flat array indexed by vertex, so that the key of
+ * an element already in the heap can be decreased (or increased) in logarithmic time,
+ * rather than pushing duplicate entries.
+ * The position array is never cleared; membership is validated by checking that the
+ * recorded position refers back to the vertex, so #clear has constant time-complexity.
+ *
+ * \tparam Key   The priority type, ordered by `operator<`. Smaller keys are popped first.
+ * \tparam Arity The number of children of each heap node.
+ */
+template<class Key, std::size_t Arity = 4>
+class indexed_dary_heap {
+public:
+    using vertex_index = std::uint32_t;
+    using size_type    = std::size_t;
+
+    struct entry {
+        Key          key;
+        vertex_index vertex;
+    };
+
+    /** \brief Ensures that vertex indices in `[0, vertex_count)` can be stored.
+     *
+     * Allocates only if \a vertex_count exceeds any previously reserved amount.
+     */
+    void reserve(size_type vertex_count)
+    {
+        if (positions.size() < vertex_count)
+            positions.resize(vertex_count, 0);
+        heap.reserve(vertex_count);
+    }
+
+    /** \brief Removes all elements from the heap.
+     */
+    void clear() noexcept { heap.clear(); }
+
+    bool      empty() const noexcept { return heap.empty(); }
+    size_type size()  const noexcept { return heap.size(); }
+
+    /** \brief Returns `true` if \a vertex is an element of the heap.
+     */
+    bool contains(vertex_index vertex) const noexcept
+    {
+        const vertex_index position = positions[vertex];
+        return position < heap.size() && heap[position].vertex == vertex;
+    }
+
+    /** \brief Returns the element with the smallest key.
+     */
+    const entry& top() const noexcept { return heap.front(); }
+
+    /** \brief Returns the key of \a vertex, which must be an element of the heap.
+     */
+    const Key& key(vertex_index vertex) const noexcept { return heap[positions[vertex]].key; }
+
+    /** \brief Removes the element with the smallest key.
+     */
+    void pop() noexcept
+    {
+        move_to(heap.back(), 0);
+        heap.pop_back();
+        if (!heap.empty())
+            sift_down(0);
+    }
+
+    /** \brief Inserts \a vertex with \a key, or changes the key of \a vertex if it is
+     *         already an element of the heap.
+     */
+    void push_or_update(vertex_index vertex, const Key& key)
+    {
+        if (!contains(vertex)) {
+            heap.push_back({key, vertex});
+            positions[vertex] = static_cast<vertex_index>(heap.size() - 1);
+            sift_up(heap.size() - 1);
+        } else {
+            const size_type position = positions[vertex];
+            const bool decreased = key < heap[position].key;
+            heap[position].key = key;
+            if (decreased) sift_up(position);
+            else           sift_down(position);
+        }
+    }
+
+    /** \brief Inserts \a vertex with \a key, or decreases the key of \a vertex if it is
+     *         already an element of the heap with a greater key.
+     *
+     * \return `true` if the heap was modified, otherwise `false`.
+     */
+    bool push_or_decrease(vertex_index vertex, const Key& key)
+    {
+        if (contains(vertex) && !(key < heap[positions[vertex]].key))
+            return false;
+        push_or_update(vertex, key);
+        return true;
+    }
+
+    /** \brief Removes \a vertex from the heap, if it is an element.
+     */
+    void erase(vertex_index vertex) noexcept
+    {
+        if (!contains(vertex))
+            return;
+
+        const size_type position = positions[vertex];
+        const entry last = heap.back();
+        heap.pop_back();
+        if (position == heap.size())
+            return;
+
+        const bool decreased = last.key < heap[position].key;
+        move_to(last, position);
+        if (decreased) sift_up(position);
+        else           sift_down(position);
+    }
+
+    /** \brief Replaces the key of every element with `key_of(vertex)`, then restores
+     *         the heap order in linear time.
+     */
+    template<class KeyFunction>
+    void rekey(const KeyFunction& key_of)
+    {
+        rekey(0, rekey_steps(), key_of);
+    }
+
+    /** \brief Returns the number of steps #rekey takes: one for each element to key
+     *         anew, then one for each parent to sift down.
+     */
+    size_type rekey_steps() const noexcept
+    {
+        return heap.size() + (heap.size() < 2 ? 0 : (heap.size() - 2) / Arity + 1);
+    }
+
+    /** \brief Takes the steps `[first, last)` of #rekey, so that keying the heap anew
+     *         can be spread over several calls.
+     *
+     * The heap order holds again once every step has been taken, in order. The heap
+     * must not be modified in the meantime.
+     */
+    template<class KeyFunction>
+    void rekey(size_type first, size_type last, const KeyFunction& key_of)
+    {
+        const size_type count = heap.size();
+        for (size_type step = first; step < std::min(last, count); ++step)
+            heap[step].key = key_of(heap[step].vertex);
+
+        // the parents are sifted down from the last to the root
+        const size_type parents = rekey_steps() - count;
+        for (size_type step = std::max(first, count); step < last; ++step)
+            sift_down(parents - 1 - (step - count));
+    }
+
+private:
+    std::vector<entry>        heap;      ///< The heap-ordered elements.
+    std::vector<vertex_index> positions; ///< The position of each vertex in #heap.
+
+    void move_to(const entry& e, size_type position) noexcept
+    {
+        heap[position] = e;
+        positions[e.vertex] = static_cast<vertex_index>(position);
+    }
 
-    hasher_type hasher = hasher_type();
+    void sift_up(size_type position) noexcept
+    {
+        const entry e = heap[position];
+        while (position > 0) {
+            const size_type parent = (position - 1) / Arity;
+            if (!(e.key < heap[parent].key))
+                break;
+            move_to(heap[parent], position);
+            position = parent;
+        }
+        move_to(e, position);
+    }
 
-    std::size_t operator()(const MapIterator& it) const {
-        return hasher(it->first);
+    void sift_down(size_type position) noexcept
+    {
+        const entry e = heap[position];
+        const size_type count = heap.size();
+        for (;;) {
+            const size_type first_child = position * Arity + 1;
+            if (first_child >= count)
+                break;
+
+            const size_type last_child = std::min(first_child + Arity, count);
+            size_type best = first_child;
+            for (size_type child = first_child + 1; child < last_child; ++child) {
+                if (heap[child].key < heap[best].key)
+                    best = child;
+            }
+
+            if (!(heap[best].key < e.key))
+                break;
+            move_to(heap[best], position);
+            position = best;
+        }
+        move_to(e, position);
     }
 };
 
-template<class Vertex, class Distance>
-struct astar_search_entry {
-    Vertex   predecessor;
-    Distance distance; // from start
-    bool open;
+/** \brief Reusable state for #astar_search and #get_path.
+ *
+ * The per-vertex search state is kept in flat arrays indexed by vertex index.
+ * Rather than clearing these arrays between searches, each search increments a
+ * generation counter and entries stamped with an older generation are treated as
+ * unvisited.
+ * Once the arrays have grown to the size of the graph, searches perform no
+ * allocations.
+ */
+template<class Distance>
+class astar_workspace {
+public:
+    using vertex_index = std::uint32_t;
+    using size_type    = std::size_t;
+    using heap_type    = indexed_dary_heap<Distance>;
+
+    /** \brief Prepares the workspace for a new search over a graph with
+     *         \a vertex_count vertices.
+     */
+    void begin_search(size_type vertex_count)
+    {
+        if (stamps.size() < vertex_count) {
+            stamps.resize(vertex_count, 0);
+            distances.resize(vertex_count);
+            predecessors.resize(vertex_count);
+            closed.resize(vertex_count);
+        }
+        frontier.reserve(vertex_count);
+        frontier.clear();
+
+        if (++generation == 0) { // stamps wrapped around, so actually clear them
+            std::fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
+        }
+    }
+
+    /** \brief Returns `true` if \a vertex was reached in the current search.
+     */
+    bool reached(vertex_index vertex) const noexcept
+    {
+        return vertex < stamps.size() && stamps[vertex] == generation;
+    }
+
+    /** \brief Returns the best known distance from the start to \a vertex.
+     *
+     * Only meaningful if #reached returns `true` for \a vertex.
+     */
+    const Distance& distance(vertex_index vertex) const noexcept { return distances[vertex]; }
+
+    /** \brief Returns the predecessor of \a vertex on the best known path from the start.
+     *
+     * Only meaningful if #reached returns `true` for \a vertex.
+     */
+    vertex_index predecessor(vertex_index vertex) const noexcept { return predecessors[vertex]; }
+
+    /** \brief Returns `true` if \a vertex was expanded in the current search.
+     */
+    bool expanded(vertex_index vertex) const noexcept { return reached(vertex) && closed[vertex]; }
+
+    /** \brief Records \a distance and \a predecessor for \a vertex if it was not yet
+     *         reached or if \a distance improves upon the current distance.
+     *
+     * \return `true` if the vertex was updated, otherwise `false`.
+     */
+    bool relax(vertex_index vertex, vertex_index predecessor, const Distance& distance) noexcept
+    {
+        if (reached(vertex) && !(distance < distances[vertex]))
+            return false;
+
+        stamps[vertex]       = generation;
+        distances[vertex]    = distance;
+        predecessors[vertex] = predecessor;
+        closed[vertex]       = false;
+        return true;
+    }
+
+    /** \brief Marks \a vertex as expanded.
+     */
+    void close(vertex_index vertex) noexcept { closed[vertex] = true; }
+
+    heap_type frontier; ///< The open set, keyed on estimated total distance.
+
+    std::vector<vertex_index> path; ///< Storage for the last path built by #get_path.
+
+private:
+    std::uint32_t              generation = 0;
+    std::vector<std::uint32_t> stamps;
+    std::vector<Distance>      distances;
+    std::vector<vertex_index>  predecessors;
+    std::vector<bool>          closed;
 };
 
+/** \brief Performs an A* search from \a start to \a goal, storing the results in
+ *         \a workspace.
+ *
+ * \param[in]     heuristic      Invoked as `heuristic(node, goal_node)`.
+ * \param[in]     visitor        Invoked as `visitor(predecessor_node, node)` as each
+ *                               node is expanded, returns `false` to halt evaluation.
+ * \param[in]     edge_predicate Invoked as `edge_predicate(node, node, edge)`, returns
+ *                               `false` to ignore the edge.
+ * \return `true` if \a goal was expanded, otherwise `false`.
+ */
 template<
     class Node, class Edge,
     class Heuristic,
     class Visitor,
     class EdgePredicate,
-    class Distance = decltype(std::declval<const Heuristic&>()(std::declval<const Node&>(), std::declval<const Node&>())),
-    class Vertex   = typename compiled_adjacency_list<Node, Edge>::iterator
->
-std::unordered_map<
-    Vertex,
-    astar_search_entry<Vertex, Distance>,
-    map_iterator_hasher<Vertex>
+    class Distance
 >
+bool
 astar_search(const compiled_adjacency_list<Node, Edge>& graph,
-             const Vertex& start,
-             const Vertex& goal,
-             const Heuristic& heuristic, // invoked as heuristic(node, goal_node)
-             Visitor visitor,  // invoked as visitor(predecessor_node, node), returns false to halt evaluation
-             const EdgePredicate& edge_predicate) // invoked as edge_predicate(node, node, edge)
+             astar_workspace<Distance>& workspace,
+             const typename compiled_adjacency_list<Node, Edge>::iterator& start,
+             const typename compiled_adjacency_list<Node, Edge>::iterator& goal,
+             const Heuristic& heuristic,
+             Visitor visitor,
+             const EdgePredicate& edge_predicate)
 {
-    using graph_type = compiled_adjacency_list<Node, Edge>;
-    using map_entry = astar_search_entry<Vertex, Distance>;
-    struct queue_entry {
-        Distance priority;
-        Vertex   vertex;
-    };
+    using graph_type   = compiled_adjacency_list<Node, Edge>;
+    using vertex_index = typename graph_type::vertex_index;
 
-    std::unordered_map<Vertex, map_entry, map_iterator_hasher<Vertex>> search_map;
-    std::priority_queue frontier = [] {
-        return std::priority_queue(
-            [] (const queue_entry& a, const queue_entry& b) { return a.priority > b.priority; },
-            std::vector<queue_entry>());
-    }();
-
-    auto push = [heuristic, &goal, &search_map, &frontier]
-                (Vertex   predecessor,
-                 Vertex   vertex,
-                 Distance distance) {
-        bool opened = false;
-
-        if (auto it = search_map.find(vertex); it == search_map.end())
-            search_map.emplace(vertex, map_entry{predecessor, distance, opened = true});
-        else if (distance < it->second.distance)
-            it->second = {predecessor, distance, opened = true};
-
-        if (opened)
-            frontier.push({distance + heuristic(vertex->first, goal->first), vertex});
-    };
+    const vertex_index start_index = graph_type::index(start);
+    const vertex_index goal_index  = graph_type::index(goal);
+    const Node&        goal_node   = graph.node(goal_index);
+
+    workspace.begin_search(graph.size());
+    auto& frontier = workspace.frontier;
 
-    push(start, start, static_cast<Distance>(0));
+    workspace.relax(start_index, start_index, static_cast<Distance>(0));
+    frontier.push_or_update(start_index, heuristic(graph.node(start_index), goal_node));
     while (!frontier.empty()) {
-        const Vertex vertex = frontier.top().vertex;
-        const auto& [node, edges] = *vertex;
-        const map_entry& entry = search_map.at(vertex);
+        const vertex_index vertex = frontier.top().vertex;
         frontier.pop();
-
-        if (!entry.open)
-            continue;
-
-        const Distance distance = entry.distance;
-        if (!visitor(entry.predecessor->first, node) || vertex == goal)
-            break;
-
-        for (const typename graph_type::edge_type& edge : edges)
-            if (edge_predicate(edge.source->first, edge.target->first, edge))
-                push(edge.source, edge.target, distance + edge->distance);
+        workspace.close(vertex);
+
+        const Node& node = graph.node(vertex);
+        if (!visitor(graph.node(workspace.predecessor(vertex)), node))
+            return false;
+        else if (vertex == goal_index)
+            return true;
+
+        const Distance distance = workspace.distance(vertex);
+        for (const typename graph_type::edge_type& edge : graph.egress_edges(vertex)) {
+            if (workspace.expanded(edge.target)
+                || !edge_predicate(node, graph.node(edge.target), edge))
+                continue;
+
+            const Distance target_distance = distance + edge->distance;
+            if (workspace.relax(edge.target, vertex, target_distance)) {
+                frontier.push_or_update(edge.target,
+                                        target_distance + heuristic(graph.node(edge.target), goal_node));
+            }
+        }
     }
 
-    return search_map;
+    return false;
 }
 
-template<class Vertex, class Distance, class... MapArgs>
-std::optional<std::vector<Vertex>>
-get_path(const Vertex& start,
-         const Vertex& goal,
-         const std::unordered_map<Vertex, astar_search_entry<Vertex, Distance>,
-                                  MapArgs...>& search_map)
+/** \brief Reconstructs the path from \a start to \a goal from the last search
+ *         performed in \a workspace.
+ *
+ * The path is stored in `workspace.path`, the storage of which is reused.
+ *
+ * \param[in] start The vertex iterator the search started from.
+ * \param[in] goal  The vertex iterator of the goal of the search, into the same graph.
+ * \return An optional containing the span of vertex indices on the path, excluding
+ *         \a start and including \a goal, or `std::nullopt` if \a goal was not reached.
+ */
+template<class Distance, class VertexIterator>
+std::optional<rough_span<typename std::vector<std::uint32_t>::const_iterator>>
+get_path(astar_workspace<Distance>& workspace,
+         const VertexIterator&      start,
+         const VertexIterator&      goal)
 {
-    auto it = search_map.find(goal);
-    auto end = search_map.find(start);
+    using vertex_index = typename astar_workspace<Distance>::vertex_index;
+
+    const vertex_index start_index = start.index();
+    vertex_index       vertex      = goal.index();
 
-    if (it == search_map.end() || end == search_map.end())
+    if (!workspace.reached(vertex) || !workspace.reached(start_index))
         return std::nullopt;
 
-    std::vector<Vertex> path;
-    for (; it != end; it = search_map.find(it->second.predecessor))
-        path.push_back(it->first);
+    auto& path = workspace.path;
+    path.clear();
+    for (; vertex != start_index; vertex = workspace.predecessor(vertex))
+        path.push_back(vertex);
     std::reverse(path.begin(), path.end());
 
-    return std::make_optional(path);
+    return rough_span(path.cbegin(), path.cend());
 }
 
+/** \brief An incremental shortest-path planner for a moving target (Moving Target
+ *         D* Lite) that keeps its search state between queries.
+ *
+ * The planner searches forwards from the start, so that every vertex it has settled
+ * knows its distance from the start along a tree of best predecessors.
+ * When the goal vertex moves, the heuristic is offset (by the key modifier) rather
+ * than recomputing the queue keys, and the search continues towards the new goal.
+ * When the start vertex moves to a vertex the search has settled, the subtree
+ * rooted at the new start is kept and only the vertices outside of it are reset and
+ * repaired; a start the search has not settled restarts the search.
+ * When an edge cost changes, only the vertex it leads to is made inconsistent.
+ * As a result, a query following a small change typically expands a handful of
+ * vertices, rather than re-expanding the entire search region.
+ *
+ * The heuristic must be consistent and is invoked as `heuristic(node, goal_node)`.
+ * Edge costs are supplied by a cost function invoked as `cost(node, node, edge)`,
+ * which returns an infinite distance for untraversable edges. The planner assumes
+ * costs do not change between calls unless reported through #notify_edge_changed.
+ */
+template<class Node, class Edge, class Distance = float>
+class incremental_planner {
+public:
+    using graph_type   = compiled_adjacency_list<Node, Edge>;
+    using vertex_index = typename graph_type::vertex_index;
+    using iterator     = typename graph_type::iterator;
+    using size_type    = std::size_t;
+
+    static constexpr vertex_index no_vertex = static_cast<vertex_index>(-1);
+
+    /** \brief Returns the graph the planner is bound to, or `nullptr` if unbound.
+     */
+    const graph_type* get_graph() const noexcept { return graph; }
+
+    /** \brief Discards all search state and binds the planner to \a graph_.
+     */
+    void reset(const graph_type& graph_)
+    {
+        graph = std::addressof(graph_);
+        if (stamps.size() < graph->size()) {
+            stamps.resize(graph->size(), 0);
+            g_values.resize(graph->size());
+            rhs_values.resize(graph->size());
+            parents.resize(graph->size());
+            marks.resize(graph->size(), mark_unknown);
+        }
+        queue.reserve(graph->size());
+        touched.reserve(graph->size());
+        scratch.reserve(graph->size());
+
+        start = goal = no_vertex;
+        clear_search();
+    }
+
+    /** \brief Returns `true` if the planner has both a start and goal vertex.
+     */
+    bool has_query() const noexcept { return start != no_vertex && goal != no_vertex; }
+
+    /** \brief Moves the start vertex to \a vertex.
+     *
+     * If the search has settled \a vertex, the subtree of the search rooted at
+     * \a vertex is kept. Otherwise the search starts over from \a vertex.
+     */
+    template<class Heuristic, class Cost>
+    void set_start(const iterator& vertex, const Heuristic& heuristic, const Cost& cost)
+    {
+        const vertex_index index = graph_type::index(vertex);
+        if (index == start)
+            return;
+
+        const vertex_index old_start = start;
+        start = index;
+        if (old_start == no_vertex || !(g(start) < infinity) || g(start) != rhs(start)) {
+            clear_search();
+            rhs(start) = static_cast<Distance>(0);
+            queue.push_or_update(start, calculate_key(start, heuristic));
+            return;
+        }
+
+        // the new start keeps its distance from the old start, which offsets every
+        // distance in its subtree equally and so leaves the search consistent
+        parent(start) = no_vertex;
+        delete_outside_subtree(heuristic, cost);
+    }
+
+    /** \brief Moves the goal vertex to \a vertex.
+     */
+    template<class Heuristic>
+    void set_goal(const iterator& vertex, const Heuristic& heuristic)
+    {
+        const vertex_index index = graph_type::index(vertex);
+        if (index == goal)
+            return;
+
+        if (goal != no_vertex)
+            key_modifier += heuristic(graph->node(goal), graph->node(index));
+        goal = index;
+    }
+
+    /** \brief Informs the planner that the cost of \a edge has changed.
+     */
+    template<class Heuristic, class Cost>
+    void notify_edge_changed(const typename graph_type::edge_type& edge,
+                             const Heuristic& heuristic,
+                             const Cost& cost)
+    {
+        if (start == no_vertex || edge.target == start)
+            return;
+
+        update_rhs(edge.target, cost);
+        update_state(edge.target, heuristic);
+    }
+
+    /** \brief Repairs the search state for the current start and goal.
+     *
+     * \param[in] visitor Invoked as `visitor(node)` for each vertex expanded,
+     *                    returns `false` to halt the repair. A halted repair is
+     *                    resumed by the next call.
+     * \return `true` if the search state is repaired for the goal vertex, otherwise
+     *         `false`.
+     */
+    template<class Heuristic, class Cost, class Visitor>
+    bool compute(const Heuristic& heuristic, const Cost& cost, Visitor visitor)
+    {
+        if (!has_query())
+            return false;
+
+        while (!queue.empty()
+               && (queue.top().key < calculate_key(goal, heuristic)
+                   || rhs(goal) > g(goal))) {
+            const vertex_index u = queue.top().vertex;
+            const key_type k_old = queue.top().key;
+            const key_type k_new = calculate_key(u, heuristic);
+
+            if (k_old < k_new) {
+                queue.push_or_update(u, k_new);
+                continue;
+            }
+
+            if (!visitor(graph->node(u)))
+                return false;
+
+            if (g(u) > rhs(u)) {
+                g(u) = rhs(u);
+                queue.erase(u);
+                for (const typename graph_type::edge_type& edge : graph->egress_edges(u)) {
+                    const vertex_index s = edge.target;
+                    if (s == start)
+                        continue;
+
+                    const Distance d = g(u) + cost(graph->node(u), graph->node(s), edge);
+                    if (d < rhs(s)) {
+                        parent(s) = u;
+                        rhs(s)    = d;
+                        update_state(s, heuristic);
+                    }
+                }
+            } else {
+                g(u) = infinity;
+                update_state(u, heuristic);
+                for (const typename graph_type::edge_type& edge : graph->egress_edges(u)) {
+                    const vertex_index s = edge.target;
+                    if (s != start && parent(s) == u) {
+                        update_rhs(s, cost);
+                        update_state(s, heuristic);
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /** \brief Returns the distance from the start vertex to the goal, or infinity if
+     *         the goal is unreachable or unknown.
+     *
+     * Only meaningful once #compute has returned `true`.
+     */
+    Distance distance_to_goal() const noexcept { return has_query() ? rhs(goal) - rhs(start) : infinity; }
+
+    /** \brief Follows the best predecessors back from the goal to find the path from the
+     *         start vertex.
+     *
+     * Only meaningful once #compute has returned `true`.
+     *
+     * \param[in]  max_count The maximum number of vertices to write.
+     * \param[out] out       The output iterator receiving the first vertex indices on
+     *                       the path, excluding the start vertex.
+     * \return The number of vertices written to \a out.
+     */
+    template<class OutputIt>
+    size_type get_path(size_type max_count, OutputIt out)
+    {
+        if (!has_query() || !(rhs(goal) < infinity))
+            return 0;
+
+        scratch.clear();
+        for (vertex_index u = goal; u != start; u = parent(u)) {
+            if (u == no_vertex || scratch.size() == graph->size())
+                return 0; // the tree does not reach the start
+            scratch.push_back(u);
+        }
+
+        const size_type count = std::min(max_count, scratch.size());
+        std::copy(scratch.rbegin(), scratch.rbegin() + count, out);
+        return count;
+    }
+
+private:
+    static constexpr Distance infinity = std::numeric_limits<Distance>::infinity();
+
+    struct key_type {
+        Distance primary;
+        Distance secondary;
+
+        bool operator<(const key_type& other) const noexcept
+        {
+            return primary < other.primary
+                || (!(other.primary < primary) && secondary < other.secondary);
+        }
+    };
+
+    // the classification of vertices when the start moves
+    static constexpr std::uint8_t mark_unknown  = 0;
+    static constexpr std::uint8_t mark_visiting = 1;
+    static constexpr std::uint8_t mark_inside   = 2; ///< In the subtree of the start.
+    static constexpr std::uint8_t mark_outside  = 3;
+
+    const graph_type* graph = nullptr;
+
+    vertex_index start = no_vertex;
+    vertex_index goal  = no_vertex;
+    Distance     key_modifier = static_cast<Distance>(0);
+
+    std::uint32_t              generation = 0;
+    std::vector<std::uint32_t> stamps;
+    std::vector<Distance>      g_values;
+    std::vector<Distance>      rhs_values;
+    std::vector<vertex_index>  parents;
+    std::vector<std::uint8_t>  marks;   ///< Only set while the start moves.
+    std::vector<vertex_index>  touched; ///< The vertices stamped this generation.
+    std::vector<vertex_index>  scratch;
+
+    indexed_dary_heap<key_type> queue;
+
+    void clear_search()
+    {
+        queue.clear();
+        touched.clear();
+        key_modifier = static_cast<Distance>(0);
+        if (++generation == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
+        }
+    }
+
+    void touch(vertex_index v)
+    {
+        if (stamps[v] != generation) {
+            stamps[v]     = generation;
+            g_values[v]   = infinity;
+            rhs_values[v] = infinity;
+            parents[v]    = no_vertex;
+            touched.push_back(v);
+        }
+    }
+
+    Distance&     g(vertex_index v)      { touch(v); return g_values[v]; }
+    Distance&     rhs(vertex_index v)    { touch(v); return rhs_values[v]; }
+    vertex_index& parent(vertex_index v) { touch(v); return parents[v]; }
+
+    Distance g(vertex_index v) const noexcept { return stamps[v] == generation ? g_values[v] : infinity; }
+    Distance rhs(vertex_index v) const noexcept { return stamps[v] == generation ? rhs_values[v] : infinity; }
+
+    template<class Heuristic>
+    key_type calculate_key(vertex_index v, const Heuristic& heuristic) const
+    {
+        // without a goal vertex the key is underestimated, to be corrected when popped
+        const Distance m = std::min(g(v), rhs(v));
+        const Distance h = goal != no_vertex ? heuristic(graph->node(v), graph->node(goal))
+                                             : static_cast<Distance>(0);
+        return {m + h + key_modifier, m};
+    }
+
+    /** \brief Sets the right-hand side value of \a v from its best predecessor.
+     */
+    template<class Cost>
+    void update_rhs(vertex_index v, const Cost& cost)
+    {
+        Distance     best        = infinity;
+        vertex_index best_parent = no_vertex;
+        for (const typename graph_type::edge_type& edge : graph->ingress_edges(v)) {
+            const Distance d = g(edge.source) + cost(graph->node(edge.source), graph->node(v), edge);
+            if (d < best) {
+                best        = d;
+                best_parent = edge.source;
+            }
+        }
+
+        rhs(v)    = best;
+        parent(v) = best_parent;
+    }
+
+    template<class Heuristic>
+    void update_state(vertex_index u, const Heuristic& heuristic)
+    {
+        if (g(u) != rhs(u)) queue.push_or_update(u, calculate_key(u, heuristic));
+        else                queue.erase(u);
+    }
+
+    /** \brief Resets the vertices of the search outside of the subtree rooted at the
+     *         start vertex, and makes those adjacent to the subtree inconsistent.
+     */
+    template<class Heuristic, class Cost>
+    void delete_outside_subtree(const Heuristic& heuristic, const Cost& cost)
+    {
+        // each vertex is classified by following its predecessors until reaching the
+        // start or a vertex already classified, then the whole chain is classified
+        const size_type touched_count = touched.size();
+        for (size_type i = 0; i < touched_count; ++i) {
+            scratch.clear();
+            vertex_index u = touched[i];
+            while (u != no_vertex && u != start && marks[u] == mark_unknown) {
+                marks[u] = mark_visiting;
+                scratch.push_back(u);
+                u = parents[u];
+            }
+
+            const std::uint8_t mark = u == start || (u != no_vertex && marks[u] == mark_inside)
+                ? mark_inside : mark_outside;
+            for (vertex_index v : scratch)
+                marks[v] = mark;
+        }
+
+        scratch.clear();
+        for (size_type i = 0; i < touched_count; ++i) {
+            const vertex_index v = touched[i];
+            if (marks[v] == mark_outside) {
+                g_values[v]   = infinity;
+                rhs_values[v] = infinity;
+                parents[v]    = no_vertex;
+                queue.erase(v);
+                scratch.push_back(v);
+            }
+            marks[v] = mark_unknown;
+        }
+
+        for (vertex_index v : scratch) {
+            update_rhs(v, cost);
+            if (rhs(v) < infinity)
+                queue.push_or_update(v, calculate_key(v, heuristic));
+        }
+    }
+};
+
 } // namespace simulacrum
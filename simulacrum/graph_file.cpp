@@ -0,0 +1,338 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "graph.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+
+namespace {
+
+using graph_type = simulacrum::navigation_graph::graph_type;
+
+static_assert(std::is_trivially_copyable_v<simulacrum::navigation_graph_node>
+              && std::is_trivially_copyable_v<graph_type::edge_type>,
+              "navigation graph elements must be trivially copyable to be mapped");
+
+/** \brief The version of the navigation graph file format.
+ *
+ * This must be incremented whenever the layout of the file or the graph elements
+ * changes. Changes to the way the graph is built are covered by the key, through
+ * simulacrum::navigation_builder_fingerprint.
+ */
+constexpr std::uint32_t file_version = 2;
+
+constexpr char file_magic[8] = {'S', 'I', 'M', 'N', 'A', 'V', 'G', '\0'};
+
+enum file_section {
+    section_nodes,
+    section_edges,
+    section_edge_offsets,
+    section_ingress_edge_indices,
+    section_ingress_offsets,
+    section_surface_vertices,
+    section_edge_vertices,
+    section_count
+};
+
+/** \brief The header of a navigation graph file.
+ *
+ * Each section is aligned to #section_alignment bytes, so that the sections of a
+ * mapped file can be used in place.
+ */
+struct file_header {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t node_size;       ///< `sizeof` the node type, as a layout check.
+    std::uint32_t edge_size;       ///< `sizeof` the edge type, as a layout check.
+    std::uint32_t node_count;
+    std::uint32_t edge_count;
+    std::uint32_t surface_count;   ///< The number of entries in the surface table.
+    std::uint32_t cbsp_edge_count; ///< The number of entries in the edge table.
+    std::uint32_t reserved;
+    std::uint64_t key;
+    std::uint64_t file_size;
+    std::uint64_t section_offsets[section_count];
+};
+
+constexpr std::uint64_t section_alignment = 16;
+
+constexpr std::uint64_t align_section(std::uint64_t offset)
+{
+    return (offset + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+/** \brief Computes the size of each section of a file described by \a header.
+ */
+std::array<std::uint64_t, section_count> get_section_sizes(const file_header& header);
+
+/** \brief Returns `true` if the offsets of \a view never decrease and span its edges,
+ *         and every edge and edge index is in bounds and grouped under its vertex.
+ */
+bool is_consistent(const graph_type::storage_view& view);
+
+/** \brief Creates the directories leading up to \a filename, if they do not exist.
+ */
+void create_parent_directories(const std::string& filename);
+
+} // namespace (anonymous)
+
+namespace simulacrum {
+
+std::uint64_t navigation_graph_key(const sentinel::tags::collision_bsp& cbsp,
+                                   const scenery_snapshot& scenery)
+{
+    // FNV-1a, over everything that the navigation graph is built from
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    auto hash_bytes = [&hash] (const void* data, std::size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    };
+
+    auto hash_block = [&hash_bytes] (const auto& block) {
+        using value_type = typename std::decay_t<decltype(block)>::value_type;
+        hash_bytes(&block.count, sizeof(block.count));
+        hash_bytes(block.data, sizeof(value_type) * std::max<decltype(block.count)>(block.count, 0));
+    };
+
+    auto hash_vector = [&hash_bytes] (const auto& v) {
+        using value_type = typename std::decay_t<decltype(v)>::value_type;
+        const std::uint64_t count = v.size();
+        hash_bytes(&count, sizeof(count));
+        hash_bytes(v.data(), sizeof(value_type) * v.size());
+    };
+
+    hash_block(cbsp.planes);
+    hash_block(cbsp.surfaces);
+    hash_block(cbsp.edges);
+    hash_block(cbsp.vertices);
+
+    hash_vector(scenery.objects);
+    hash_vector(scenery.sphere_x);
+    hash_vector(scenery.sphere_y);
+    hash_vector(scenery.sphere_z);
+    hash_vector(scenery.sphere_radius);
+
+    const std::uint64_t fingerprint = navigation_builder_fingerprint();
+    hash_bytes(&fingerprint, sizeof(fingerprint));
+    return hash;
+}
+
+bool navigation_graph::write_file(const std::string& filename, std::uint64_t key) const
+{
+    const graph_type::storage_view& view = graph.storage();
+    if (view.node_count == 0)
+        return false;
+
+    file_header header = {};
+    std::copy(std::begin(file_magic), std::end(file_magic), header.magic);
+    header.version         = file_version;
+    header.node_size       = sizeof(node_type);
+    header.edge_size       = sizeof(graph_type::edge_type);
+    header.node_count      = view.node_count;
+    header.edge_count      = view.edge_count;
+    header.surface_count   = static_cast<std::uint32_t>(surface_vertices.size());
+    header.cbsp_edge_count = static_cast<std::uint32_t>(edge_vertices.size());
+    header.key             = key;
+
+    const void* const section_data[section_count] = {
+        view.nodes, view.edges, view.edge_offsets,
+        view.ingress_edge_indices, view.ingress_offsets,
+        surface_vertices.data(), edge_vertices.data()
+    };
+    const auto section_sizes = get_section_sizes(header);
+
+    std::uint64_t offset = align_section(sizeof(header));
+    for (int i = 0; i < section_count; ++i) {
+        header.section_offsets[i] = offset;
+        offset = align_section(offset + section_sizes[i]);
+    }
+    header.file_size = offset;
+
+    create_parent_directories(filename);
+
+    // builds for the same map may overlap, such as after a quick reload, so each
+    // thread writes to its own file
+    const std::string temporary_filename = filename
+                                         + '.' + std::to_string(GetCurrentProcessId())
+                                         + '.' + std::to_string(GetCurrentThreadId())
+                                         + ".tmp";
+    {
+        std::ofstream out(temporary_filename, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        static constexpr char padding[section_alignment] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::uint64_t position = sizeof(header);
+        for (int i = 0; i < section_count; ++i) {
+            out.write(padding, header.section_offsets[i] - position);
+            out.write(static_cast<const char*>(section_data[i]), section_sizes[i]);
+            position = header.section_offsets[i] + section_sizes[i];
+        }
+        out.write(padding, header.file_size - position);
+        out.close();
+
+        if (!out) {
+            DeleteFileA(temporary_filename.c_str());
+            return false;
+        }
+    }
+
+    if (!MoveFileExA(temporary_filename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temporary_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<navigation_graph>
+navigation_graph::map_file(const std::string& filename, std::uint64_t key)
+{
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return std::nullopt;
+
+    LARGE_INTEGER size = {};
+    HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG)sizeof(file_header)
+                   ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)
+                   : NULL;
+    CloseHandle(file); // the mapping refers to the file
+    if (mapping == NULL)
+        return std::nullopt;
+
+    const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view refers to the mapping
+    if (base == NULL)
+        return std::nullopt;
+
+    std::shared_ptr<const void> owner(base, [] (const void* view) { UnmapViewOfFile(view); });
+
+    const file_header& header = *static_cast<const file_header*>(base);
+    if (!std::equal(std::begin(file_magic), std::end(file_magic), header.magic)
+        || header.version != file_version
+        || header.node_size != sizeof(node_type)
+        || header.edge_size != sizeof(graph_type::edge_type)
+        || header.key != key
+        || header.file_size != static_cast<std::uint64_t>(size.QuadPart)
+        || header.node_count == 0)
+        return std::nullopt;
+
+    const auto section_sizes = get_section_sizes(header);
+    const char* sections[section_count] = {};
+    for (int i = 0; i < section_count; ++i) {
+        const std::uint64_t offset = header.section_offsets[i];
+        if (offset % section_alignment != 0
+            || offset > header.file_size
+            || section_sizes[i] > header.file_size - offset)
+            return std::nullopt;
+        sections[i] = static_cast<const char*>(base) + offset;
+    }
+
+    graph_type::storage_view view;
+    view.nodes                = reinterpret_cast<const node_type*>(sections[section_nodes]);
+    view.edges                = reinterpret_cast<const graph_type::edge_type*>(sections[section_edges]);
+    view.edge_offsets         = reinterpret_cast<const graph_type::vertex_index*>(sections[section_edge_offsets]);
+    view.ingress_edge_indices = reinterpret_cast<const std::uint32_t*>(sections[section_ingress_edge_indices]);
+    view.ingress_offsets      = reinterpret_cast<const graph_type::vertex_index*>(sections[section_ingress_offsets]);
+    view.node_count           = header.node_count;
+    view.edge_count           = header.edge_count;
+
+    if (!is_consistent(view))
+        return std::nullopt;
+
+    const auto* surface_table = reinterpret_cast<const graph_type::vertex_index*>(sections[section_surface_vertices]);
+    const auto* edge_table    = reinterpret_cast<const graph_type::vertex_index*>(sections[section_edge_vertices]);
+    auto is_vertex = [&header] (graph_type::vertex_index vertex) {
+        return vertex < header.node_count || vertex == no_vertex;
+    };
+    if (!std::all_of(surface_table, surface_table + header.surface_count, is_vertex)
+        || !std::all_of(edge_table, edge_table + header.cbsp_edge_count, is_vertex))
+        return std::nullopt;
+
+    std::optional<navigation_graph> result(std::in_place);
+    result->graph = graph_type(view, std::move(owner));
+    result->surface_vertices.assign(surface_table, surface_table + header.surface_count);
+    result->edge_vertices.assign(edge_table, edge_table + header.cbsp_edge_count);
+    result->index_spatially();
+    return result;
+}
+
+} // namespace simulacrum
+
+namespace {
+
+std::array<std::uint64_t, section_count> get_section_sizes(const file_header& header)
+{
+    using vertex_index = graph_type::vertex_index;
+
+    std::array<std::uint64_t, section_count> sizes = {};
+    sizes[section_nodes]                = std::uint64_t(header.node_count) * header.node_size;
+    sizes[section_edges]                = std::uint64_t(header.edge_count) * header.edge_size;
+    sizes[section_edge_offsets]         = (std::uint64_t(header.node_count) + 1) * sizeof(vertex_index);
+    sizes[section_ingress_edge_indices] = std::uint64_t(header.edge_count) * sizeof(std::uint32_t);
+    sizes[section_ingress_offsets]      = (std::uint64_t(header.node_count) + 1) * sizeof(vertex_index);
+    sizes[section_surface_vertices]     = std::uint64_t(header.surface_count) * sizeof(vertex_index);
+    sizes[section_edge_vertices]        = std::uint64_t(header.cbsp_edge_count) * sizeof(vertex_index);
+    return sizes;
+}
+
+bool is_consistent(const graph_type::storage_view& view)
+{
+    using vertex_index = graph_type::vertex_index;
+
+    auto spans_edges = [&view] (const vertex_index* offsets) {
+        if (offsets[0] != 0 || offsets[view.node_count] != view.edge_count)
+            return false;
+        for (vertex_index vertex = 0; vertex < view.node_count; ++vertex) {
+            if (offsets[vertex + 1] < offsets[vertex])
+                return false;
+        }
+        return true;
+    };
+
+    if (!spans_edges(view.edge_offsets) || !spans_edges(view.ingress_offsets))
+        return false;
+
+    for (vertex_index vertex = 0; vertex < view.node_count; ++vertex) {
+        for (std::uint32_t i = view.edge_offsets[vertex]; i < view.edge_offsets[vertex + 1]; ++i) {
+            const graph_type::edge_type& edge = view.edges[i];
+            if (edge.source != vertex || edge.target >= view.node_count)
+                return false;
+        }
+
+        for (std::uint32_t i = view.ingress_offsets[vertex]; i < view.ingress_offsets[vertex + 1]; ++i) {
+            const std::uint32_t edge = view.ingress_edge_indices[i];
+            if (edge >= view.edge_count || view.edges[edge].target != vertex)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void create_parent_directories(const std::string& filename)
+{
+    for (std::size_t i = filename.find_first_of("\\/");
+         i != std::string::npos;
+         i = filename.find_first_of("\\/", i + 1)) {
+        // failure is expected where the directory already exists
+        CreateDirectoryA(filename.substr(0, i).c_str(), NULL);
+    }
+}
+
+} // namespace (anonymous)
@@ -0,0 +1,78 @@
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+// The parts of the navigation graph that read the loaded map, kept apart from graph.cpp
+// so that graphs can be built from synthetic geometry without the game.
+
+#include "graph.hpp"
+#include "bsp_interface.hpp"
+#include "utility.hpp"
+
+#include <vector>
+
+#include <boost/geometry.hpp>
+
+#include <sentinel/structures/object.hpp>
+#include <sentinel/tags/object.hpp>
+#include <sentinel/tags/collision_model.hpp>
+#include <sentutil/all.hpp>
+
+namespace simulacrum {
+
+scenery_snapshot snapshot_scenery()
+{
+    using box_type = boost::geometry::model::box<sentinel::real3d>;
+
+    scenery_snapshot snapshot;
+    auto visitor = [&snapshot] (sentinel::object&       object,
+                                sentinel::tags::object& definition)
+    {
+        if (!definition.object.collision_model)
+            return;
+
+        const sentinel::tags::collision_model& coll = *definition.object.collision_model;
+        const std::size_t first_sphere = snapshot.sphere_radius.size();
+        for (const auto& sphere : coll.pathfinding.spheres) {
+            const sentinel::real3d center = sphere.node < 0
+                ? object.object.position + sphere.center
+                : object.object.node_transforms[sphere.node] * sphere.center;
+            snapshot.sphere_x.push_back(center[0]);
+            snapshot.sphere_y.push_back(center[1]);
+            snapshot.sphere_z.push_back(center[2]);
+            snapshot.sphere_radius.push_back(sphere.radius);
+        }
+
+        snapshot.objects.push_back({
+            box_type{object.object.bound_center - sentinel::real3d::filled(object.object.bound_radius),
+                     object.object.bound_center + sentinel::real3d::filled(object.object.bound_radius)},
+            static_cast<std::uint32_t>(first_sphere),
+            static_cast<std::uint32_t>(snapshot.sphere_radius.size() - first_sphere)
+        });
+    };
+
+    visit_map_scenery(visitor);
+    return snapshot;
+}
+
+navigation_graph::navigation_graph(this_collision_bsp_tag)
+    : navigation_graph(utility::interface_cbsp{*sentutil::globals::map_globals->collision_bsp})
+{
+
+}
+
+navigation_graph::navigation_graph(const utility::interface_cbsp& cbsp)
+    : navigation_graph(cbsp, snapshot_scenery())
+{
+
+}
+
+navigation_graph::navigation_graph(const utility::interface_cbsp& cbsp,
+                                   const scenery_snapshot& scenery)
+    : navigation_graph(utility::compiled_cbsp(cbsp.collision_bsp.get()), scenery)
+{
+
+}
+
+} // namespace simulacrum
@@ -0,0 +1,281 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "hierarchy.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <numeric>
+
+namespace {
+
+using graph_type   = simulacrum::navigation_graph::graph_type;
+using vertex_index = graph_type::vertex_index;
+
+/** \brief Runs Dijkstra's algorithm from \a source over the vertices in the cluster
+ *         of \a source, stopping once \a stop is expanded.
+ *
+ * If \a Reverse is `true`, edges are followed backwards, so that the distances are
+ * to \a source and the predecessor of each vertex is its successor on the path to
+ * \a source.
+ */
+template<bool Reverse>
+void search_cluster(const graph_type& graph,
+                    const std::vector<std::uint32_t>& clusters,
+                    simulacrum::astar_workspace<float>& workspace,
+                    vertex_index source,
+                    vertex_index stop);
+
+} // namespace (anonymous)
+
+namespace simulacrum {
+
+navigation_hierarchy::navigation_hierarchy(const navigation_graph& nav_graph,
+                                           float cell_size)
+    : graph(std::addressof(nav_graph.get_graph()))
+    , vertex_clusters()
+    , vertex_entrances()
+    , entrance_vertices()
+    , cluster_entrances()
+    , cluster_entrance_offsets()
+    , abstract_edges()
+    , abstract_edge_offsets()
+{
+    const graph_type& g = *graph;
+    const vertex_index vertex_count = static_cast<vertex_index>(g.size());
+
+    { // cluster vertices by the cell they lie in
+        std::map<std::array<long, 3>, cluster_index> cells;
+        vertex_clusters.resize(vertex_count);
+        for (vertex_index v = 0; v < vertex_count; ++v) {
+            const sentinel::real3d& point = g.node(v).point;
+            const std::array<long, 3> cell {
+                static_cast<long>(std::floor(point[0] / cell_size)),
+                static_cast<long>(std::floor(point[1] / cell_size)),
+                static_cast<long>(std::floor(point[2] / cell_size))
+            };
+            vertex_clusters[v] = cells.try_emplace(cell, static_cast<cluster_index>(cells.size())).first->second;
+        }
+        cluster_entrance_offsets.assign(cells.size() + 1, 0);
+    }
+
+    { // entrances are the vertices on either side of an edge between clusters
+        std::vector<bool> is_entrance(vertex_count, false);
+        for (vertex_index v = 0; v < vertex_count; ++v) {
+            for (const auto& edge : g.egress_edges(v)) {
+                if (vertex_clusters[edge.source] != vertex_clusters[edge.target])
+                    is_entrance[edge.source] = is_entrance[edge.target] = true;
+            }
+        }
+
+        vertex_entrances.assign(vertex_count, no_vertex);
+        for (vertex_index v = 0; v < vertex_count; ++v) {
+            if (!is_entrance[v])
+                continue;
+            vertex_entrances[v] = static_cast<std::uint32_t>(entrance_vertices.size());
+            entrance_vertices.push_back(v);
+        }
+    }
+
+    { // group entrances by cluster
+        for (vertex_index v : entrance_vertices)
+            ++cluster_entrance_offsets[vertex_clusters[v] + 1];
+        std::partial_sum(cluster_entrance_offsets.begin(), cluster_entrance_offsets.end(),
+                         cluster_entrance_offsets.begin());
+
+        std::vector<std::uint32_t> cursor(cluster_entrance_offsets.begin(),
+                                          cluster_entrance_offsets.end() - 1);
+        cluster_entrances.resize(entrance_vertices.size());
+        for (std::uint32_t e = 0; e < entrance_vertices.size(); ++e)
+            cluster_entrances[cursor[vertex_clusters[entrance_vertices[e]]]++] = e;
+    }
+
+    { // form the abstract graph
+        astar_workspace<float> workspace;
+        abstract_edge_offsets.reserve(entrance_vertices.size() + 1);
+        abstract_edge_offsets.push_back(0);
+        for (std::uint32_t e = 0; e < entrance_vertices.size(); ++e) {
+            const vertex_index  v = entrance_vertices[e];
+            const cluster_index c = vertex_clusters[v];
+
+            for (const auto& edge : g.egress_edges(v)) {
+                if (vertex_clusters[edge.target] != c)
+                    abstract_edges.push_back({vertex_entrances[edge.target], edge->distance});
+            }
+
+            search_cluster<false>(g, vertex_clusters, workspace, v, no_vertex);
+            for (std::uint32_t i = cluster_entrance_offsets[c]; i < cluster_entrance_offsets[c + 1]; ++i) {
+                const std::uint32_t other = cluster_entrances[i];
+                if (other != e && workspace.reached(entrance_vertices[other]))
+                    abstract_edges.push_back({other, workspace.distance(entrance_vertices[other])});
+            }
+
+            abstract_edge_offsets.push_back(static_cast<std::uint32_t>(abstract_edges.size()));
+        }
+    }
+}
+
+std::optional<navigation_hierarchy::path_type>
+navigation_hierarchy::find_path(vertex_index start,
+                                vertex_index goal,
+                                hierarchy_workspace& workspace,
+                                std::size_t max_count) const
+{
+    auto& path = workspace.path;
+    path.clear();
+
+    if (!graph || start >= graph->size() || goal >= graph->size())
+        return std::nullopt;
+    else if (start == goal)
+        return path_type(path.cbegin(), path.cend());
+
+    const graph_type&   g             = *graph;
+    const cluster_index start_cluster = cluster(start);
+    const cluster_index goal_cluster  = cluster(goal);
+
+    // connect the start and goal to the entrances of their clusters
+    search_cluster<false>(g, vertex_clusters, workspace.local, start, no_vertex);
+    search_cluster<true>(g, vertex_clusters, workspace.goal, goal, no_vertex);
+
+    // search the abstract graph, where the start and goal follow the entrances
+    const std::uint32_t abstract_start = static_cast<std::uint32_t>(entrance_count());
+    const std::uint32_t abstract_goal  = abstract_start + 1;
+    auto vertex_of = [&] (std::uint32_t a) -> vertex_index {
+        return a == abstract_start ? start
+             : a == abstract_goal  ? goal
+             : entrance_vertices[a];
+    };
+
+    const sentinel::real3d& goal_point = g.node(goal).point;
+    auto heuristic = [&] (std::uint32_t a) { return norm(goal_point - g.node(vertex_of(a)).point); };
+
+    auto& abstract = workspace.abstract;
+    auto& frontier = abstract.frontier;
+    abstract.begin_search(entrance_count() + 2);
+    abstract.relax(abstract_start, abstract_start, 0.0f);
+    frontier.push_or_update(abstract_start, heuristic(abstract_start));
+
+    bool found = false;
+    while (!frontier.empty()) {
+        const std::uint32_t a = frontier.top().vertex;
+        frontier.pop();
+        abstract.close(a);
+
+        if (a == abstract_goal) {
+            found = true;
+            break;
+        }
+
+        const float distance = abstract.distance(a);
+        auto relax = [&] (std::uint32_t b, float edge_distance) {
+            if (!abstract.expanded(b) && abstract.relax(b, a, distance + edge_distance))
+                frontier.push_or_update(b, distance + edge_distance + heuristic(b));
+        };
+
+        const vertex_index v = vertex_of(a);
+        if (a == abstract_start) {
+            for (std::uint32_t i = cluster_entrance_offsets[start_cluster];
+                 i < cluster_entrance_offsets[start_cluster + 1]; ++i) {
+                const vertex_index entrance = entrance_vertices[cluster_entrances[i]];
+                if (workspace.local.reached(entrance))
+                    relax(cluster_entrances[i], workspace.local.distance(entrance));
+            }
+        } else {
+            for (std::uint32_t i = abstract_edge_offsets[a]; i < abstract_edge_offsets[a + 1]; ++i)
+                relax(abstract_edges[i].target, abstract_edges[i].distance);
+        }
+
+        if (cluster(v) == goal_cluster && workspace.goal.reached(v))
+            relax(abstract_goal, workspace.goal.distance(v));
+    }
+
+    if (!found)
+        return std::nullopt;
+
+    auto& abstract_path = workspace.abstract_path;
+    abstract_path.clear();
+    for (std::uint32_t a = abstract_goal; a != abstract_start; a = abstract.predecessor(a))
+        abstract_path.push_back(a);
+    abstract_path.push_back(abstract_start);
+    std::reverse(abstract_path.begin(), abstract_path.end());
+
+    // refine the abstract path, segment by segment, until enough vertices are known
+    for (std::size_t i = 0; i + 1 < abstract_path.size() && path.size() < max_count; ++i) {
+        const std::uint32_t a    = abstract_path[i];
+        const std::uint32_t b    = abstract_path[i + 1];
+        const vertex_index  from = vertex_of(a);
+        const vertex_index  to   = vertex_of(b);
+
+        if (b == abstract_goal) {
+            for (vertex_index v = from; v != goal; ) {
+                v = workspace.goal.predecessor(v);
+                path.push_back(v);
+            }
+        } else if (cluster(from) != cluster(to)) {
+            path.push_back(to);
+        } else {
+            if (a != abstract_start) // the search from the start is already known
+                search_cluster<false>(g, vertex_clusters, workspace.local, from, to);
+
+            const std::size_t first = path.size();
+            for (vertex_index v = to; v != from; v = workspace.local.predecessor(v))
+                path.push_back(v);
+            std::reverse(path.begin() + first, path.end());
+        }
+    }
+
+    return path_type(path.cbegin(), path.cend());
+}
+
+} // namespace simulacrum
+
+namespace {
+
+template<bool Reverse>
+void search_cluster(const graph_type& graph,
+                    const std::vector<std::uint32_t>& clusters,
+                    simulacrum::astar_workspace<float>& workspace,
+                    vertex_index source,
+                    vertex_index stop)
+{
+    const std::uint32_t cluster = clusters[source];
+    auto& frontier = workspace.frontier;
+
+    workspace.begin_search(graph.size());
+    workspace.relax(source, source, 0.0f);
+    frontier.push_or_update(source, 0.0f);
+    while (!frontier.empty()) {
+        const vertex_index vertex = frontier.top().vertex;
+        frontier.pop();
+        workspace.close(vertex);
+
+        if (vertex == stop)
+            return;
+
+        const float distance = workspace.distance(vertex);
+        auto relax = [&] (vertex_index next, const graph_type::edge_type& edge) {
+            if (clusters[next] != cluster || workspace.expanded(next))
+                return;
+
+            const float next_distance = distance + edge->distance;
+            if (workspace.relax(next, vertex, next_distance))
+                frontier.push_or_update(next, next_distance);
+        };
+
+        if constexpr (Reverse) {
+            for (const graph_type::edge_type& edge : graph.ingress_edges(vertex))
+                relax(edge.source, edge);
+        } else {
+            for (const graph_type::edge_type& edge : graph.egress_edges(vertex))
+                relax(edge.target, edge);
+        }
+    }
+}
+
+} // namespace (anonymous)
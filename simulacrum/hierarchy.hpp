@@ -0,0 +1,122 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <optional>
+#include <vector>
+
+#include "graph.hpp"
+#include "utility.hpp"
+
+namespace simulacrum {
+
+/** \brief Reusable state for #navigation_hierarchy::find_path.
+ */
+struct hierarchy_workspace {
+    astar_workspace<float> local;    ///< Search state for searches within a cluster.
+    astar_workspace<float> goal;     ///< Search state for the reverse search from the goal.
+    astar_workspace<float> abstract; ///< Search state for the abstract graph.
+
+    std::vector<std::uint32_t> abstract_path; ///< The last abstract path found.
+    std::vector<std::uint32_t> path;          ///< The last refined path found.
+};
+
+/** \brief A hierarchical abstraction of a #navigation_graph (HPA*).
+ *
+ * The vertices of the graph are partitioned into clusters by cubic cells of the
+ * world. The vertices with an edge to or from another cluster are *entrances*, which
+ * form the vertices of an abstract graph. The abstract graph has an edge for every
+ * edge between clusters, and an edge between every pair of entrances of the same
+ * cluster weighted by the shortest distance between them within the cluster.
+ *
+ * A query connects the start and goal vertices to the entrances of their clusters,
+ * searches the abstract graph, and then refines only as much of the abstract path
+ * into graph vertices as requested. Both the search and the refinement touch a small
+ * number of vertices relative to a search over the full graph, at the cost of paths
+ * that are not necessarily the shortest.
+ */
+class navigation_hierarchy {
+public:
+    using graph_type    = navigation_graph::graph_type;
+    using vertex_index  = graph_type::vertex_index;
+    using cluster_index = std::uint32_t;
+    using path_type     = rough_span<std::vector<std::uint32_t>::const_iterator>;
+
+    static constexpr float default_cell_size = 10.0f;
+
+    static constexpr vertex_index no_vertex = static_cast<vertex_index>(-1);
+
+    navigation_hierarchy() = default;
+
+    /** \brief Builds the hierarchy over \a nav_graph, clustering its vertices into
+     *         cells \a cell_size world units across.
+     *
+     * The hierarchy refers to the graph of \a nav_graph, which must outlive it and
+     * must not be modified.
+     */
+    explicit navigation_hierarchy(const navigation_graph& nav_graph,
+                                  float cell_size = default_cell_size);
+
+    /** \brief Returns the number of clusters.
+     */
+    std::size_t cluster_count() const noexcept { return cluster_entrance_offsets.empty() ? 0 : cluster_entrance_offsets.size() - 1; }
+
+    /** \brief Returns the number of vertices in the abstract graph.
+     */
+    std::size_t entrance_count() const noexcept { return entrance_vertices.size(); }
+
+    /** \brief Returns the number of edges in the abstract graph.
+     */
+    std::size_t abstract_edge_count() const noexcept { return abstract_edges.size(); }
+
+    /** \brief Returns the cluster that the vertex \a vertex belongs to.
+     */
+    cluster_index cluster(vertex_index vertex) const noexcept { return vertex_clusters[vertex]; }
+
+    /** \brief Finds a path from \a start to \a goal.
+     *
+     * The path is stored in `workspace.path`, the storage of which is reused.
+     *
+     * \param[in] max_count The number of path vertices to refine. The abstract path
+     *                      is refined only until at least this many vertices are known.
+     * \return An optional containing the span of vertex indices on the path, excluding
+     *         \a start and including \a goal if the path was fully refined, or
+     *         `std::nullopt` if there is no path.
+     */
+    std::optional<path_type>
+    find_path(vertex_index start,
+              vertex_index goal,
+              hierarchy_workspace& workspace,
+              std::size_t max_count = static_cast<std::size_t>(-1)) const;
+
+private:
+    struct abstract_edge {
+        std::uint32_t target;   ///< The abstract index of the target entrance.
+        float         distance; ///< The distance to the target entrance.
+    };
+
+    const graph_type* graph = nullptr;
+
+    std::vector<cluster_index> vertex_clusters;   ///< The cluster of each vertex.
+    std::vector<std::uint32_t> vertex_entrances;  ///< The abstract index of each vertex,
+                                                  ///< or #no_vertex if not an entrance.
+    std::vector<vertex_index>  entrance_vertices; ///< The vertex of each entrance.
+
+    std::vector<std::uint32_t> cluster_entrances;        ///< The entrances, grouped by cluster.
+    std::vector<std::uint32_t> cluster_entrance_offsets; ///< The offset into
+                                                         ///< #cluster_entrances of each
+                                                         ///< cluster.
+
+    std::vector<abstract_edge> abstract_edges;        ///< The abstract edges, grouped by source.
+    std::vector<std::uint32_t> abstract_edge_offsets; ///< The offset into #abstract_edges
+                                                      ///< of each entrance.
+};
+
+} // namespace simulacrum
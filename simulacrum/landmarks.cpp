@@ -0,0 +1,187 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "landmarks.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+using graph_type   = simulacrum::navigation_graph::graph_type;
+using vertex_index = graph_type::vertex_index;
+
+constexpr float infinity = std::numeric_limits<float>::infinity();
+
+/** \brief Computes the shortest distances from \a source to every vertex, or to
+ *         \a source from every vertex if \a Reverse is `true`.
+ *
+ * Unreachable vertices are assigned an infinite distance.
+ */
+template<bool Reverse>
+void shortest_distances(const graph_type& graph,
+                        simulacrum::astar_workspace<float>& workspace,
+                        vertex_index source,
+                        float* distances);
+
+} // namespace (anonymous)
+
+namespace simulacrum {
+
+landmark_heuristic::landmark_heuristic(const graph_type& graph_,
+                                       std::size_t landmark_count)
+    : graph(std::addressof(graph_))
+    , landmarks()
+    , scale(0.0f)
+    , from_landmark()
+    , to_landmark()
+{
+    const std::size_t vertex_count = graph->size();
+    landmark_count = std::min(landmark_count, vertex_count);
+    if (landmark_count == 0)
+        return;
+
+    // distances are tabulated by landmark while sampling, then transposed
+    std::vector<float> from_distances(landmark_count * vertex_count);
+    std::vector<float> to_distances(landmark_count * vertex_count);
+    std::vector<float> nearest(vertex_count, infinity);
+    astar_workspace<float> workspace;
+
+    // the first landmark is the vertex farthest from an arbitrary vertex
+    shortest_distances<false>(*graph, workspace, 0, from_distances.data());
+    auto pick_farthest = [vertex_count] (const float* distances) {
+        vertex_index farthest = 0;
+        float        farthest_distance = -1.0f;
+        for (vertex_index v = 0; v < vertex_count; ++v) {
+            // unreachable vertices are preferred, to cover each component
+            const float d = std::isinf(distances[v]) ? std::numeric_limits<float>::max()
+                                                     : distances[v];
+            if (d > farthest_distance) {
+                farthest = v;
+                farthest_distance = d;
+            }
+        }
+        return farthest;
+    };
+
+    vertex_index next = pick_farthest(from_distances.data());
+    for (std::size_t l = 0; l < landmark_count; ++l) {
+        float* from = from_distances.data() + l * vertex_count;
+        float* to   = to_distances.data() + l * vertex_count;
+
+        landmarks.push_back(next);
+        shortest_distances<false>(*graph, workspace, next, from);
+        shortest_distances<true>(*graph, workspace, next, to);
+
+        // the next landmark is the vertex farthest from all landmarks so far
+        for (vertex_index v = 0; v < vertex_count; ++v)
+            nearest[v] = std::min(nearest[v], from[v]);
+        next = pick_farthest(nearest.data());
+    }
+
+    // quantize, rounding down so that differences can be corrected to lower bounds
+    float max_distance = 0.0f;
+    for (const float* table : {from_distances.data(), to_distances.data()}) {
+        for (std::size_t i = 0; i < from_distances.size(); ++i) {
+            if (!std::isinf(table[i]))
+                max_distance = std::max(max_distance, table[i]);
+        }
+    }
+    scale = max_distance > 0.0f ? max_distance / (unreachable - 1) : 1.0f;
+
+    auto quantize = [this] (float distance) -> std::uint16_t {
+        if (std::isinf(distance))
+            return unreachable;
+        return static_cast<std::uint16_t>(std::min<float>(std::floor(distance / scale), unreachable - 1));
+    };
+
+    from_landmark.resize(from_distances.size());
+    to_landmark.resize(to_distances.size());
+    for (vertex_index v = 0; v < vertex_count; ++v) {
+        for (std::size_t l = 0; l < landmark_count; ++l) {
+            from_landmark[v * landmark_count + l] = quantize(from_distances[l * vertex_count + v]);
+            to_landmark[v * landmark_count + l]   = quantize(to_distances[l * vertex_count + v]);
+        }
+    }
+}
+
+float landmark_heuristic::lower_bound(vertex_index vertex, vertex_index goal) const noexcept
+{
+    const std::size_t count = landmarks.size();
+    const std::uint16_t* from_vertex = from_landmark.data() + vertex * count;
+    const std::uint16_t* from_goal   = from_landmark.data() + goal * count;
+    const std::uint16_t* to_vertex   = to_landmark.data() + vertex * count;
+    const std::uint16_t* to_goal     = to_landmark.data() + goal * count;
+
+    // each quantized distance is at most a step short, so differences are
+    // corrected by a step to remain lower bounds
+    long best = 0;
+    for (std::size_t l = 0; l < count; ++l) {
+        if (from_vertex[l] != unreachable && from_goal[l] != unreachable)
+            best = std::max(best, long(from_goal[l]) - long(from_vertex[l]) - 1);
+        if (to_vertex[l] != unreachable && to_goal[l] != unreachable)
+            best = std::max(best, long(to_vertex[l]) - long(to_goal[l]) - 1);
+    }
+
+    return best * scale;
+}
+
+float landmark_heuristic::operator()(const navigation_graph_node& node,
+                                     const navigation_graph_node& goal) const noexcept
+{
+    const float straight = norm(goal.point - node.point);
+    if (landmarks.empty())
+        return straight;
+
+    return std::max(straight, lower_bound(graph->index(node), graph->index(goal)));
+}
+
+} // namespace simulacrum
+
+namespace {
+
+template<bool Reverse>
+void shortest_distances(const graph_type& graph,
+                        simulacrum::astar_workspace<float>& workspace,
+                        vertex_index source,
+                        float* distances)
+{
+    auto& frontier = workspace.frontier;
+
+    std::fill(distances, distances + graph.size(), infinity);
+    workspace.begin_search(graph.size());
+    workspace.relax(source, source, 0.0f);
+    frontier.push_or_update(source, 0.0f);
+    while (!frontier.empty()) {
+        const vertex_index vertex = frontier.top().vertex;
+        frontier.pop();
+        workspace.close(vertex);
+
+        const float distance = workspace.distance(vertex);
+        distances[vertex] = distance;
+
+        auto relax = [&] (vertex_index next, const graph_type::edge_type& edge) {
+            if (workspace.expanded(next))
+                return;
+
+            const float next_distance = distance + edge->distance;
+            if (workspace.relax(next, vertex, next_distance))
+                frontier.push_or_update(next, next_distance);
+        };
+
+        if constexpr (Reverse) {
+            for (const graph_type::edge_type& edge : graph.ingress_edges(vertex))
+                relax(edge.source, edge);
+        } else {
+            for (const graph_type::edge_type& edge : graph.egress_edges(vertex))
+                relax(edge.target, edge);
+        }
+    }
+}
+
+} // namespace (anonymous)
@@ -0,0 +1,79 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "graph.hpp"
+
+namespace simulacrum {
+
+/** \brief A landmark (ALT) heuristic over a #navigation_graph.
+ *
+ * A set of landmark vertices is chosen by farthest-point sampling, and the shortest
+ * distances from and to each landmark are tabulated for every vertex.
+ * By the triangle inequality, for any landmark `L` the distance from `u` to `t` is
+ * bounded below by both `d(L, t) - d(L, u)` and `d(u, L) - d(t, L)`, which accounts
+ * for walls, cliffs and one-way drops that a straight-line estimate does not.
+ *
+ * The distances are quantized to 16 bits, with the bounds rounded down so that the
+ * heuristic remains admissible. Quantization may make the heuristic inconsistent by
+ * up to a single quantization step, so paths found by #astar_search are within a
+ * few steps (typically hundredths of a world unit) of the shortest.
+ */
+class landmark_heuristic {
+public:
+    using graph_type   = navigation_graph::graph_type;
+    using vertex_index = graph_type::vertex_index;
+
+    static constexpr std::size_t default_landmark_count = 16;
+
+    landmark_heuristic() = default;
+
+    /** \brief Selects up to \a landmark_count landmarks of \a graph and tabulates
+     *         their distances.
+     *
+     * The heuristic refers to \a graph, which must outlive it.
+     */
+    explicit landmark_heuristic(const graph_type& graph,
+                                std::size_t landmark_count = default_landmark_count);
+
+    /** \brief Returns the number of landmarks selected.
+     */
+    std::size_t landmark_count() const noexcept { return landmarks.size(); }
+
+    /** \brief Returns the landmark vertices, in the order they were selected.
+     */
+    const std::vector<vertex_index>& get_landmarks() const noexcept { return landmarks; }
+
+    /** \brief Returns a lower bound on the distance from \a vertex to \a goal.
+     */
+    float lower_bound(vertex_index vertex, vertex_index goal) const noexcept;
+
+    /** \brief Returns a lower bound on the distance from \a node to \a goal, being
+     *         the greater of the landmark bound and the straight-line distance.
+     *
+     * Both \a node and \a goal must be references to nodes interned in the graph,
+     * as supplied to the heuristic by #astar_search.
+     */
+    float operator()(const navigation_graph_node& node,
+                     const navigation_graph_node& goal) const noexcept;
+
+private:
+    static constexpr std::uint16_t unreachable = 0xFFFF;
+
+    const graph_type*          graph = nullptr;
+    std::vector<vertex_index>  landmarks;
+    float                      scale = 0.0f; ///< The distance of a quantization step.
+    std::vector<std::uint16_t> from_landmark; ///< `d(L, v)`, grouped by vertex `v`.
+    std::vector<std::uint16_t> to_landmark;   ///< `d(v, L)`, grouped by vertex `v`.
+};
+
+} // namespace simulacrum
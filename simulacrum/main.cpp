@@ -7,13 +7,19 @@
 #include "main.h"
 
 #include <algorithm>
+#include <chrono>
 #include <string>
+#include <vector>
 
 #include <sentutil/all.hpp>
 #include "bot_ai.hpp"
 #include "bot_control.hpp"
 #include "bot_config.hpp"
 #include "game_context.hpp"
+#include "graph.hpp"
+#include "marker_cache.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
 
 #ifdef OLD
 bool dump_bsp_model(const char* filename)
@@ -343,6 +349,28 @@ void controls_filter(sentinel::digital_controls_state& digital,
                      float seconds,
                      long  ticks);
 
+/** \brief The trace being recorded, if any, and the frame reused to record it.
+ */
+simulacrum::trace::recorder trace_recorder;
+simulacrum::trace::frame    trace_frame;
+
+std::vector<simulacrum::marker_cache::object_identity> trace_units;  ///< Reused to look
+std::vector<std::optional<sentinel::real3d>>           trace_bodies; ///< up body markers.
+
+/** \brief Records the state read and the controls output over the current tick to
+ *         #trace_recorder.
+ */
+void record_trace_frame(const sentinel::digital_controls_state& digital,
+                        const sentinel::analog_controls_state&  analog,
+                        float seconds,
+                        long  ticks,
+                        std::chrono::steady_clock::duration update_time);
+
+/** \brief Prints the number of frames in the trace at \a filename and the time the AI
+ *         and control took over them.
+ */
+void summarize_trace(std::string_view filename);
+
 bool Load()
 {
     using sentutil::controls::install_controls_filter;
@@ -362,10 +390,31 @@ bool Load()
             +[] (bool b) { simulacrum_enabled = b; },
             "enables or disables the simulacrum AI and control"
             "<bool>") &&
+        install_script_function<"simulacrum_trace_record">(
+            +[] (std::optional<std::string_view> filename) -> bool {
+                if (!filename) {
+                    trace_recorder.close();
+                    return false;
+                }
+                const sentinel::tags::collision_bsp* cbsp = sentutil::globals::map_globals->collision_bsp;
+                if (!cbsp)
+                    return false;
+
+                // the geometry is identified as for persisted navigation graphs
+                const auto key = simulacrum::navigation_graph_key(*cbsp, simulacrum::snapshot_scenery());
+                return trace_recorder.open(std::string(filename.value()), current_map_name, key);
+            },
+            "starts recording the state read and the controls output each tick to a trace file, or stops recording",
+            "[string: filename]") &&
+        install_script_function<"simulacrum_trace_summary">(
+            summarize_trace,
+            "prints the number of frames in a trace file and the time the AI and control took over them",
+            "<string: filename>") &&
         simulacrum::config::load() &&
         simulacrum::game_context.load() &&
         simulacrum::ai::load() &&
-        simulacrum::control::load(); /* &&
+        simulacrum::control::load() &&
+        simulacrum::perf::load(); /* &&
         // OLD: phase these out
         install_script_function<"dump_bsp_model">(dump_bsp_model,
                                                   "dumps the bsp model",
@@ -421,6 +470,10 @@ namespace {
 
 void load_map_cache(std::string_view cache_name)
 {
+    simulacrum::ai::retire_navigation();
+    simulacrum::game_context.clear_projectile_contexts();
+    simulacrum::object_markers.clear();
+
     current_cache_name = cache_name;
     current_map_name   = [] {
         auto first = +sentutil::globals::map_file_header->map_name;
@@ -457,12 +510,142 @@ void controls_filter(sentinel::digital_controls_state& digital,
     *tabbed_freeze_game = *tabbed_disable_dyna_sound = *tabbed_disable_cont_sound = false;
     */
 
-    simulacrum::game_context.preupdate(ticks);
+    using simulacrum::perf::scope;
+    simulacrum::perf::begin_tick();
+    scope tick_timing(simulacrum::perf::phase_tick);
+
+    {
+        scope timing(simulacrum::perf::phase_preupdate);
+        simulacrum::game_context.preupdate(ticks);
+    }
+
+    const auto update_start = std::chrono::steady_clock::now();
     if (simulacrum_enabled) {
-        simulacrum::ai::update(seconds, ticks);
-        simulacrum::control::update(digital, analog, seconds, ticks);
+        {
+            scope timing(simulacrum::perf::phase_ai);
+            simulacrum::ai::update(seconds, ticks);
+        }
+        {
+            scope timing(simulacrum::perf::phase_control);
+            simulacrum::control::update(digital, analog, seconds, ticks);
+        }
     }
+    if (trace_recorder.is_open())
+        record_trace_frame(digital, analog, seconds, ticks,
+                           std::chrono::steady_clock::now() - update_start);
+
+    scope timing(simulacrum::perf::phase_postupdate);
     simulacrum::game_context.postupdate(digital);
 }
 
+void record_trace_frame(const sentinel::digital_controls_state& digital,
+                        const sentinel::analog_controls_state&  analog,
+                        float seconds,
+                        long  ticks,
+                        std::chrono::steady_clock::duration update_time)
+{
+    using simulacrum::game_context;
+    using simulacrum::trace::frame_header;
+
+    frame_header& header = trace_frame.header;
+    header = frame_header();
+    header.ticks   = ticks;
+    header.seconds = seconds;
+    header.flags   = (simulacrum_enabled ? frame_header::flag_enabled : 0)
+                   | (game_context.local_unit ? frame_header::flag_alive : 0)
+                   | (game_context.can_fire_primary_trigger ? frame_header::flag_can_fire : 0);
+    header.yaw     = game_context.orientation_context.yaw;
+    header.pitch   = game_context.orientation_context.pitch;
+    header.ticks_since_fired = game_context.ticks_since_fired;
+    header.weapon_tag = game_context.weapon ? game_context.weapon.value().get().object.tag.raw
+                                            : sentinel::invalid_identity.raw;
+    if (game_context.local_unit) {
+        const sentinel::unit& unit = game_context.local_unit.value();
+        header.local_position = unit.object.position;
+        header.local_velocity = unit.object.velocity;
+        header.aim_forward    = unit.unit.aim_forward;
+    }
+    if (game_context.projectile_context) {
+        const simulacrum::ProjectileContext& projectile = game_context.projectile_context.value();
+        header.projectile.flags = simulacrum::trace::projectile_record::flag_present
+                                | (projectile.does_lerp ? simulacrum::trace::projectile_record::flag_lerps : 0);
+        header.projectile.speed_muzzle     = projectile.speed_muzzle;
+        header.projectile.speed_final      = projectile.speed_final;
+        header.projectile.damage_range_min = projectile.damage_range.min;
+        header.projectile.damage_range_max = projectile.damage_range.max;
+        header.projectile.detonation_range = projectile.detonation_range;
+    }
+    header.digital = digital;
+    header.analog  = analog;
+    header.update_microseconds = static_cast<std::uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(update_time).count());
+
+    const simulacrum::PlayerSnapshot& snapshot = game_context.player_snapshot;
+    trace_units.clear();
+    for (std::size_t i = 0; i < snapshot.size(); ++i) {
+        if (snapshot.flags[i] & simulacrum::PlayerSnapshot::flag_alive)
+            trace_units.push_back(snapshot.players[i]->unit);
+    }
+    trace_bodies.resize(trace_units.size());
+    simulacrum::object_markers.get_world_positions(trace_units.data(), trace_units.size(),
+                                                   "body", trace_bodies.data());
+
+    trace_frame.players.clear();
+    for (std::size_t i = 0, alive = 0; i < snapshot.size(); ++i) {
+        simulacrum::trace::player_record record = {};
+        record.unit     = snapshot.players[i]->unit.raw;
+        record.team     = static_cast<std::int32_t>(snapshot.players[i]->team);
+        record.flags    = snapshot.flags[i];
+        record.position = snapshot.positions[i];
+        if (snapshot.flags[i] & simulacrum::PlayerSnapshot::flag_alive) {
+            const sentinel::unit& unit = *snapshot.players[i]->unit;
+            record.velocity = unit.object.parent ? unit.object.parent->object.velocity
+                                                 : unit.object.velocity;
+
+            const auto& body = trace_bodies[alive++];
+            record.has_body = body.has_value();
+            record.body     = body.value_or(record.position);
+        }
+        trace_frame.players.push_back(record);
+    }
+
+    if (!trace_recorder.record(trace_frame))
+        sentutil::console::cprintf(sentutil::color::red, "trace recording stopped: write failed");
+}
+
+void summarize_trace(std::string_view filename)
+{
+    using sentutil::console::cprintf;
+
+    simulacrum::trace::reader reader;
+    if (!reader.open(std::string(filename))) {
+        cprintf(sentutil::color::red, "not a trace of this version: \"%s\"", std::string(filename).c_str());
+        return;
+    }
+
+    simulacrum::trace::frame  f;
+    std::vector<std::uint32_t> update_times; // of the frames the AI and control ran on
+    long frames = 0;
+    long ticks  = 0;
+    while (reader.next(f)) {
+        ++frames;
+        ticks += f.header.ticks;
+        if (f.header.flags & simulacrum::trace::frame_header::flag_enabled)
+            update_times.push_back(f.header.update_microseconds);
+    }
+
+    cprintf("%s: %ld frames, %ld ticks, %u updated",
+            reader.map_name().c_str(), frames, ticks,
+            static_cast<unsigned>(update_times.size()));
+    if (update_times.empty())
+        return;
+
+    std::sort(update_times.begin(), update_times.end());
+    auto percentile = [&update_times] (std::size_t p) {
+        return update_times[(update_times.size() - 1) * p / 100];
+    };
+    cprintf("update: p50 %uus, p99 %uus, max %uus",
+            percentile(50), percentile(99), update_times.back());
+}
+
 } // namespace (anonymous)
@@ -0,0 +1,89 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "marker_cache.hpp"
+
+#include <algorithm>
+
+#include <sentinel/tags/object.hpp>
+#include <sentutil/object.hpp>
+
+namespace simulacrum {
+
+marker_cache object_markers;
+
+namespace {
+
+/** \brief Returns the tag identity of the model of \a object.
+ */
+sentinel::identity_raw get_model(const sentinel::object& object);
+
+} // namespace (anonymous)
+
+std::optional<marker_cache::marker>
+marker_cache::resolve(const object_identity& object, std::string_view name)
+{
+    const sentinel::identity_raw model = get_model(*object->object);
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [model, name] (const entry& e) { return e.model == model && e.name == name; });
+    if (it != entries.end())
+        return it->value;
+
+    // names passed to the engine must be terminated
+    const std::string marker_name(name);
+    auto opt_result = sentutil::object::get_object_marker(object, marker_name.c_str());
+    if (!opt_result || opt_result.value().marker_node < 0)
+        return std::nullopt;
+
+    const marker value{opt_result.value().marker_node, opt_result.value().marker_transform};
+    entries.push_back({model, marker_name, value});
+    return value;
+}
+
+std::optional<sentinel::affine_matrix3d>
+marker_cache::get_world_transform(const object_identity& object, std::string_view name)
+{
+    const auto opt_marker = resolve(object, name);
+    if (!opt_marker)
+        return std::nullopt;
+
+    const sentinel::object& datum = *object->object;
+    return datum.object.node_transforms[opt_marker.value().node] * opt_marker.value().local_transform;
+}
+
+std::size_t marker_cache::get_world_positions(const object_identity* objects,
+                                              std::size_t count,
+                                              std::string_view name,
+                                              std::optional<sentinel::real3d>* out)
+{
+    std::size_t computed = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto opt_marker = resolve(objects[i], name);
+        if (!opt_marker) {
+            out[i] = std::nullopt;
+            continue;
+        }
+
+        const sentinel::object& datum = *objects[i]->object;
+        out[i] = datum.object.node_transforms[opt_marker.value().node]
+               * opt_marker.value().local_transform.translation;
+        ++computed;
+    }
+
+    return computed;
+}
+
+namespace {
+
+sentinel::identity_raw get_model(const sentinel::object& object)
+{
+    const auto& definition = *reinterpret_cast<const sentinel::tags::object*>(object.object.tag->definition);
+    return definition.object.model.tag.raw;
+}
+
+} // namespace (anonymous)
+
+} // namespace simulacrum
@@ -0,0 +1,94 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sentinel/types.hpp>
+#include <sentinel/structures/object.hpp>
+
+namespace simulacrum {
+
+/** \brief Resolves the markers of objects through the engine once per model and marker
+ *         name, after which markers are computed from the node transforms of objects.
+ *
+ * A marker is the node it is attached to and its transform relative to that node, both
+ * of which are taken from the model tag. Computing a marker from the cache is a single
+ * affine transformation rather than a search of the model by name.
+ *
+ * The first marker of a name is cached, so markers that differ between the regions or
+ * permutations of a model are not supported. The cache must be cleared when a map is
+ * loaded, as models are keyed by their tag identities.
+ */
+class marker_cache {
+public:
+    using object_identity = sentinel::identity<sentinel::object_table_datum>;
+
+    /** \brief A marker as taken from the model tag.
+     */
+    struct marker {
+        sentinel::index_short     node;            ///< The node the marker is attached to.
+        sentinel::affine_matrix3d local_transform; ///< The transform relative to #node.
+    };
+
+    /** \brief Discards all markers resolved.
+     */
+    void clear() noexcept { entries.clear(); }
+
+    /** \brief Resolves the marker \a name of the model of \a object, querying the engine
+     *         if the marker is not cached.
+     *
+     * \return The marker, or `std::nullopt` if the model has no such marker.
+     */
+    std::optional<marker> resolve(const object_identity& object, std::string_view name);
+
+    /** \brief Computes the world transform of the marker \a name of \a object.
+     *
+     * \return The transform, or `std::nullopt` if the model has no such marker.
+     */
+    std::optional<sentinel::affine_matrix3d>
+    get_world_transform(const object_identity& object, std::string_view name);
+
+    /** \brief Computes the world positions of the marker \a name of \a count objects.
+     *
+     * Objects of a model are resolved once, so the positions are computed without
+     * querying the engine for any model already resolved.
+     *
+     * \param[out] out Receives the position of the marker of each object, or
+     *                 `std::nullopt` for objects whose model has no such marker.
+     * \return The number of positions computed.
+     */
+    std::size_t get_world_positions(const object_identity* objects,
+                                    std::size_t count,
+                                    std::string_view name,
+                                    std::optional<sentinel::real3d>* out);
+
+    /** \brief Returns the number of markers cached.
+     */
+    std::size_t size() const noexcept { return entries.size(); }
+
+private:
+    struct entry {
+        sentinel::identity_raw model;
+        std::string            name;
+        marker                 value;
+    };
+
+    std::vector<entry> entries; ///< Few enough to be searched linearly.
+};
+
+/** \brief The markers resolved for the current map.
+ */
+extern marker_cache object_markers;
+
+} // namespace simulacrum
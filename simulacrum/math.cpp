@@ -4,6 +4,10 @@
 #include <cmath>
 
 #include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
 #include <sentutil/console.hpp>
 
 namespace simulacrum { namespace math {
@@ -47,29 +51,72 @@ initial_projectile_velocity(const sentinel::real    muzzle_speed,
     return (muzzle_speed + dot(aiming_direction, parent_velocity)) * aiming_direction;
 }
 
-bool intersects_segment_sphere(const sentinel::position3d&  segment_begin,
-                               const sentinel::direction3d& segment_direction,
-                               const sentinel::real&        segment_length,
-                               const sentinel::position3d&  sphere_center_,
-                               const sentinel::real&        sphere_radius)
+void
+get_target_offsets(const sentinel::position3d& source,
+                   const OrientationContext&   orientation,
+                   const sentinel::real*       target_x,
+                   const sentinel::real*       target_y,
+                   const sentinel::real*       target_z,
+                   std::size_t                 count,
+                   sentinel::real*             distances,
+                   sentinel::real*             turn_offsets)
 {
-    const auto square = [] (const auto& v) { return v * v; };
-
-    // Translate coordinates so that segment_begin is the origin
-    const sentinel::position3d sphere_center = sphere_center_ - segment_begin;
-    const auto segment_end = segment_length * segment_direction;
-    /* segment_begin = sentinel::real3d::zero; */
-
-    const auto square_sphere_radius = square(sphere_radius);
-    const auto center_component_length = dot(segment_direction, sphere_center);
-    /*
-    const auto center_component = center_component_length * segment_direction;
-    const auto center_ortho_component = sphere_center - center_component;
-    */
-
-    return (norm2(sphere_center) < square_sphere_radius) ||
-           (norm2(segment_end - sphere_center) < square_sphere_radius) ||
-           (norm2(sphere_center) - square(center_component_length)) < square_sphere_radius;
+    // guards the cosines of targets directly above or at the source
+    constexpr float min_length = 1e-6f;
+    std::size_t i = 0;
+
+#ifdef __SSE__
+    // the same computation as the scalar loop below, on four targets per iteration
+    const __m128 source_x  = _mm_set1_ps(source[0]);
+    const __m128 source_y  = _mm_set1_ps(source[1]);
+    const __m128 source_z  = _mm_set1_ps(source[2]);
+    const __m128 cos_yaw   = _mm_set1_ps(orientation.cos_yaw);
+    const __m128 sin_yaw   = _mm_set1_ps(orientation.sin_yaw);
+    const __m128 cos_pitch = _mm_set1_ps(orientation.cos_pitch);
+    const __m128 sin_pitch = _mm_set1_ps(orientation.sin_pitch);
+    const __m128 two       = _mm_set1_ps(2.0f);
+    const __m128 min_len   = _mm_set1_ps(min_length);
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 delta_x = _mm_sub_ps(_mm_loadu_ps(target_x + i), source_x);
+        const __m128 delta_y = _mm_sub_ps(_mm_loadu_ps(target_y + i), source_y);
+        const __m128 delta_z = _mm_sub_ps(_mm_loadu_ps(target_z + i), source_z);
+
+        const __m128 square_horizontal = _mm_add_ps(_mm_mul_ps(delta_x, delta_x),
+                                                    _mm_mul_ps(delta_y, delta_y));
+        const __m128 horizontal = _mm_sqrt_ps(square_horizontal);
+        const __m128 distance   = _mm_sqrt_ps(_mm_add_ps(square_horizontal,
+                                                         _mm_mul_ps(delta_z, delta_z)));
+
+        const __m128 forward = _mm_add_ps(_mm_mul_ps(cos_yaw, delta_x),
+                                          _mm_mul_ps(sin_yaw, delta_y));
+        const __m128 rise    = _mm_add_ps(_mm_mul_ps(cos_pitch, horizontal),
+                                          _mm_mul_ps(sin_pitch, delta_z));
+
+        const __m128 cos_turn_yaw   = _mm_div_ps(forward, _mm_max_ps(horizontal, min_len));
+        const __m128 cos_turn_pitch = _mm_div_ps(rise, _mm_max_ps(distance, min_len));
+
+        _mm_storeu_ps(distances + i, distance);
+        _mm_storeu_ps(turn_offsets + i, _mm_sub_ps(two, _mm_add_ps(cos_turn_yaw, cos_turn_pitch)));
+    }
+#endif // __SSE__
+
+    for (; i < count; ++i) {
+        const float delta_x = target_x[i] - source[0];
+        const float delta_y = target_y[i] - source[1];
+        const float delta_z = target_z[i] - source[2];
+
+        const float square_horizontal = delta_x * delta_x + delta_y * delta_y;
+        const float horizontal = std::sqrt(square_horizontal);
+        const float distance   = std::sqrt(square_horizontal + delta_z * delta_z);
+
+        const float forward = orientation.cos_yaw * delta_x + orientation.sin_yaw * delta_y;
+        const float rise    = orientation.cos_pitch * horizontal + orientation.sin_pitch * delta_z;
+
+        distances[i]    = distance;
+        turn_offsets[i] = 2.0f - forward / std::max(horizontal, min_length)
+                               - rise / std::max(distance, min_length);
+    }
 }
 
 float
@@ -133,4 +180,65 @@ projectile_travel_time(const ProjectileContext& projectile,
     return {true, travel_time};
 }
 
+std::pair<bool, float>
+projectile_travel_time_lookup(const ProjectileContext& projectile,
+                              const float initial_speed,
+                              const float distance)
+{
+    if (distance >= projectile.max_range)
+        return {false, 0.0f};
+
+    if (const std::optional<float> ticks = projectile.travel_table.ticks(initial_speed, distance))
+        return {true, ticks.value()};
+    return projectile_travel_time(projectile, initial_speed, distance);
+}
+
+std::optional<projectile_intercept>
+solve_projectile_intercept(const ProjectileContext&    projectile,
+                           const float                 initial_speed,
+                           const sentinel::real3d&     source,
+                           const kinematic_trajectory& target,
+                           const float                 max_ticks,
+                           const int                   max_iterations,
+                           const float                 tolerance)
+{
+    // the difference between the projectile travel time to where the target is at
+    // `ticks` and `ticks`, which is zero at an intercept
+    auto residual = [&] (const float ticks) -> std::optional<float> {
+        const auto [in_range, travel_time] = projectile_travel_time_lookup(
+            projectile, initial_speed, norm(target.position_at(ticks) - source));
+        return in_range ? std::make_optional(travel_time - ticks) : std::nullopt;
+    };
+
+    float previous_ticks = 0.0f;
+    std::optional<float> previous = residual(previous_ticks);
+    if (!previous)
+        return std::nullopt;
+
+    // the first step is the travel time to where the target is now
+    float ticks = std::min(previous_ticks + previous.value(), max_ticks);
+    for (int i = 0; i < max_iterations; ++i) {
+        const std::optional<float> current = residual(ticks);
+        if (!current)
+            return std::nullopt;
+
+        if (std::abs(current.value()) <= tolerance)
+            return projectile_intercept{ticks, target.position_at(ticks)};
+
+        // fall back to a fixed-point step where the secant is flat
+        const float slope = (current.value() - previous.value()) / (ticks - previous_ticks);
+        const float next  = std::isfinite(slope) && slope != 0.0f
+                          ? ticks - current.value() / slope
+                          : ticks + current.value();
+
+        previous_ticks = ticks;
+        previous       = current;
+        ticks          = std::clamp(next, 0.0f, max_ticks);
+        if (ticks == previous_ticks)
+            return std::nullopt; // pinned against a bound, so there is no intercept within it
+    }
+
+    return std::nullopt;
+}
+
 } } // namespace simulacrum::math
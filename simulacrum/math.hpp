@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+
+#include <optional>
 #include <utility> // std::pair
 
 #include <sentinel/types.hpp>
@@ -54,6 +57,59 @@ intersects_segment_sphere(const sentinel::position3d&  segment_begin,
                           const sentinel::position3d&  sphere_center,
                           const sentinel::real&        sphere_radius);
 
+/** \brief Tests if a sphere contains a point of a line segment between its ends.
+ *
+ * Unlike #intersects_segment_sphere, a sphere on the line through the segment but
+ * beyond either end of the segment does not intersect it.
+ *
+ * \return `true` if the line segment intersects the sphere, otherwise `false`.
+ */
+bool
+intersects_bounded_segment_sphere(const sentinel::position3d&  segment_begin,
+                                  const sentinel::direction3d& segment_direction,
+                                  const sentinel::real&        segment_length,
+                                  const sentinel::position3d&  sphere_center,
+                                  const sentinel::real&        sphere_radius);
+
+/** \brief Tests if a line segment intersects any of \a count spheres, given in
+ *         structure-of-arrays form.
+ *
+ * The spheres are tested four at a time where SSE is available. The result is the
+ * same as that of #intersects_segment_sphere over each sphere.
+ *
+ * \return `true` if the line segment intersects a sphere, otherwise `false`.
+ */
+bool
+intersects_segment_spheres(const sentinel::position3d&  segment_begin,
+                           const sentinel::direction3d& segment_direction,
+                           const sentinel::real&        segment_length,
+                           const sentinel::real*        sphere_x,
+                           const sentinel::real*        sphere_y,
+                           const sentinel::real*        sphere_z,
+                           const sentinel::real*        sphere_radius,
+                           std::size_t                  count);
+
+/** \brief Computes the distances and turn offsets from \a source to \a count targets,
+ *         given in structure-of-arrays form.
+ *
+ * The turn offset to a target is `(1 - cos(yaw)) + (1 - cos(pitch))` for the angles
+ * #get_turn_angles returns for that target, so it orders targets by how far the aim
+ * must turn without evaluating an arctangent per target. Targets are processed four at
+ * a time where SSE is available.
+ *
+ * \param[out] distances    Receives the distance to each target.
+ * \param[out] turn_offsets Receives the turn offset to each target.
+ */
+void
+get_target_offsets(const sentinel::position3d& source,
+                   const OrientationContext&   orientation,
+                   const sentinel::real*       target_x,
+                   const sentinel::real*       target_y,
+                   const sentinel::real*       target_z,
+                   std::size_t                 count,
+                   sentinel::real*             distances,
+                   sentinel::real*             turn_offsets);
+
 /** \brief Computes `x(t + dt) - x(t)` where `x` is determined by the differential
  *         equation `dx = -r * x * dt - k * dt` with the constraint that `x(t + dt)`
  *         is bounded by `0` and `x(t)`, for a differential \a dt.
@@ -107,4 +163,71 @@ projectile_travel_time(const ProjectileContext& projectile,
                        const float initial_speed,
                        const float distance);
 
+/** \brief Looks up the time needed for a projectile to travel a certain distance in
+ *         the travel table of \a projectile.
+ *
+ * The time is interpolated from the table, which agrees with #projectile_travel_time
+ * to within ProjectileTravelTable::error. Queries outside of the table, or
+ * for a projectile without a table, fall back to #projectile_travel_time.
+ *
+ * \param[in] projectile    The context for the projectile definition.
+ * \param[in] initial_speed The initial speed of the projectile.
+ * \param[in] distance      The goal distance for the projectile to  travel.
+ * \return A pair indicating the projectile travels \a distance before detonating (first)
+ *         and the number of partial ticks to travel \a distance (second).
+ */
+std::pair<bool, float>
+projectile_travel_time_lookup(const ProjectileContext& projectile,
+                              const float initial_speed,
+                              const float distance);
+
+/** \brief The path of a point under constant acceleration, such as a target that is
+ *         predicted to keep moving as it is.
+ */
+struct kinematic_trajectory {
+    sentinel::real3d position;     ///< The position at time `0`.
+    sentinel::real3d velocity;     ///< The velocity at time `0`, in world units per tick.
+    sentinel::real3d acceleration; ///< In world units per tick squared.
+
+    /** \brief Returns the position after \a ticks.
+     */
+    sentinel::real3d position_at(const float ticks) const noexcept
+    { return position + ticks * velocity + (0.5f * ticks * ticks) * acceleration; }
+};
+
+/** \brief Describes where and when a projectile meets a target.
+ */
+struct projectile_intercept {
+    float            ticks; ///< The number of partial ticks until the projectile meets
+                            ///< the target.
+    sentinel::real3d point; ///< The position of the target when it is met.
+};
+
+/** \brief Solves for the time at which a projectile fired from \a source meets a target
+ *         moving along \a target.
+ *
+ * The intercept is where the travel time of the projectile to the target's position
+ * equals the time the target takes to get there. It is found by secant iterations
+ * over that difference, starting from the travel time to the target's position at
+ * time `0`, so each iteration costs a single travel time lookup.
+ *
+ * \param[in] projectile     The context for the projectile definition.
+ * \param[in] initial_speed  The initial speed of the projectile.
+ * \param[in] source         The position the projectile is fired from.
+ * \param[in] target         The predicted trajectory of the target.
+ * \param[in] max_ticks      The latest intercept considered.
+ * \param[in] max_iterations The number of iterations before giving up.
+ * \param[in] tolerance      The difference in ticks under which a solution is accepted.
+ * \return The intercept, or `std::nullopt` if the projectile cannot reach the target
+ *         within range and within \a max_ticks, or if no solution was found.
+ */
+std::optional<projectile_intercept>
+solve_projectile_intercept(const ProjectileContext&    projectile,
+                           const float                 initial_speed,
+                           const sentinel::real3d&     source,
+                           const kinematic_trajectory& target,
+                           const float                 max_ticks,
+                           const int                   max_iterations = 8,
+                           const float                 tolerance      = 0.01f);
+
 } } // namespace simulacrum::math
@@ -0,0 +1,122 @@
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+// The intersection tests of math.hpp, which do not depend on the game.
+
+#include "math.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
+
+namespace simulacrum { namespace math {
+
+bool intersects_segment_sphere(const sentinel::position3d&  segment_begin,
+                               const sentinel::direction3d& segment_direction,
+                               const sentinel::real&        segment_length,
+                               const sentinel::position3d&  sphere_center_,
+                               const sentinel::real&        sphere_radius)
+{
+    const auto square = [] (const auto& v) { return v * v; };
+
+    // Translate coordinates so that segment_begin is the origin
+    const sentinel::position3d sphere_center = sphere_center_ - segment_begin;
+    const auto segment_end = segment_length * segment_direction;
+    /* segment_begin = sentinel::real3d::zero; */
+
+    const auto square_sphere_radius = square(sphere_radius);
+    const auto center_component_length = dot(segment_direction, sphere_center);
+    /*
+    const auto center_component = center_component_length * segment_direction;
+    const auto center_ortho_component = sphere_center - center_component;
+    */
+
+    return (norm2(sphere_center) < square_sphere_radius) ||
+           (norm2(segment_end - sphere_center) < square_sphere_radius) ||
+           (norm2(sphere_center) - square(center_component_length)) < square_sphere_radius;
+}
+
+bool intersects_bounded_segment_sphere(const sentinel::position3d&  segment_begin,
+                                       const sentinel::direction3d& segment_direction,
+                                       const sentinel::real&        segment_length,
+                                       const sentinel::position3d&  sphere_center,
+                                       const sentinel::real&        sphere_radius)
+{
+    // the point of the segment closest to the center is tested
+    const sentinel::real3d center = sphere_center - segment_begin;
+    const sentinel::real   along  = std::clamp(dot(segment_direction, center),
+                                               sentinel::real(0),
+                                               segment_length);
+    return norm2(center - along * segment_direction) < sphere_radius * sphere_radius;
+}
+
+bool intersects_segment_spheres(const sentinel::position3d&  segment_begin,
+                                const sentinel::direction3d& segment_direction,
+                                const sentinel::real&        segment_length,
+                                const sentinel::real*        sphere_x,
+                                const sentinel::real*        sphere_y,
+                                const sentinel::real*        sphere_z,
+                                const sentinel::real*        sphere_radius,
+                                std::size_t                  count)
+{
+    std::size_t i = 0;
+
+#ifdef __SSE__
+    // the same tests as intersects_segment_sphere, on four spheres per iteration
+    const __m128 begin_x = _mm_set1_ps(segment_begin[0]);
+    const __m128 begin_y = _mm_set1_ps(segment_begin[1]);
+    const __m128 begin_z = _mm_set1_ps(segment_begin[2]);
+    const __m128 direction_x = _mm_set1_ps(segment_direction[0]);
+    const __m128 direction_y = _mm_set1_ps(segment_direction[1]);
+    const __m128 direction_z = _mm_set1_ps(segment_direction[2]);
+    const __m128 end_x = _mm_set1_ps(segment_length * segment_direction[0]);
+    const __m128 end_y = _mm_set1_ps(segment_length * segment_direction[1]);
+    const __m128 end_z = _mm_set1_ps(segment_length * segment_direction[2]);
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 center_x = _mm_sub_ps(_mm_loadu_ps(sphere_x + i), begin_x);
+        const __m128 center_y = _mm_sub_ps(_mm_loadu_ps(sphere_y + i), begin_y);
+        const __m128 center_z = _mm_sub_ps(_mm_loadu_ps(sphere_z + i), begin_z);
+        const __m128 radius   = _mm_loadu_ps(sphere_radius + i);
+        const __m128 square_radius = _mm_mul_ps(radius, radius);
+
+        const __m128 square_center = _mm_add_ps(_mm_add_ps(_mm_mul_ps(center_x, center_x),
+                                                           _mm_mul_ps(center_y, center_y)),
+                                                _mm_mul_ps(center_z, center_z));
+
+        const __m128 to_end_x = _mm_sub_ps(end_x, center_x);
+        const __m128 to_end_y = _mm_sub_ps(end_y, center_y);
+        const __m128 to_end_z = _mm_sub_ps(end_z, center_z);
+        const __m128 square_to_end = _mm_add_ps(_mm_add_ps(_mm_mul_ps(to_end_x, to_end_x),
+                                                           _mm_mul_ps(to_end_y, to_end_y)),
+                                                _mm_mul_ps(to_end_z, to_end_z));
+
+        const __m128 center_component = _mm_add_ps(_mm_add_ps(_mm_mul_ps(direction_x, center_x),
+                                                              _mm_mul_ps(direction_y, center_y)),
+                                                   _mm_mul_ps(direction_z, center_z));
+        const __m128 square_ortho = _mm_sub_ps(square_center,
+                                               _mm_mul_ps(center_component, center_component));
+
+        const __m128 hits = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(square_center, square_radius),
+                                                _mm_cmplt_ps(square_to_end, square_radius)),
+                                      _mm_cmplt_ps(square_ortho, square_radius));
+        if (_mm_movemask_ps(hits))
+            return true;
+    }
+#endif // __SSE__
+
+    for (; i < count; ++i) {
+        if (intersects_segment_sphere(segment_begin, segment_direction, segment_length,
+                                      {sphere_x[i], sphere_y[i], sphere_z[i]},
+                                      sphere_radius[i]))
+            return true;
+    }
+
+    return false;
+}
+
+} } // namespace simulacrum::math
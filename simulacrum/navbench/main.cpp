@@ -0,0 +1,503 @@
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "graph.hpp"
+#include "compiled_cbsp.hpp"
+#include "math.hpp"
+#include "synthetic_cbsp.hpp"
+
+#include <sentutil/collision.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+namespace synthetic = simulacrum::synthetic;
+
+/** \brief A synthetic map to build and query.
+ */
+struct benchmark_map {
+    const char*                          name;
+    std::vector<synthetic::height_field> storeys;
+    sentinel::real                       storey_height;
+};
+
+/** \brief The number of checks that have failed.
+ */
+int failures = 0;
+
+/** \brief Records a failure of \a what on the map \a name if \a condition is `false`.
+ */
+void check(bool condition, const char* name, const char* what);
+
+/** \brief Returns the time elapsed since \a start, in microseconds.
+ */
+double microseconds_since(clock::time_point start);
+
+/** \brief Returns the \a p-th quantile of \a latencies, which are reordered in place.
+ */
+double percentile(std::vector<double>& latencies, double p);
+
+/** \brief Checks sentutil::collision::test_segment against generated collision BSPs.
+ */
+void test_segments();
+
+/** \brief Checks the segment and sphere intersection tests that scenery and obstacles
+ *         block edges by, and times the batched test of scenery against the scalar test.
+ */
+void test_segment_spheres();
+
+/** \brief Builds the navigation graph of \a map, then times and checks \a query_count
+ *         nearest vertex, point location and path queries over it.
+ */
+void run(const benchmark_map& map, long query_count);
+
+} // namespace (anonymous)
+
+/* Checks segment tests against synthetic collision BSPs, then builds navigation graphs
+ * over synthetic maps and prints the time taken to build them and the latencies of
+ * queries over them.
+ * The results of the queries are checked against brute force, so the exit status is
+ * nonzero if any check fails.
+ *
+ * Usage: navbench [query_count]
+ */
+int main(int argc, char* argv[])
+{
+    const long query_count = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 1000;
+    if (query_count <= 0) {
+        std::fprintf(stderr, "usage: %s [query_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const benchmark_map maps[] = {
+        {"flat grid",  {synthetic::flat_grid(128, 128)}, 0.0f},
+        {"stair ramp", {synthetic::stair_ramp(256, 64, 2, 0.25f)}, 0.0f},
+        {"maze",       {synthetic::maze(16, 16, 1), synthetic::maze(16, 16, 2), synthetic::maze(16, 16, 3)}, 4.0f},
+        {"terrain",    {synthetic::rolling_terrain(224, 224, 8.0f)}, 0.0f},
+    };
+
+    test_segments();
+    test_segment_spheres();
+    for (const auto& map : maps)
+        run(map, query_count);
+
+    if (failures != 0) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+namespace {
+
+void check(bool condition, const char* name, const char* what)
+{
+    if (condition)
+        return;
+
+    std::printf("  FAILED (%s): %s\n", name, what);
+    ++failures;
+}
+
+double microseconds_since(clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+}
+
+double percentile(std::vector<double>& latencies, double p)
+{
+    if (latencies.empty())
+        return 0.0;
+
+    const std::size_t n = std::min(latencies.size() - 1,
+                                   static_cast<std::size_t>(p * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + n, latencies.end());
+    return latencies[n];
+}
+
+void test_segments()
+{
+    using sentutil::collision::test_segment;
+    constexpr const char* name = "segments";
+
+    auto near = [] (sentinel::real a, sentinel::real b) { return std::abs(a - b) <= 1e-4f; };
+    auto near_point = [] (const sentinel::real3d& a, const sentinel::real3d& b) {
+        return norm(a - b) <= 1e-4f;
+    };
+
+    // the surface of a flat grid of unit cells over the point (x, y)
+    auto grid_surface = [] (long cells_x, sentinel::real x, sentinel::real y) {
+        const long cx = static_cast<long>(x), cy = static_cast<long>(y);
+        return 2 * (cy * cells_x + cx) + (y - cy > x - cx ? 1 : 0);
+    };
+
+    {   // a single flat storey, solid below z = 0
+        const auto cbsp = synthetic::generate_collision_bsp({synthetic::flat_grid(8, 8)});
+        const auto& tag = cbsp->get();
+
+        const auto hit = test_segment(tag, {2.3f, 4.6f, 1.0f}, {0.0f, 0.0f, -2.0f});
+        check(hit.has_value(), name, "segment into the ground missed");
+        if (hit) {
+            check(near(hit->fraction, 0.5f) && near(hit->distance, 1.0f)
+                  && near_point(hit->point, {2.3f, 4.6f, 0.0f}),
+                  name, "hit is not on the ground");
+            check(near_point(hit->plane.normal, {0.0f, 0.0f, 1.0f}),
+                  name, "hit plane does not face the source");
+            check(hit->surface == grid_surface(8, 2.3f, 4.6f), name, "hit the wrong surface");
+        }
+
+        const auto slanted = test_segment(tag, {1.2f, 1.7f, 2.0f}, {4.0f, 2.0f, -4.0f});
+        check(slanted && near_point(slanted->point, {3.2f, 2.7f, 0.0f})
+              && slanted->surface == grid_surface(8, 3.2f, 2.7f),
+              name, "slanted segment did not hit where it crosses the ground");
+
+        check(!test_segment(tag, {2.3f, 4.6f, 1.0f}, {0.0f, 0.0f, -0.5f}),
+              name, "segment short of the ground hit");
+        check(!test_segment(tag, {1.0f, 1.0f, 1.0f}, {5.0f, 5.0f, 0.0f}),
+              name, "segment above the ground hit");
+        check(!test_segment(tag, {2.3f, 4.6f, 0.0f}, {3.0f, 1.0f, 0.0f}),
+              name, "segment along the ground hit");
+
+        // straight down onto a vertex, where four cells and the diagonal planes meet
+        const auto vertex = test_segment(tag, {3.0f, 3.0f, 1.0f}, {0.0f, 0.0f, -2.0f});
+        check(vertex && near_point(vertex->point, {3.0f, 3.0f, 0.0f}) && vertex->surface >= 0,
+              name, "segment onto a vertex did not hit a surface there");
+
+        // starting below the ground, the solid space is passed through
+        check(!test_segment(tag, {2.3f, 4.6f, -1.0f}, {0.0f, 0.0f, 2.0f}),
+              name, "segment leaving solid space hit");
+        check(!test_segment(tag, {2.3f, 4.6f, -1.0f}, {0.0f, 0.0f, -2.0f}),
+              name, "segment within solid space hit");
+
+        check(!test_segment(tag, {2.3f, 4.6f, 1.0f}, sentinel::real3d::zero),
+              name, "zero-length segment above the ground hit");
+        check(!test_segment(tag, {2.3f, 4.6f, 0.0f}, sentinel::real3d::zero),
+              name, "zero-length segment on the ground hit");
+        check(!test_segment(tag, {2.3f, 4.6f, -1.0f}, sentinel::real3d::zero),
+              name, "zero-length segment in solid space hit");
+    }
+
+    {   // a ridge along x = 2, rising from either side to z = 1
+        synthetic::height_field ridge(4, 4, 1.0f);
+        for (long y = 0; y <= ridge.cells_y; ++y)
+            ridge.height(2, y) = 1.0f;
+
+        const auto cbsp = synthetic::generate_collision_bsp({ridge});
+        const auto& tag = cbsp->get();
+
+        check(!test_segment(tag, {2.0f, 0.5f, 1.0f}, {0.0f, 3.0f, 0.0f}),
+              name, "segment along the ridge edge hit");
+        check(!test_segment(tag, {0.5f, 1.5f, 1.0f}, {3.0f, 0.0f, 0.0f}),
+              name, "segment grazing the ridge edge hit");
+
+        const auto below = test_segment(tag, {0.5f, 1.5f, 0.9f}, {3.0f, 0.0f, 0.0f});
+        check(below && near_point(below->point, {1.9f, 1.5f, 0.9f}),
+              name, "segment below the ridge edge did not hit the rising side");
+        check(below && below->surface == grid_surface(4, 1.9f, 1.5f),
+              name, "segment below the ridge edge hit the wrong surface");
+    }
+
+    {   // two flat storeys, with a solid floor from z = 3.875 to z = 4
+        const auto cbsp = synthetic::generate_collision_bsp({synthetic::flat_grid(8, 8),
+                                                             synthetic::flat_grid(8, 8)},
+                                                            4.0f);
+        const auto& tag = cbsp->get();
+
+        const auto floor = test_segment(tag, {2.3f, 4.6f, -1.0f}, {0.0f, 0.0f, 6.0f});
+        check(floor && near(floor->point[2], 3.875f)
+              && near_point(floor->plane.normal, {0.0f, 0.0f, -1.0f}),
+              name, "segment from solid space did not hit the floor above");
+
+        const auto upper = test_segment(tag, {2.3f, 4.6f, 5.0f}, {0.0f, 0.0f, -2.0f});
+        check(upper && near(upper->point[2], 4.0f)
+              && upper->surface == 128 + grid_surface(8, 2.3f, 4.6f),
+              name, "segment onto the upper storey did not hit its surface");
+
+        check(!test_segment(tag, {2.3f, 4.6f, 3.9f}, {0.0f, 0.0f, 0.5f}),
+              name, "segment leaving the floor hit");
+    }
+}
+
+void test_segment_spheres()
+{
+    using simulacrum::math::intersects_bounded_segment_sphere;
+    constexpr const char* name = "segment spheres";
+
+    // a segment from (0, 0, 0) to (4, 0, 0)
+    const sentinel::position3d  begin     = sentinel::real3d::zero;
+    const sentinel::direction3d direction = {1.0f, 0.0f, 0.0f};
+    const sentinel::real        length    = 4.0f;
+
+    check(intersects_bounded_segment_sphere(begin, direction, length, {2.0f, 0.5f, 0.0f}, 1.0f),
+          name, "sphere across the segment missed");
+    check(intersects_bounded_segment_sphere(begin, direction, length, {-0.5f, 0.0f, 0.0f}, 1.0f),
+          name, "sphere over the start missed");
+    check(intersects_bounded_segment_sphere(begin, direction, length, {4.5f, 0.5f, 0.0f}, 1.0f),
+          name, "sphere over the end missed");
+    check(!intersects_bounded_segment_sphere(begin, direction, length, {2.0f, 0.0f, 1.5f}, 1.0f),
+          name, "sphere beside the segment hit");
+
+    // beyond either end, but on the line through the segment
+    check(!intersects_bounded_segment_sphere(begin, direction, length, {-3.0f, 0.0f, 0.0f}, 1.0f),
+          name, "sphere on the line before the start hit");
+    check(!intersects_bounded_segment_sphere(begin, direction, length, {10.0f, 0.0f, 0.0f}, 1.0f),
+          name, "sphere on the line past the end hit");
+    check(!intersects_bounded_segment_sphere(begin, direction, length, {5.0f, 0.5f, 0.0f}, 1.0f),
+          name, "sphere near the line past the end hit");
+
+    // edges are tested against the spheres of one scenery object at a time, of which
+    // there are a handful
+    constexpr std::size_t group_size  = 6;
+    constexpr std::size_t group_count = 4096;
+    constexpr int         passes      = 16;
+
+    std::minstd_rand rng(0x5EED);
+    std::uniform_real_distribution<float> coordinate(-8.0f, 8.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 1.0f);
+    std::uniform_real_distribution<float> segment_length(0.5f, 4.0f);
+
+    std::vector<sentinel::real> sphere_x, sphere_y, sphere_z, sphere_radius;
+    std::vector<sentinel::position3d>  segment_begins;
+    std::vector<sentinel::direction3d> segment_directions;
+    std::vector<sentinel::real>        segment_lengths;
+    for (std::size_t i = 0; i < group_size * group_count; ++i) {
+        sphere_x.push_back(coordinate(rng));
+        sphere_y.push_back(coordinate(rng));
+        sphere_z.push_back(coordinate(rng));
+        sphere_radius.push_back(radius(rng));
+    }
+    for (std::size_t i = 0; i < group_count; ++i) {
+        segment_begins.push_back({coordinate(rng), coordinate(rng), coordinate(rng)});
+        segment_directions.push_back(normalized(sentinel::real3d{coordinate(rng), coordinate(rng), coordinate(rng)}));
+        segment_lengths.push_back(segment_length(rng));
+    }
+
+    std::vector<char> scalar_hits(group_count), batched_hits(group_count);
+    const auto scalar_start = clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (std::size_t i = 0; i < group_count; ++i) {
+            bool hit = false;
+            for (std::size_t j = i * group_size; !hit && j < (i + 1) * group_size; ++j) {
+                hit = simulacrum::math::intersects_segment_sphere(
+                    segment_begins[i], segment_directions[i], segment_lengths[i],
+                    {sphere_x[j], sphere_y[j], sphere_z[j]}, sphere_radius[j]);
+            }
+            scalar_hits[i] = hit;
+        }
+    }
+    const double scalar_time = microseconds_since(scalar_start);
+
+    const auto batched_start = clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (std::size_t i = 0; i < group_count; ++i) {
+            const std::size_t first = i * group_size;
+            batched_hits[i] = simulacrum::math::intersects_segment_spheres(
+                segment_begins[i], segment_directions[i], segment_lengths[i],
+                sphere_x.data() + first, sphere_y.data() + first, sphere_z.data() + first,
+                sphere_radius.data() + first, group_size);
+        }
+    }
+    const double batched_time = microseconds_since(batched_start);
+
+    check(scalar_hits == batched_hits, name, "batched test differs from the scalar test");
+    std::printf("%s: %zu spheres per segment, %.1fns scalar, %.1fns batched\n",
+                name, group_size,
+                1000.0 * scalar_time / (passes * group_count),
+                1000.0 * batched_time / (passes * group_count));
+}
+
+void run(const benchmark_map& map, long query_count)
+{
+    using simulacrum::navigation_graph_node;
+
+    // the results of this many queries are compared against brute force
+    constexpr long checked_queries = 100;
+    constexpr int  build_count     = 3;
+
+    const auto cbsp = synthetic::generate_collision_bsp(map.storeys, map.storey_height);
+    const simulacrum::utility::compiled_cbsp geometry(cbsp->get());
+
+    // the graph is built over threads, but must be the same each time
+    std::vector<double> build_latencies;
+    std::optional<simulacrum::navigation_graph> first_build;
+    for (int i = 0; i < build_count; ++i) {
+        const auto start_time = clock::now();
+        simulacrum::navigation_graph nav_graph(geometry, simulacrum::scenery_snapshot{});
+        build_latencies.push_back(microseconds_since(start_time) / 1000.0);
+
+        if (!first_build) {
+            first_build.emplace(std::move(nav_graph));
+            continue;
+        }
+
+        const auto& expected = first_build->get_graph();
+        const auto& actual   = nav_graph.get_graph();
+        bool same = actual.size() == expected.size()
+                 && actual.storage().edge_count == expected.storage().edge_count;
+        for (std::uint32_t v = 0; same && v < actual.size(); ++v)
+            same = actual.node(v) == expected.node(v);
+        check(same, map.name, "graph differs between builds");
+    }
+
+    const auto& nav_graph = first_build.value();
+    const auto& graph     = nav_graph.get_graph();
+    std::printf("%s: %ld surfaces, %u vertices, %u edges, built in %.1fms (min %.1fms)\n",
+                map.name, (long)geometry.surface_count(), (unsigned)graph.size(),
+                (unsigned)graph.storage().edge_count,
+                percentile(build_latencies, 0.5), percentile(build_latencies, 0.0));
+    check(graph.size() != 0, map.name, "no vertices");
+    if (graph.size() == 0)
+        return;
+
+    {   // a graph mapped from a file adopts the arrays in place, but must find nodes as
+        // fast as the graph built
+        using graph_type = simulacrum::navigation_graph::graph_type;
+        const auto adopt_start = clock::now();
+        const graph_type adopted(graph.storage(),
+                                 std::shared_ptr<const void>(&graph, [] (const void*) { }));
+        const double adopt_time = microseconds_since(adopt_start) / 1000.0;
+
+        auto find_all = [] (const graph_type& g, bool& found) {
+            const auto start_time = clock::now();
+            for (std::uint32_t v = 0; v < g.size(); ++v)
+                found = found && g.find(g.node(v)) == g.vertex(v);
+            return 1000.0 * microseconds_since(start_time) / g.size();
+        };
+
+        bool found = true;
+        const double built_find   = find_all(graph, found);
+        const double adopted_find = find_all(adopted, found);
+        check(found, map.name, "find did not return the vertex of a node");
+
+        std::printf("  adopted in %.1fms, find %.1fns built, %.1fns adopted\n",
+                    adopt_time, built_find, adopted_find);
+    }
+
+    std::minstd_rand rng(0x5EED);
+    std::uniform_int_distribution<std::uint32_t> pick(0, graph.size() - 1);
+
+    // points are taken a little above the nodes, where units stand
+    std::vector<sentinel::real3d> points;
+    for (long i = 0; i < query_count; ++i)
+        points.push_back(graph.node(pick(rng)).point + sentinel::real3d{0.0f, 0.0f, 0.3f});
+
+    {
+        std::vector<double> latencies;
+        bool nearest = true;
+        for (long i = 0; i < query_count; ++i) {
+            const auto start_time = clock::now();
+            const auto vertex     = nav_graph.nearest_node(points[i]);
+            latencies.push_back(microseconds_since(start_time));
+            if (!vertex) {
+                nearest = false;
+                continue;
+            } else if (i >= checked_queries) {
+                continue;
+            }
+
+            float best = std::numeric_limits<float>::infinity();
+            for (std::uint32_t v = 0; v < graph.size(); ++v)
+                best = std::min(best, norm(graph.node(v).point - points[i]));
+            nearest = nearest && norm(graph.node(graph.index(*vertex)).point - points[i]) <= best + 1e-4f;
+        }
+        check(nearest, map.name, "nearest_node did not return the nearest vertex");
+
+        std::printf("  nearest p50 %.2fus, p90 %.2fus, p99 %.2fus, max %.2fus\n",
+                    percentile(latencies, 0.5), percentile(latencies, 0.9),
+                    percentile(latencies, 0.99), percentile(latencies, 1.0));
+    }
+
+    {
+        std::vector<double> latencies;
+        long located = 0;
+        for (const auto& point : points) {
+            const auto start_time = clock::now();
+            located += nav_graph.locate_node(geometry, point).has_value();
+            latencies.push_back(microseconds_since(start_time));
+        }
+        check(located == query_count, map.name, "locate_node did not locate every point");
+
+        std::printf("  locate  p50 %.2fus, p90 %.2fus, p99 %.2fus, max %.2fus\n",
+                    percentile(latencies, 0.5), percentile(latencies, 0.9),
+                    percentile(latencies, 0.99), percentile(latencies, 1.0));
+    }
+
+    {
+        auto straight_line = [] (const navigation_graph_node& node,
+                                 const navigation_graph_node& goal)
+                                 { return norm(goal.point - node.point); };
+        auto no_heuristic = [] (auto&&...) { return 0.0f; };
+        auto visit_all    = [] (auto&&...) { return true; };
+        auto all_edges    = [] (auto&&...) { return std::true_type(); };
+
+        simulacrum::astar_workspace<float> workspace;
+        simulacrum::astar_workspace<float> dijkstra_workspace;
+        std::vector<double> latencies;
+        long paths = 0;
+        bool optimal = true, connected = true;
+        for (long i = 0; i < query_count; ++i) {
+            const auto start = graph.vertex(pick(rng));
+            const auto goal  = graph.vertex(pick(rng));
+            const auto start_time = clock::now();
+            const bool found = simulacrum::astar_search(graph, workspace, start, goal,
+                                                        straight_line, visit_all, all_edges);
+            latencies.push_back(microseconds_since(start_time));
+            paths += found;
+            if (!found || i >= checked_queries) {
+                optimal = optimal && (found || i >= checked_queries
+                                            || !simulacrum::astar_search(graph, dijkstra_workspace, start, goal,
+                                                                         no_heuristic, visit_all, all_edges));
+                continue;
+            }
+
+            // the path must follow edges of the graph and be as short as Dijkstra's
+            const auto path = simulacrum::get_path(workspace, start, goal);
+            float length = 0.0f;
+            std::uint32_t from = graph.index(start);
+            for (std::uint32_t to : path.value()) {
+                const auto edges = graph.egress_edges(from);
+                const auto edge  = std::find_if(edges.begin(), edges.end(),
+                                                [to] (const auto& e) { return e.target == to; });
+                if (edge == edges.end()) {
+                    connected = false;
+                    break;
+                }
+                length += (*edge)->distance;
+                from = to;
+            }
+
+            const float distance = workspace.distance(graph.index(goal));
+            connected = connected && from == graph.index(goal)
+                     && std::abs(length - distance) <= 1e-3f * std::max(1.0f, distance);
+            optimal = optimal
+                && simulacrum::astar_search(graph, dijkstra_workspace, start, goal,
+                                            no_heuristic, visit_all, all_edges)
+                && std::abs(dijkstra_workspace.distance(graph.index(goal)) - distance)
+                   <= 1e-3f * std::max(1.0f, distance);
+        }
+        check(connected, map.name, "astar_search path does not follow the graph");
+        check(optimal, map.name, "astar_search disagrees with Dijkstra's algorithm");
+
+        std::printf("  astar   %ld/%ld found, p50 %.0fus, p90 %.0fus, p99 %.0fus, max %.0fus\n",
+                    paths, (long)latencies.size(),
+                    percentile(latencies, 0.5), percentile(latencies, 0.9),
+                    percentile(latencies, 0.99), percentile(latencies, 1.0));
+    }
+}
+
+} // namespace (anonymous)
@@ -0,0 +1,167 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "obstacles.hpp"
+#include "math.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+
+#include <sentutil/all.hpp>
+
+namespace {
+
+/** \brief Returns `true` if objects of type \a type may obstruct navigation without
+ *         being part of the navigation graph.
+ *
+ * Only vehicles and machines, such as doors and lifts, are obstacles, so that the
+ * per-tick snapshot reads the tags and node transforms of few objects.
+ */
+bool is_obstacle_type(int type) noexcept;
+
+} // namespace (anonymous)
+
+namespace simulacrum {
+
+void snapshot_obstacles(std::vector<obstacle_sphere>& out)
+{
+    out.clear();
+
+    sentinel::table_type<sentinel::object_table_datum>& table = *sentutil::globals::objects;
+    for (sentinel::object_table_datum& object_dat : table) {
+        if (!is_obstacle_type(object_dat.type))
+            continue;
+
+        sentinel::object&       object     = *object_dat.object;
+        sentinel::tags::object& definition = *reinterpret_cast<sentinel::tags::object*>(object.object.tag->definition);
+        if (object.object.parent || !definition.object.collision_model)
+            continue;
+
+        const std::uint64_t object_key = (std::uint64_t(object_dat.salt) << 16)
+                                       | std::uint64_t(&object_dat - table.array);
+        const auto& spheres = definition.object.collision_model->pathfinding.spheres;
+        for (long i = 0; i < spheres.count; ++i) {
+            const auto& sphere = spheres[i];
+            const sentinel::real3d center = sphere.node < 0
+                ? object.object.position + sphere.center
+                : object.object.node_transforms[sphere.node] * sphere.center;
+            out.push_back({(object_key << 16) | std::uint64_t(i), center, sphere.radius});
+        }
+    }
+}
+
+void obstacle_layer::reset(const navigation_graph& nav_graph_)
+{
+    nav_graph = std::addressof(nav_graph_);
+    obstacles.clear();
+
+    const std::uint32_t edge_count = nav_graph->get_graph().storage().edge_count;
+    blocker_counts.assign(edge_count, 0);
+    blocked.assign(edge_count, false);
+    blocked_edges = 0;
+}
+
+const std::vector<std::uint32_t>&
+obstacle_layer::update(const std::vector<obstacle_sphere>& spheres)
+{
+    touched.clear();
+    changed.clear();
+    if (!nav_graph)
+        return changed;
+
+    ++stamp;
+    for (const obstacle_sphere& sphere : spheres) {
+        auto [it, inserted] = obstacles.try_emplace(sphere.key);
+        tracked_obstacle& obstacle = it->second;
+        obstacle.stamp = stamp;
+
+        if (!inserted) {
+            const bool moved = norm(sphere.center - obstacle.center) > movement_tolerance
+                            || std::abs(sphere.radius - obstacle.radius) > movement_tolerance;
+            if (!moved)
+                continue;
+            unblock(obstacle);
+        }
+
+        obstacle.center = sphere.center;
+        obstacle.radius = sphere.radius;
+        block(obstacle);
+    }
+
+    for (auto it = obstacles.begin(); it != obstacles.end();) {
+        if (it->second.stamp == stamp) {
+            ++it;
+            continue;
+        }
+
+        unblock(it->second);
+        it = obstacles.erase(it);
+    }
+
+    // an edge unblocked and reblocked by an obstacle that moved is left unreported
+    for (std::uint32_t edge : touched) {
+        const bool is_blocked = blocker_counts[edge] != 0;
+        if (is_blocked == static_cast<bool>(blocked[edge]))
+            continue;
+
+        blocked[edge] = is_blocked;
+        if (is_blocked) ++blocked_edges;
+        else            --blocked_edges;
+        changed.push_back(edge);
+    }
+
+    return changed;
+}
+
+void obstacle_layer::block(tracked_obstacle& obstacle)
+{
+    const auto& graph = nav_graph->get_graph();
+    const auto  extent = sentinel::real3d::filled(obstacle.radius);
+
+    candidates.clear();
+    nav_graph->find_edges({obstacle.center - extent, obstacle.center + extent}, candidates);
+
+    obstacle.edges.clear();
+    for (std::uint32_t edge_index : candidates) {
+        const graph_type::edge_type& edge = graph.edge(edge_index);
+        if (!math::intersects_bounded_segment_sphere(graph.node(edge.source).point,
+                                                     edge->direction,
+                                                     edge->distance,
+                                                     obstacle.center,
+                                                     obstacle.radius))
+            continue;
+
+        obstacle.edges.push_back(edge_index);
+        if (blocker_counts[edge_index]++ == 0)
+            touched.push_back(edge_index);
+    }
+}
+
+void obstacle_layer::unblock(tracked_obstacle& obstacle)
+{
+    for (std::uint32_t edge_index : obstacle.edges) {
+        if (--blocker_counts[edge_index] == 0)
+            touched.push_back(edge_index);
+    }
+    obstacle.edges.clear();
+}
+
+} // namespace simulacrum
+
+namespace {
+
+bool is_obstacle_type(int type) noexcept
+{
+    // bipeds do not obstruct each other and scenery is avoided by the graph, while
+    // items, controls and the like are walked over or around without blocking a path
+    constexpr int object_type_vehicle = 1;
+    constexpr int object_type_machine = 7;
+
+    return type == object_type_vehicle || type == object_type_machine;
+}
+
+} // namespace (anonymous)
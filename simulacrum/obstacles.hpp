@@ -0,0 +1,113 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unordered_map>
+#include <vector>
+
+#include <sentinel/types.hpp>
+
+#include "graph.hpp"
+
+namespace simulacrum {
+
+/** \brief A pathfinding sphere of an object that may move, in world space.
+ */
+struct obstacle_sphere {
+    std::uint64_t        key;    ///< Identifies the object and sphere across ticks.
+    sentinel::position3d center;
+    sentinel::real       radius;
+};
+
+/** \brief Gathers the pathfinding spheres of the objects that may obstruct navigation
+ *         without being part of the navigation graph, vehicles and machines, into
+ *         \a out.
+ *
+ * Scenery is excluded, as it is avoided when the graph is built. So are bipeds, which
+ * do not obstruct each other, items, and objects attached to a parent.
+ * This accesses the object table, so it must be called from the game thread.
+ */
+void snapshot_obstacles(std::vector<obstacle_sphere>& out);
+
+/** \brief Tracks the edges of a #navigation_graph that are obstructed by moving
+ *         objects, without rebuilding the graph.
+ *
+ * Each update diffs the obstacle spheres against those of the previous update.
+ * Only the spheres of objects that appeared, disappeared or moved by more than
+ * #movement_tolerance are tested against the graph, through its edge spatial index,
+ * so the cost of an update is proportional to the number of objects that moved.
+ *
+ * An edge is blocked while any obstacle sphere intersects it between its ends.
+ */
+class obstacle_layer {
+public:
+    using graph_type = navigation_graph::graph_type;
+
+    static constexpr sentinel::real movement_tolerance = 0.1f;
+
+    obstacle_layer() = default;
+
+    /** \brief Discards all obstacles and binds the layer to \a nav_graph, which must
+     *         outlive the binding.
+     */
+    void reset(const navigation_graph& nav_graph);
+
+    /** \brief Returns the number of obstacles tracked.
+     */
+    std::size_t obstacle_count() const noexcept { return obstacles.size(); }
+
+    /** \brief Returns the number of edges currently blocked.
+     */
+    std::size_t blocked_count() const noexcept { return blocked_edges; }
+
+    /** \brief Returns `true` if \a edge, an edge of the bound graph, is blocked.
+     */
+    bool is_blocked(const graph_type::edge_type& edge) const noexcept
+    { return blocked[nav_graph->get_graph().edge_index(edge)]; }
+
+    /** \brief Replaces the tracked obstacles with \a spheres.
+     *
+     * \return The indices of the edges that were blocked or unblocked by the update,
+     *         which remain valid until the next update.
+     */
+    const std::vector<std::uint32_t>& update(const std::vector<obstacle_sphere>& spheres);
+
+private:
+    struct tracked_obstacle {
+        sentinel::position3d       center;
+        sentinel::real             radius;
+        std::uint32_t              stamp; ///< The update the obstacle was last seen by.
+        std::vector<std::uint32_t> edges; ///< The edges the obstacle blocks.
+    };
+
+    const navigation_graph* nav_graph = nullptr;
+
+    std::unordered_map<std::uint64_t, tracked_obstacle> obstacles;
+
+    std::vector<std::uint16_t> blocker_counts; ///< The obstacles blocking each edge.
+    std::vector<char>          blocked;        ///< The blocked state of each edge, as
+                                               ///< last reported.
+    std::size_t                blocked_edges = 0;
+
+    std::uint32_t              stamp = 0;
+    std::vector<std::uint32_t> touched;   ///< The edges whose count changed.
+    std::vector<std::uint32_t> changed;   ///< The edges whose state changed.
+    std::vector<std::uint32_t> candidates;
+
+    /** \brief Blocks the edges that intersect the sphere of \a obstacle.
+     */
+    void block(tracked_obstacle& obstacle);
+
+    /** \brief Unblocks the edges blocked by \a obstacle.
+     */
+    void unblock(tracked_obstacle& obstacle);
+};
+
+} // namespace simulacrum
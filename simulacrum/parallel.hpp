@@ -0,0 +1,68 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace simulacrum {
+
+/** \brief Splits work over contiguous chunks of an index range, processing each chunk
+ *         on its own thread.
+ *
+ * The calling thread processes the first chunk and blocks until the other chunks are
+ * processed, at which point all writes from the other threads are observed.
+ * The chunks are a function of the range size and the number of hardware threads
+ * alone, so results gathered per chunk and concatenated in chunk order do not depend
+ * on scheduling.
+ */
+struct parallel_chunks {
+    std::size_t min_chunk_size = 64; ///< The smallest range worth a thread to itself.
+
+    /** \brief Returns the number of chunks that a range of \a count indices is split into.
+     */
+    std::size_t chunk_count(std::size_t count) const noexcept
+    {
+        const std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        return std::clamp<std::size_t>(count / std::max<std::size_t>(min_chunk_size, 1), 1, threads);
+    }
+
+    /** \brief Invokes `f(chunk, begin, end)` for each chunk `[begin, end)` of `[0, count)`.
+     *
+     * \a f must not throw.
+     */
+    template<class F>
+    void operator()(std::size_t count, const F& f) const
+    {
+        const std::size_t chunks = chunk_count(count);
+        auto chunk_begin = [count, chunks] (std::size_t chunk) { return count * chunk / chunks; };
+
+        std::vector<std::thread> threads;
+        threads.reserve(chunks - 1);
+        for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+            threads.emplace_back(f, chunk, chunk_begin(chunk), chunk_begin(chunk + 1));
+
+        f(std::size_t(0), chunk_begin(0), chunk_begin(1));
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+};
+
+/** \brief Processes an index range as a single chunk on the calling thread, for use
+ *         where a #parallel_chunks is accepted.
+ */
+struct sequential_chunks {
+    std::size_t chunk_count(std::size_t) const noexcept { return 1; }
+
+    template<class F>
+    void operator()(std::size_t count, const F& f) const { f(std::size_t(0), std::size_t(0), count); }
+};
+
+} // namespace simulacrum
@@ -0,0 +1,200 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "perf.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <sentutil/all.hpp>
+
+namespace {
+
+using simulacrum::perf::phase_count;
+using simulacrum::perf::tick_capacity;
+
+/** \brief The time spent in and the number of entries to each phase over a tick.
+ */
+struct tick_record {
+    std::array<std::uint64_t, phase_count> cycles;
+    std::array<std::uint32_t, phase_count> entries;
+};
+
+std::array<tick_record, tick_capacity> ticks;
+
+std::size_t current  = 0; ///< The index of the tick being recorded.
+std::size_t recorded = 0; ///< The number of ticks kept, including the current tick.
+
+/** \brief A time stamp and clock reading taken together at the first tick recorded,
+ *         against which the rate of the time stamp counter is measured.
+ */
+std::uint64_t                         calibration_timestamp;
+std::chrono::steady_clock::time_point calibration_time;
+
+/** \brief Returns the number of time stamp counts per microsecond.
+ */
+double get_counts_per_microsecond();
+
+/** \brief Returns the indices of the ticks kept, oldest first, excluding the tick that
+ *         is being recorded.
+ */
+std::vector<std::size_t> get_complete_ticks();
+
+} // namespace (anonymous)
+
+namespace simulacrum { namespace perf {
+
+const char* get_phase_name(phase p) noexcept
+{
+    constexpr const char* names[phase_count] = {
+        "tick", "preupdate", "ai", "control", "postupdate",
+        "targeting", "obstacles", "planning", "simulation", "raycast"
+    };
+    return p < phase_count ? names[p] : "unknown";
+}
+
+void begin_tick() noexcept
+{
+    if (recorded == 0) {
+        calibration_timestamp = timestamp();
+        calibration_time      = std::chrono::steady_clock::now();
+    } else {
+        current = (current + 1) % tick_capacity;
+    }
+
+    recorded = std::min(recorded + 1, tick_capacity);
+    ticks[current] = tick_record();
+}
+
+void add(phase p, std::uint64_t cycles) noexcept
+{
+    if (recorded == 0)
+        return;
+
+    ticks[current].cycles[p]  += cycles;
+    ticks[current].entries[p] += 1;
+}
+
+void print_summary()
+{
+    using sentutil::console::cprintf;
+
+    const std::vector<std::size_t> complete = get_complete_ticks();
+    if (complete.empty()) {
+        cprintf(sentutil::color::red, "no ticks recorded");
+        return;
+    }
+
+    const double counts_per_us = get_counts_per_microsecond();
+    cprintf("%u ticks, %.0f counts/us", static_cast<unsigned>(complete.size()), counts_per_us);
+
+    std::vector<std::uint64_t> cycles(complete.size());
+    for (std::size_t p = 0; p < phase_count; ++p) {
+        std::uint64_t entries = 0;
+        for (std::size_t i = 0; i < complete.size(); ++i) {
+            cycles[i] = ticks[complete[i]].cycles[p];
+            entries  += ticks[complete[i]].entries[p];
+        }
+        if (entries == 0)
+            continue;
+
+        std::sort(cycles.begin(), cycles.end());
+        auto percentile = [&cycles, counts_per_us] (double q) {
+            return cycles[static_cast<std::size_t>(q * (cycles.size() - 1))] / counts_per_us;
+        };
+
+        cprintf("  %-10s p50 %.0fus, p90 %.0fus, p99 %.0fus, max %.0fus, %.1f/tick",
+                get_phase_name(static_cast<phase>(p)),
+                percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0),
+                static_cast<double>(entries) / complete.size());
+    }
+}
+
+bool export_csv(const std::string& filename)
+{
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << "tick";
+    for (std::size_t p = 0; p < phase_count; ++p)
+        out << ',' << get_phase_name(static_cast<phase>(p)) << "_us";
+    for (std::size_t p = 0; p < phase_count; ++p)
+        out << ',' << get_phase_name(static_cast<phase>(p)) << "_entries";
+    out << '\n';
+
+    const double counts_per_us = get_counts_per_microsecond();
+    const std::vector<std::size_t> complete = get_complete_ticks();
+    for (std::size_t i = 0; i < complete.size(); ++i) {
+        const tick_record& record = ticks[complete[i]];
+        out << i;
+        for (std::uint64_t c : record.cycles)
+            out << ',' << c / counts_per_us;
+        for (std::uint32_t n : record.entries)
+            out << ',' << n;
+        out << '\n';
+    }
+
+    return static_cast<bool>(out);
+}
+
+void clear() noexcept
+{
+    current  = 0;
+    recorded = 0;
+}
+
+bool load()
+{
+    using sentutil::script::install_script_function;
+    return
+        install_script_function<"simulacrum_perf">(
+            +[] (std::optional<std::string_view> filename) {
+                print_summary();
+                if (filename && !export_csv(std::string(filename.value())))
+                    sentutil::console::cprintf(sentutil::color::red, "could not write \"%s\"",
+                                               std::string(filename.value()).c_str());
+            },
+            "prints the percentiles of the time spent in each phase of recent ticks, optionally exporting each tick to a CSV file",
+            "[string: filename]") &&
+        install_script_function<"simulacrum_perf_reset">(
+            +[] { clear(); },
+            "discards the ticks timed so far",
+            "");
+}
+
+} } // namespace simulacrum::perf
+
+namespace {
+
+double get_counts_per_microsecond()
+{
+    const std::uint64_t counts = simulacrum::perf::timestamp() - calibration_timestamp;
+    const double microseconds  = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - calibration_time).count();
+
+    // too short an interval to measure, so counts are reported as they are
+    return microseconds > 1000.0 ? counts / microseconds : 1.0;
+}
+
+std::vector<std::size_t> get_complete_ticks()
+{
+    std::vector<std::size_t> indices;
+    if (recorded < 2)
+        return indices;
+
+    const std::size_t count = recorded - 1;
+    const std::size_t first = (current + tick_capacity - count) % tick_capacity;
+    for (std::size_t i = 0; i < count; ++i)
+        indices.push_back((first + i) % tick_capacity);
+    return indices;
+}
+
+} // namespace (anonymous)
@@ -0,0 +1,114 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <chrono>
+#include <string>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace simulacrum { namespace perf {
+
+/** \brief The phases of a tick that are timed, the first of which is the whole tick.
+ *
+ * The sub-steps are timed within the phases that run them, so their times overlap
+ * those of the phases.
+ */
+enum phase : std::size_t {
+    phase_tick,
+    phase_preupdate,
+    phase_ai,
+    phase_control,
+    phase_postupdate,
+    phase_targeting,  ///< Scoring the candidate targets.
+    phase_obstacles,  ///< Blocking edges by moving objects.
+    phase_planning,   ///< Searching for a path.
+    phase_simulation, ///< Creating restore points and advancing the simulation.
+    phase_raycast,    ///< Casting lines of sight.
+    phase_count
+};
+
+/** \brief The number of recent ticks kept.
+ */
+constexpr std::size_t tick_capacity = 1024;
+
+/** \brief Returns the name of \a p, as printed and exported.
+ */
+const char* get_phase_name(phase p) noexcept;
+
+/** \brief Reads the time stamp counter, or a steady clock where there is none.
+ */
+inline std::uint64_t timestamp() noexcept
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/** \brief Starts the record of a new tick, overwriting the oldest if the ring is full.
+ */
+void begin_tick() noexcept;
+
+/** \brief Adds \a cycles spent in \a p to the current tick.
+ */
+void add(phase p, std::uint64_t cycles) noexcept;
+
+/** \brief Times the span from its construction to its destruction, or to #stop,
+ *         adding it to the current tick.
+ */
+class scope {
+public:
+    explicit scope(phase p) noexcept : timed(p), start(timestamp()) { }
+
+    ~scope() { stop(); }
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    /** \brief Ends the span early. Subsequent calls have no effect.
+     */
+    void stop() noexcept
+    {
+        if (running) {
+            add(timed, timestamp() - start);
+            running = false;
+        }
+    }
+
+private:
+    phase         timed;
+    std::uint64_t start;
+    bool          running = true;
+};
+
+/** \brief Prints the percentiles of the time spent in each phase over the ticks kept.
+ */
+void print_summary();
+
+/** \brief Writes the time spent in and the number of entries to each phase for each
+ *         tick kept to \a filename, in CSV.
+ *
+ * \return `true` if the file was written, otherwise `false`.
+ */
+bool export_csv(const std::string& filename);
+
+/** \brief Discards the ticks kept.
+ */
+void clear() noexcept;
+
+/** \brief Installs the script functions for reporting timings.
+ */
+bool load();
+
+} } // namespace simulacrum::perf
@@ -0,0 +1,381 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "synthetic_cbsp.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+using cbsp_type = sentinel::tags::collision_bsp;
+
+/** \brief Accumulates the tag blocks of a collision BSP.
+ */
+class cbsp_builder {
+public:
+    std::vector<cbsp_type::bsp3d_node>      bsp3d_nodes;
+    std::vector<cbsp_type::plane>           planes;
+    std::vector<cbsp_type::leaf>            leaves;
+    std::vector<cbsp_type::bsp2d_reference> bsp2d_references;
+    std::vector<cbsp_type::surface>         surfaces;
+    std::vector<cbsp_type::edge>            edges;
+    std::vector<cbsp_type::vertex>          vertices;
+
+    std::int32_t add_plane(const sentinel::direction3d& normal, const sentinel::position3d& point);
+
+    std::int32_t add_vertex(const sentinel::position3d& point);
+
+    /** \brief Adds the triangle through \a corners, linking its edges to those of the
+     *         surfaces already added.
+     */
+    std::int32_t add_triangle(const std::array<std::int32_t, 3>& corners);
+
+    /** \brief Adds a node partitioning space by \a plane, returning its index.
+     *
+     * The children are assigned once built, as the node vector may reallocate.
+     */
+    std::int32_t add_node(std::int32_t plane);
+
+    /** \brief Adds a leaf bounded below by \a surface, returning the child index that
+     *         refers to it.
+     */
+    std::int32_t add_leaf(std::int32_t surface);
+
+    /** \brief Returns the collision BSP referring to the blocks above.
+     */
+    cbsp_type get() noexcept;
+
+private:
+    std::unordered_map<std::uint64_t, std::int32_t> edge_lookup; ///< By vertex pair.
+};
+
+/** \brief Builds the subtree over the cells `[x0, x1) x [y0, y1)` of \a field, the
+ *         surfaces of which start at \a first_surface.
+ */
+std::int32_t build_cells(cbsp_builder& builder,
+                         const simulacrum::synthetic::height_field& field,
+                         std::int32_t first_surface,
+                         long x0, long y0, long x1, long y1);
+
+/** \brief Builds the subtree over the storeys `[first, last)`.
+ */
+std::int32_t build_storeys(cbsp_builder& builder,
+                           const std::vector<simulacrum::synthetic::height_field>& storeys,
+                           const std::vector<std::int32_t>& first_surfaces,
+                           sentinel::real storey_height,
+                           std::size_t first, std::size_t last);
+
+} // namespace (anonymous)
+
+namespace simulacrum { namespace synthetic {
+
+height_field flat_grid(long cells_x, long cells_y, sentinel::real cell_size)
+{
+    return height_field(cells_x, cells_y, cell_size);
+}
+
+height_field stair_ramp(long cells_x, long cells_y,
+                        long step_cells, sentinel::real step_height,
+                        sentinel::real cell_size)
+{
+    height_field field(cells_x, cells_y, cell_size);
+    step_cells = std::max(step_cells, 1l);
+    for (long y = 0; y <= cells_y; ++y) {
+        for (long x = 0; x <= cells_x; ++x)
+            field.height(x, y) = (x / step_cells) * step_height;
+    }
+    return field;
+}
+
+height_field rolling_terrain(long cells_x, long cells_y,
+                             sentinel::real amplitude,
+                             sentinel::real cell_size)
+{
+    height_field field(cells_x, cells_y, cell_size);
+    for (long y = 0; y <= cells_y; ++y) {
+        for (long x = 0; x <= cells_x; ++x) {
+            const sentinel::real s = std::sin(0.11f * x) * std::cos(0.07f * y);
+            field.height(x, y) = 0.5f * amplitude * (s + 1.0f);
+        }
+    }
+    return field;
+}
+
+height_field maze(long maze_x, long maze_y, unsigned seed,
+                  sentinel::real wall_height,
+                  sentinel::real cell_size)
+{
+    constexpr long room_stride = 4; // three cells of room, one of wall
+
+    maze_x = std::max(maze_x, 1l);
+    maze_y = std::max(maze_y, 1l);
+    const long cells_x = maze_x * room_stride + 1;
+    const long cells_y = maze_y * room_stride + 1;
+
+    // every cell on a wall line is a wall until carved
+    std::vector<char> walls(cells_x * cells_y);
+    for (long y = 0; y < cells_y; ++y) {
+        for (long x = 0; x < cells_x; ++x)
+            walls[y * cells_x + x] = x % room_stride == 0 || y % room_stride == 0;
+    }
+
+    // randomized depth-first search over the rooms
+    std::minstd_rand rng(seed);
+    std::vector<char> visited(maze_x * maze_y);
+    std::vector<std::pair<long, long>> stack = {{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        const auto [rx, ry] = stack.back();
+
+        std::array<std::pair<long, long>, 4> unvisited;
+        std::size_t count = 0;
+        for (auto [dx, dy] : {std::pair{1l, 0l}, {-1l, 0l}, {0l, 1l}, {0l, -1l}}) {
+            const long nx = rx + dx, ny = ry + dy;
+            if (nx >= 0 && ny >= 0 && nx < maze_x && ny < maze_y && !visited[ny * maze_x + nx])
+                unvisited[count++] = {nx, ny};
+        }
+
+        if (count == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        const auto [nx, ny] = unvisited[rng() % count];
+        visited[ny * maze_x + nx] = true;
+        stack.push_back({nx, ny});
+
+        // carve the wall between the rooms
+        if (nx != rx) {
+            const long wx = std::max(rx, nx) * room_stride;
+            for (long y = ry * room_stride + 1; y < (ry + 1) * room_stride; ++y)
+                walls[y * cells_x + wx] = false;
+        } else {
+            const long wy = std::max(ry, ny) * room_stride;
+            for (long x = rx * room_stride + 1; x < (rx + 1) * room_stride; ++x)
+                walls[wy * cells_x + x] = false;
+        }
+    }
+
+    // a vertex is raised if any cell around it is a wall
+    height_field field(cells_x, cells_y, cell_size);
+    for (long y = 0; y <= cells_y; ++y) {
+        for (long x = 0; x <= cells_x; ++x) {
+            bool raised = false;
+            for (long cy = std::max(y - 1, 0l); cy <= std::min(y, cells_y - 1); ++cy) {
+                for (long cx = std::max(x - 1, 0l); cx <= std::min(x, cells_x - 1); ++cx)
+                    raised = raised || walls[cy * cells_x + cx];
+            }
+            field.height(x, y) = raised ? wall_height : 0.0f;
+        }
+    }
+    return field;
+}
+
+std::unique_ptr<collision_bsp_snapshot>
+generate_collision_bsp(const std::vector<height_field>& storeys,
+                       sentinel::real storey_height)
+{
+    cbsp_builder builder;
+
+    std::vector<std::int32_t> first_surfaces;
+    for (std::size_t k = 0; k < storeys.size(); ++k) {
+        const height_field& field = storeys[k];
+        const sentinel::real base = k * storey_height;
+        first_surfaces.push_back(static_cast<std::int32_t>(builder.surfaces.size()));
+
+        const std::int32_t first_vertex = static_cast<std::int32_t>(builder.vertices.size());
+        for (long y = 0; y <= field.cells_y; ++y) {
+            for (long x = 0; x <= field.cells_x; ++x)
+                builder.add_vertex({x * field.cell_size, y * field.cell_size, base + field.height(x, y)});
+        }
+
+        // cell (x, y) is split into the surfaces 2c and 2c + 1 from a to c
+        // d - c
+        // | / |
+        // a - b
+        auto vertex = [first_vertex, &field] (long x, long y) {
+            return first_vertex + static_cast<std::int32_t>(y * (field.cells_x + 1) + x);
+        };
+        for (long y = 0; y < field.cells_y; ++y) {
+            for (long x = 0; x < field.cells_x; ++x) {
+                const std::int32_t a = vertex(x, y),     b = vertex(x + 1, y);
+                const std::int32_t c = vertex(x + 1, y + 1), d = vertex(x, y + 1);
+                builder.add_triangle({a, b, c});
+                builder.add_triangle({a, c, d});
+            }
+        }
+    }
+
+    if (!storeys.empty())
+        build_storeys(builder, storeys, first_surfaces, storey_height, 0, storeys.size());
+
+    return std::make_unique<collision_bsp_snapshot>(builder.get());
+}
+
+} } // namespace simulacrum::synthetic
+
+namespace {
+
+std::int32_t cbsp_builder::add_plane(const sentinel::direction3d& normal,
+                                     const sentinel::position3d& point)
+{
+    planes.push_back({normal, dot(normal, point)});
+    return static_cast<std::int32_t>(planes.size() - 1);
+}
+
+std::int32_t cbsp_builder::add_vertex(const sentinel::position3d& point)
+{
+    vertices.push_back({point, -1});
+    return static_cast<std::int32_t>(vertices.size() - 1);
+}
+
+std::int32_t cbsp_builder::add_triangle(const std::array<std::int32_t, 3>& corners)
+{
+    const auto& a = vertices[corners[0]].point;
+    const auto& b = vertices[corners[1]].point;
+    const auto& c = vertices[corners[2]].point;
+
+    const std::int32_t surface = static_cast<std::int32_t>(surfaces.size());
+    const std::int32_t plane   = add_plane(normalized(cross(b - a, c - a)), a);
+
+    // the surface is on side 0 of the edges it adds, from vertices[0] to vertices[1],
+    // and on side 1 of the edges it shares, which it follows in reverse
+    std::array<std::int32_t, 3> ring;
+    for (std::size_t k = 0; k < 3; ++k) {
+        const std::int32_t from = corners[k];
+        const std::int32_t to   = corners[(k + 1) % 3];
+        const std::uint64_t key = (std::uint64_t(std::min(from, to)) << 32) | std::uint32_t(std::max(from, to));
+
+        auto [it, inserted] = edge_lookup.try_emplace(key, static_cast<std::int32_t>(edges.size()));
+        if (inserted)
+            edges.push_back({{from, to}, {-1, -1}, {surface, -1}});
+        else
+            edges[it->second].surfaces[1] = surface;
+        ring[k] = it->second;
+
+        if (vertices[from].first_edge < 0)
+            vertices[from].first_edge = it->second;
+    }
+
+    for (std::size_t k = 0; k < 3; ++k) {
+        cbsp_type::edge& edge = edges[ring[k]];
+        edge.edges[edge.surfaces[0] == surface ? 0 : 1] = ring[(k + 1) % 3];
+    }
+
+    surfaces.push_back({plane, ring[0], 0, -1, -1});
+    return surface;
+}
+
+std::int32_t cbsp_builder::add_node(std::int32_t plane)
+{
+    bsp3d_nodes.push_back({plane, {-1, -1}});
+    return static_cast<std::int32_t>(bsp3d_nodes.size() - 1);
+}
+
+std::int32_t cbsp_builder::add_leaf(std::int32_t surface)
+{
+    // the 2D BSP of the reference is the surface alone
+    const std::int32_t leaf = static_cast<std::int32_t>(leaves.size());
+    leaves.push_back({0, 1, static_cast<std::int32_t>(bsp2d_references.size())});
+    bsp2d_references.push_back({surfaces[surface].plane,
+                                static_cast<std::int32_t>(0x80000000u | std::uint32_t(surface))});
+    return static_cast<std::int32_t>(0x80000000u | std::uint32_t(leaf));
+}
+
+cbsp_type cbsp_builder::get() noexcept
+{
+    cbsp_type cbsp = {};
+    auto point_to = [] (auto& block, auto& container) {
+        block.count = static_cast<decltype(block.count)>(container.size());
+        block.data  = container.data();
+    };
+
+    point_to(cbsp.bsp3d_nodes,      bsp3d_nodes);
+    point_to(cbsp.planes,           planes);
+    point_to(cbsp.leaves,           leaves);
+    point_to(cbsp.bsp2d_references, bsp2d_references);
+    point_to(cbsp.surfaces,         surfaces);
+    point_to(cbsp.edges,            edges);
+    point_to(cbsp.vertices,         vertices);
+    return cbsp;
+}
+
+std::int32_t build_cells(cbsp_builder& builder,
+                         const simulacrum::synthetic::height_field& field,
+                         std::int32_t first_surface,
+                         long x0, long y0, long x1, long y1)
+{
+    const sentinel::real size = field.cell_size;
+    if (x1 - x0 > 1 || y1 - y0 > 1) {
+        // split the longer side at the middle grid line
+        const bool  split_x = x1 - x0 >= y1 - y0;
+        const long  middle  = split_x ? (x0 + x1) / 2 : (y0 + y1) / 2;
+        const std::int32_t plane = split_x ? builder.add_plane({1, 0, 0}, {middle * size, 0, 0})
+                                           : builder.add_plane({0, 1, 0}, {0, middle * size, 0});
+
+        const std::int32_t node  = builder.add_node(plane);
+        const std::int32_t back  = split_x ? build_cells(builder, field, first_surface, x0, y0, middle, y1)
+                                           : build_cells(builder, field, first_surface, x0, y0, x1, middle);
+        const std::int32_t front = split_x ? build_cells(builder, field, first_surface, middle, y0, x1, y1)
+                                           : build_cells(builder, field, first_surface, x0, middle, x1, y1);
+        builder.bsp3d_nodes[node].children[0] = back;
+        builder.bsp3d_nodes[node].children[1] = front;
+        return node;
+    }
+
+    // the diagonal from a to c separates the surface over b (in front) from that over d
+    const std::int32_t surface = first_surface + static_cast<std::int32_t>(2 * (y0 * field.cells_x + x0));
+    const sentinel::real inv_sqrt2 = 0.70710678f;
+    const std::int32_t diagonal = builder.add_plane({inv_sqrt2, -inv_sqrt2, 0}, {x0 * size, y0 * size, 0});
+
+    auto build_surface = [&builder] (std::int32_t s) {
+        // the space above the surface is open and the space below is solid
+        const std::int32_t node = builder.add_node(builder.surfaces[s].plane);
+        const std::int32_t leaf = builder.add_leaf(s);
+        builder.bsp3d_nodes[node].children[0] = -1;
+        builder.bsp3d_nodes[node].children[1] = leaf;
+        return node;
+    };
+
+    const std::int32_t node  = builder.add_node(diagonal);
+    const std::int32_t back  = build_surface(surface + 1);
+    const std::int32_t front = build_surface(surface);
+    builder.bsp3d_nodes[node].children[0] = back;
+    builder.bsp3d_nodes[node].children[1] = front;
+    return node;
+}
+
+std::int32_t build_storeys(cbsp_builder& builder,
+                           const std::vector<simulacrum::synthetic::height_field>& storeys,
+                           const std::vector<std::int32_t>& first_surfaces,
+                           sentinel::real storey_height,
+                           std::size_t first, std::size_t last)
+{
+    if (last - first == 1) {
+        const auto& field = storeys[first];
+        return build_cells(builder, field, first_surfaces[first], 0, 0, field.cells_x, field.cells_y);
+    }
+
+    // the floors between storeys are solid, so the split is just below the base
+    const std::size_t middle = (first + last) / 2;
+    const std::int32_t plane = builder.add_plane({0, 0, 1}, {0, 0, middle * storey_height - 0.125f});
+
+    const std::int32_t node  = builder.add_node(plane);
+    const std::int32_t back  = build_storeys(builder, storeys, first_surfaces, storey_height, first, middle);
+    const std::int32_t front = build_storeys(builder, storeys, first_surfaces, storey_height, middle, last);
+    builder.bsp3d_nodes[node].children[0] = back;
+    builder.bsp3d_nodes[node].children[1] = front;
+    return node;
+}
+
+} // namespace (anonymous)
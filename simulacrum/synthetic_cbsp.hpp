@@ -0,0 +1,86 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+
+#include <memory>
+#include <vector>
+
+#include <sentinel/types.hpp>
+
+#include "graph.hpp"
+
+namespace simulacrum { namespace synthetic {
+
+/** \brief The heights of the vertices of a grid of square cells, from which a collision
+ *         BSP can be generated.
+ *
+ * Each cell is split along its diagonal into two triangular surfaces.
+ */
+struct height_field {
+    long           cells_x   = 0;
+    long           cells_y   = 0;
+    sentinel::real cell_size = 1.0f;
+
+    std::vector<sentinel::real> heights; ///< The height of each vertex, by row.
+
+    height_field() = default;
+
+    height_field(long cells_x_, long cells_y_, sentinel::real cell_size_)
+        : cells_x(cells_x_), cells_y(cells_y_), cell_size(cell_size_)
+        , heights((cells_x_ + 1) * (cells_y_ + 1), 0.0f) { }
+
+    sentinel::real& height(long x, long y) { return heights[y * (cells_x + 1) + x]; }
+    sentinel::real  height(long x, long y) const { return heights[y * (cells_x + 1) + x]; }
+
+    std::size_t surface_count() const noexcept { return 2 * cells_x * cells_y; }
+};
+
+/** \brief Generates a flat field.
+ */
+height_field flat_grid(long cells_x, long cells_y, sentinel::real cell_size = 1.0f);
+
+/** \brief Generates a field that climbs along the x-axis by \a step_height every
+ *         \a step_cells cells, each step rising over a single sloped cell.
+ */
+height_field stair_ramp(long cells_x, long cells_y,
+                        long step_cells, sentinel::real step_height,
+                        sentinel::real cell_size = 1.0f);
+
+/** \brief Generates a field of rolling hills with peaks of height \a amplitude.
+ */
+height_field rolling_terrain(long cells_x, long cells_y,
+                             sentinel::real amplitude,
+                             sentinel::real cell_size = 1.0f);
+
+/** \brief Generates a perfect maze of \a maze_x by \a maze_y rooms, with raised walls
+ *         between the rooms and a single path between any two rooms.
+ *
+ * Each room is three cells across and walls are a cell thick, so only the middle cell
+ * of each corridor is level.
+ */
+height_field maze(long maze_x, long maze_y, unsigned seed,
+                  sentinel::real wall_height = 3.0f,
+                  sentinel::real cell_size   = 1.0f);
+
+/** \brief Generates a collision BSP of the fields of \a storeys, stacked \a storey_height
+ *         apart.
+ *
+ * The surfaces, edges and vertices form the triangle meshes of the fields, with the
+ * edges linked as the game links them. The 3D BSP separates the storeys by horizontal
+ * planes and the cells of each storey by vertical planes, and each leaf is the space
+ * above a single surface. The space below each field is solid.
+ *
+ * The fields must rise less than \a storey_height above their base, less a floor
+ * thickness of `0.125`.
+ */
+std::unique_ptr<collision_bsp_snapshot>
+generate_collision_bsp(const std::vector<height_field>& storeys,
+                       sentinel::real storey_height = 0.0f);
+
+} } // namespace simulacrum::synthetic
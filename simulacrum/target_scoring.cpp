@@ -0,0 +1,92 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "target_scoring.hpp"
+#include "game_context.hpp"
+#include "math.hpp"
+
+#include <algorithm>
+
+namespace simulacrum {
+
+void target_scorer::clear() noexcept
+{
+    players.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    visible.clear();
+}
+
+void target_scorer::push_back(sentinel::player& player,
+                              const sentinel::real3d& position,
+                              bool maybe_visible)
+{
+    players.push_back(&player);
+    x.push_back(position[0]);
+    y.push_back(position[1]);
+    z.push_back(position[2]);
+    visible.push_back(maybe_visible);
+}
+
+void target_scorer::score(const sentinel::real3d&   source,
+                          const OrientationContext& orientation,
+                          const ProjectileContext*  projectile,
+                          sentinel::real            initial_speed,
+                          const weights_type&       weights)
+{
+    const std::size_t count = size();
+    distances.resize(count);
+    turn_offsets.resize(count);
+    scores.resize(count);
+
+    math::get_target_offsets(source, orientation,
+                             x.data(), y.data(), z.data(), count,
+                             distances.data(), turn_offsets.data());
+
+    for (std::size_t i = 0; i < count; ++i)
+        scores[i] = distances[i] + weights.turn * turn_offsets[i];
+
+    // travel times are looked up from the table of the projectile
+    if (projectile) {
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto [in_range, travel_time]
+                = math::projectile_travel_time_lookup(*projectile, initial_speed, distances[i]);
+            scores[i] += in_range ? weights.travel_time * travel_time : weights.out_of_range;
+        }
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!visible[i])
+            scores[i] += weights.hidden;
+    }
+}
+
+std::size_t target_scorer::select_indices(std::size_t max_count,
+                                          std::size_t* best) const noexcept
+{
+    const std::size_t count = std::min({max_count, max_selected, scores.size()});
+
+    // a partial insertion sort over a handful of slots
+    std::size_t selected = 0;
+    for (std::size_t i = 0; i < scores.size(); ++i) {
+        std::size_t slot = selected;
+        while (slot > 0 && scores[i] < scores[best[slot - 1]]) {
+            if (slot < count)
+                best[slot] = best[slot - 1];
+            --slot;
+        }
+
+        if (slot < count) {
+            best[slot] = i;
+            selected = std::min(selected + 1, count);
+        }
+    }
+
+    return selected;
+}
+
+} // namespace simulacrum
@@ -0,0 +1,105 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <functional>
+#include <vector>
+
+#include <sentinel/types.hpp>
+#include <sentinel/structures/player.hpp>
+
+namespace simulacrum {
+
+struct OrientationContext;
+struct ProjectileContext;
+
+/** \brief Scores every candidate target at once, so that only the best few need be
+ *         tested by the more expensive marker lookups and ray casts.
+ *
+ * Candidates are kept in structure-of-arrays form. A score is a cost in world units,
+ * the lowest being the best target, and sums the distance to the target with weighted
+ * penalties for the turn of the aim towards it, the travel time of a projectile to it
+ * and whether it is hidden by the coarse visibility table.
+ *
+ * The storage of the arrays is kept between ticks.
+ */
+class target_scorer {
+public:
+    static constexpr std::size_t max_selected = 2; ///< The most candidates #select yields.
+
+    /** \brief The weights of the penalties in a score.
+     */
+    struct weights_type {
+        sentinel::real turn         = 6.0f;  ///< Per unit of turn offset, see
+                                             ///< math::get_target_offsets.
+        sentinel::real travel_time  = 0.25f; ///< Per tick of projectile travel time.
+        sentinel::real hidden       = 10.0f; ///< For candidates that are not visible.
+        sentinel::real out_of_range = 20.0f; ///< For candidates projectiles cannot reach.
+    };
+
+    /** \brief Discards the candidates, keeping the storage of the arrays.
+     */
+    void clear() noexcept;
+
+    /** \brief Appends \a player at \a position as a candidate.
+     *
+     * \param[in] maybe_visible `false` if the candidate is known to be hidden.
+     */
+    void push_back(sentinel::player& player,
+                   const sentinel::real3d& position,
+                   bool maybe_visible);
+
+    /** \brief Scores the candidates as seen from \a source.
+     *
+     * \param[in] projectile    The projectile fired, or `nullptr` to ignore travel time.
+     * \param[in] initial_speed The initial speed of the projectile.
+     */
+    void score(const sentinel::real3d&   source,
+               const OrientationContext& orientation,
+               const ProjectileContext*  projectile,
+               sentinel::real            initial_speed,
+               const weights_type&       weights);
+
+    /** \brief Finds the best scored candidates, up to \a max_count and #max_selected.
+     *
+     * \param[out] out The output iterator receiving references to the players, the
+     *                 best first.
+     * \return The number of players written to \a out.
+     */
+    template<class OutputIt>
+    std::size_t select(std::size_t max_count, OutputIt out) const
+    {
+        std::size_t best[max_selected];
+        const std::size_t count = select_indices(max_count, best);
+        for (std::size_t i = 0; i < count; ++i)
+            *out++ = std::ref(*players[best[i]]);
+        return count;
+    }
+
+    /** \brief Returns the number of candidates.
+     */
+    std::size_t size() const noexcept { return players.size(); }
+
+    bool empty() const noexcept { return players.empty(); }
+
+private:
+    std::vector<sentinel::player*> players;
+    std::vector<sentinel::real>    x;
+    std::vector<sentinel::real>    y;
+    std::vector<sentinel::real>    z;
+    std::vector<std::uint8_t>      visible;
+    std::vector<sentinel::real>    distances;
+    std::vector<sentinel::real>    turn_offsets;
+    std::vector<sentinel::real>    scores;
+
+    std::size_t select_indices(std::size_t max_count, std::size_t* best) const noexcept;
+};
+
+} // namespace simulacrum
@@ -0,0 +1,123 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "trace.hpp"
+
+#include <algorithm>
+
+namespace {
+
+/** \brief The version of the trace file format.
+ *
+ * This must be incremented whenever the layout of the file or its records changes.
+ */
+constexpr std::uint32_t file_version = 2;
+
+constexpr char file_magic[8] = {'S', 'I', 'M', 'T', 'R', 'A', 'C', 'E'};
+
+/** \brief The header of a trace file, which is followed by the map name.
+ */
+struct file_header {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t frame_size;  ///< `sizeof` the frame header, as a layout check.
+    std::uint32_t player_size; ///< `sizeof` the player record, as a layout check.
+    std::uint32_t map_name_length;
+    std::uint64_t geometry_key;
+};
+
+} // namespace (anonymous)
+
+namespace simulacrum { namespace trace {
+
+bool recorder::open(const std::string& filename,
+                    std::string_view   map_name,
+                    std::uint64_t      geometry_key)
+{
+    close();
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    file_header header = {};
+    std::copy(std::begin(file_magic), std::end(file_magic), header.magic);
+    header.version         = file_version;
+    header.frame_size      = sizeof(frame_header);
+    header.player_size     = sizeof(player_record);
+    header.map_name_length = static_cast<std::uint32_t>(map_name.size());
+    header.geometry_key    = geometry_key;
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(map_name.data(), map_name.size());
+    if (!out) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void recorder::close()
+{
+    if (out.is_open())
+        out.close();
+    out.clear();
+    frames = 0;
+}
+
+bool recorder::record(frame& f)
+{
+    if (!out.is_open())
+        return false;
+
+    f.header.tick         = frames;
+    f.header.player_count = static_cast<std::uint32_t>(f.players.size());
+    out.write(reinterpret_cast<const char*>(&f.header), sizeof(f.header));
+    out.write(reinterpret_cast<const char*>(f.players.data()),
+              f.players.size() * sizeof(player_record));
+    if (!out) {
+        close();
+        return false;
+    }
+
+    ++frames;
+    return true;
+}
+
+bool reader::open(const std::string& filename)
+{
+    in.close();
+    in.clear();
+    map.clear();
+    geometry = 0;
+    in.open(filename, std::ios::binary);
+    if (!in)
+        return false;
+
+    file_header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || !std::equal(std::begin(file_magic), std::end(file_magic), header.magic)
+        || header.version != file_version
+        || header.frame_size != sizeof(frame_header)
+        || header.player_size != sizeof(player_record))
+        return false;
+
+    geometry = header.geometry_key;
+    map.resize(header.map_name_length);
+    return static_cast<bool>(in.read(map.data(), map.size()));
+}
+
+bool reader::next(frame& f)
+{
+    if (!in.read(reinterpret_cast<char*>(&f.header), sizeof(f.header)))
+        return false;
+
+    f.players.resize(f.header.player_count);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(f.players.data()),
+                                     f.players.size() * sizeof(player_record)));
+}
+
+} } // namespace simulacrum::trace
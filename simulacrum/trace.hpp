@@ -0,0 +1,160 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <sentinel/types.hpp>
+#include <sentinel/structures/controls.hpp>
+
+namespace simulacrum { namespace trace {
+
+/** \brief The state of a remote player in a frame.
+ */
+struct player_record {
+    sentinel::identity_raw unit;     ///< The identity of the player's unit.
+    std::int32_t           team;
+    std::uint8_t           flags;    ///< The PlayerSnapshot flags of the player.
+    bool                   has_body; ///< Whether #body was found on the unit's model.
+    sentinel::real3d       position; ///< Unspecified for dead players.
+    sentinel::real3d       velocity; ///< Of the unit or, for units in vehicles, of the
+                                     ///< vehicle. Unspecified for dead players.
+    sentinel::real3d       body;     ///< The position of the unit's body marker, which
+                                     ///< targets are aimed at, if #has_body is set.
+};
+
+/** \brief The parameters of the projectile fired by the weapon held, from which the
+ *         projectile context read by targeting and aiming is built.
+ */
+struct projectile_record {
+    static constexpr std::uint8_t flag_present = 1; ///< A weapon with a projectile is held.
+    static constexpr std::uint8_t flag_lerps   = 2; ///< The projectile changes speed.
+
+    std::uint8_t flags;
+    float        speed_muzzle;
+    float        speed_final;
+    float        damage_range_min;
+    float        damage_range_max;
+    float        detonation_range;
+};
+
+/** \brief The fixed-size part of a frame.
+ */
+struct frame_header {
+    static constexpr std::uint8_t flag_enabled  = 1; ///< The AI and control ran.
+    static constexpr std::uint8_t flag_alive    = 2; ///< The local player has a unit.
+    static constexpr std::uint8_t flag_can_fire = 4; ///< The primary trigger may be fired.
+
+    std::uint32_t          tick;            ///< The index of the frame in the trace.
+    std::int32_t           ticks;           ///< The ticks passed to the controls filter.
+    float                  seconds;         ///< The seconds passed to the controls filter.
+    std::uint8_t           flags;
+    float                  yaw;
+    float                  pitch;
+    std::int32_t           ticks_since_fired;
+    sentinel::identity_raw weapon_tag;      ///< The tag of the weapon held, if any.
+    sentinel::real3d       local_position;
+    sentinel::real3d       local_velocity;
+    sentinel::real3d       aim_forward;
+    projectile_record      projectile;
+    std::uint32_t          player_count;    ///< The number of player records that follow.
+
+    sentinel::digital_controls_state digital; ///< The controls output.
+    sentinel::analog_controls_state  analog;  ///< The controls output.
+
+    std::uint32_t update_microseconds; ///< The time spent in the AI and control.
+};
+
+static_assert(std::is_trivially_copyable_v<player_record>
+              && std::is_trivially_copyable_v<projectile_record>
+              && std::is_trivially_copyable_v<frame_header>,
+              "trace records must be trivially copyable to be written as they are");
+
+/** \brief A capture of what a tick of the AI and control read, and of what they output.
+ */
+struct frame {
+    frame_header               header;
+    std::vector<player_record> players;
+};
+
+/** \brief Writes frames to a trace file.
+ *
+ * A trace file is a header naming the map and identifying its collision geometry,
+ * followed by each frame header and its player records. Records are written in the
+ * layout of the host, so traces are read back by builds for the same architecture.
+ */
+class recorder {
+public:
+    /** \brief Starts a trace of \a map_name at \a filename, ending any trace open.
+     *
+     * \param[in] geometry_key Identifies the collision BSP and scenery of the map, such
+     *                         as a key obtained through #navigation_graph_key.
+     * \return `true` if the file was opened, otherwise `false`.
+     */
+    bool open(const std::string& filename,
+              std::string_view   map_name,
+              std::uint64_t      geometry_key);
+
+    /** \brief Ends the trace open, if any.
+     */
+    void close();
+
+    bool is_open() const { return out.is_open(); }
+
+    /** \brief Appends \a f to the trace, numbering it by the frames written so far.
+     *
+     * \return `true` if the frame was written, otherwise `false`, which ends the trace.
+     */
+    bool record(frame& f);
+
+    /** \brief Returns the number of frames written to the trace open.
+     */
+    std::uint32_t frame_count() const noexcept { return frames; }
+
+private:
+    std::ofstream out;
+    std::uint32_t frames = 0;
+};
+
+/** \brief Reads frames from a trace file written by #recorder.
+ */
+class reader {
+public:
+    /** \brief Opens the trace at \a filename.
+     *
+     * \return `true` if the file is a trace of this version, otherwise `false`.
+     */
+    bool open(const std::string& filename);
+
+    /** \brief Returns the name of the map the trace was recorded on.
+     */
+    const std::string& map_name() const noexcept { return map; }
+
+    /** \brief Returns the key of the collision geometry the trace was recorded over.
+     */
+    std::uint64_t geometry_key() const noexcept { return geometry; }
+
+    /** \brief Reads the next frame to \a f, reusing its storage.
+     *
+     * \return `true` if a frame was read, or `false` at the end of the trace.
+     */
+    bool next(frame& f);
+
+private:
+    std::ifstream in;
+    std::string   map;
+    std::uint64_t geometry = 0;
+};
+
+} } // namespace simulacrum::trace
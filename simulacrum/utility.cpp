@@ -5,39 +5,11 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "utility.hpp"
-#include "math.hpp"
-
-#include <algorithm>
 
 #include <sentutil/all.hpp>
 
 namespace simulacrum {
 
-bool intersects_coll_pathfinding_spheres(const sentinel::position3d&  segment_begin,
-                                         const sentinel::direction3d& segment_direction,
-                                         const sentinel::real&        segment_length,
-                                         const sentinel::object&      object,
-                                         const sentinel::tags::collision_model& coll)
-{
-    using math::intersects_segment_sphere;
-    using pathfinding_sphere = sentinel::tags::collision_model::pathfinding_sphere;
-    auto test_sphere = [&segment_begin, &segment_direction, &segment_length, &object]
-                       (const pathfinding_sphere& sphere) {
-        const sentinel::real3d center = sphere.node < 0
-            ? object.object.position + sphere.center
-            : object.object.node_transforms[sphere.node] * sphere.center;
-        return intersects_segment_sphere(segment_begin,
-                                         segment_direction,
-                                         segment_length,
-                                         center,
-                                         sphere.radius); // should scale but its ok
-    };
-
-    return std::any_of(coll.pathfinding.spheres.begin(),
-                       coll.pathfinding.spheres.end(),
-                       test_sphere);
-}
-
 void visit_map_scenery(const std::function<void(sentinel::object&, sentinel::tags::object&)>& visitor){
     [[maybe_unused]]
     constexpr auto object_type_biped   = 0;
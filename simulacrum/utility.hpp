@@ -16,9 +16,14 @@
 #include <boost/iterator/transform_iterator.hpp>
 
 #include <sentinel/types.hpp>
-#include <sentinel/structures/object.hpp>
-#include <sentinel/tags/object.hpp>
-#include <sentinel/tags/collision_model.hpp>
+
+namespace sentinel {
+    struct object;
+
+    namespace tags {
+        struct object;
+    }
+}
 
 namespace simulacrum {
 
@@ -59,12 +64,6 @@ rough_span<
             boost::transform_iterator(count_end,   f)};
 }
 
-bool intersects_coll_pathfinding_spheres(const sentinel::position3d&  segment_begin,
-                                         const sentinel::direction3d& segment_direction,
-                                         const sentinel::real&        segment_length,
-                                         const sentinel::object&      object,
-                                         const sentinel::tags::collision_model& coll);
-
 /** \brief Calls \a visitor on each scenery object on the current map, additionally
  *         supplying the object's tag.
  */
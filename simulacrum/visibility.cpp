@@ -0,0 +1,183 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "visibility.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <bitset>
+
+#include <sentutil/collision.hpp>
+
+namespace simulacrum {
+
+cluster_visibility::cluster_visibility(const navigation_hierarchy&          hierarchy,
+                                       const navigation_graph&              nav_graph,
+                                       const sentinel::tags::collision_bsp& cbsp)
+    : clusters(hierarchy.cluster_count())
+    , words_per_row((hierarchy.cluster_count() + 63) / 64)
+    , bits(clusters * words_per_row, 0)
+{
+    const graph_type& graph = nav_graph.get_graph();
+
+    // samples are spread over the vertices of each cluster in index order
+    std::vector<std::vector<vertex_index>> members(clusters);
+    for (vertex_index vertex = 0; vertex < graph.size(); ++vertex)
+        members[hierarchy.cluster(vertex)].push_back(vertex);
+
+    std::vector<sentinel::real3d> samples;
+    std::vector<std::size_t>      sample_offsets(clusters + 1, 0);
+    for (std::size_t cluster = 0; cluster < clusters; ++cluster) {
+        const std::vector<vertex_index>& vertices = members[cluster];
+        const std::size_t count = std::min(samples_per_cluster, vertices.size());
+        for (std::size_t i = 0; i < count; ++i) {
+            const vertex_index vertex = vertices[(2 * i + 1) * vertices.size() / (2 * count)];
+            samples.push_back(graph.node(vertex).point + sentinel::real3d{0.0f, 0.0f, eye_height});
+        }
+        sample_offsets[cluster + 1] = samples.size();
+    }
+
+    auto sees = [&] (std::size_t a, std::size_t b) {
+        for (std::size_t i = sample_offsets[a]; i < sample_offsets[a + 1]; ++i) {
+            for (std::size_t j = sample_offsets[b]; j < sample_offsets[b + 1]; ++j) {
+                if (!sentutil::collision::test_segment(cbsp, samples[i], samples[j] - samples[i]))
+                    return true;
+            }
+        }
+        return false;
+    };
+
+    // each chunk fills the upper triangle of its own rows, which is mirrored after
+    parallel_chunks{8}(clusters, [&] (std::size_t, std::size_t first, std::size_t last) {
+        for (std::size_t a = first; a < last; ++a) {
+            std::uint64_t* row = &bits[a * words_per_row];
+            row[a / 64] |= std::uint64_t(1) << (a % 64);
+            for (std::size_t b = a + 1; b < clusters; ++b) {
+                if (sees(a, b))
+                    row[b / 64] |= std::uint64_t(1) << (b % 64);
+            }
+        }
+    });
+
+    for (std::size_t a = 0; a < clusters; ++a) {
+        for (std::size_t b = a + 1; b < clusters; ++b) {
+            if (maybe_visible(a, b))
+                bits[b * words_per_row + a / 64] |= std::uint64_t(1) << (a % 64);
+        }
+    }
+
+    // the samples miss lines of sight, so a pair is also marked visible if any pair of
+    // clusters adjacent to them was, by dilating the rows and then the columns
+    std::vector<std::vector<cluster_index>> neighbours(clusters);
+    for (vertex_index vertex = 0; vertex < graph.size(); ++vertex) {
+        const cluster_index cluster = hierarchy.cluster(vertex);
+        for (const auto& edge : graph.egress_edges(vertex)) {
+            if (hierarchy.cluster(edge.target) != cluster)
+                neighbours[cluster].push_back(hierarchy.cluster(edge.target));
+        }
+    }
+
+    for (auto& adjacent : neighbours) {
+        std::sort(adjacent.begin(), adjacent.end());
+        adjacent.erase(std::unique(adjacent.begin(), adjacent.end()), adjacent.end());
+    }
+
+    auto dilate_rows = [this, &neighbours] (const std::vector<std::uint64_t>& matrix) {
+        std::vector<std::uint64_t> dilated(matrix);
+        for (std::size_t a = 0; a < clusters; ++a) {
+            for (cluster_index b : neighbours[a]) {
+                for (std::size_t word = 0; word < words_per_row; ++word)
+                    dilated[a * words_per_row + word] |= matrix[b * words_per_row + word];
+            }
+        }
+        return dilated;
+    };
+
+    auto transpose = [this] (const std::vector<std::uint64_t>& matrix) {
+        std::vector<std::uint64_t> transposed(matrix.size(), 0);
+        for (std::size_t a = 0; a < clusters; ++a) {
+            for (std::size_t b = 0; b < clusters; ++b) {
+                if ((matrix[a * words_per_row + b / 64] >> (b % 64)) & 1)
+                    transposed[b * words_per_row + a / 64] |= std::uint64_t(1) << (a % 64);
+            }
+        }
+        return transposed;
+    };
+
+    // the sampled matrix is symmetric, so the dilated matrix is too
+    bits = dilate_rows(transpose(dilate_rows(bits)));
+}
+
+std::size_t cluster_visibility::visible_pair_count() const noexcept
+{
+    std::size_t count = 0;
+    for (std::uint64_t word : bits)
+        count += std::bitset<64>(word).count();
+    return (count - clusters) / 2;
+}
+
+void ray_cache::clear() noexcept
+{
+    for (entry& e : entries)
+        e.occupied = false;
+}
+
+const bool* ray_cache::find(const sentinel::real3d& from,
+                            const sentinel::real3d& to,
+                            std::uint32_t tag) noexcept
+{
+    const auto key = make_key(from, to);
+    for (entry& e : entries) {
+        if (!e.occupied || e.tag != tag || e.key != key)
+            continue;
+
+        if (now - e.stored > max_age) {
+            e.occupied = false;
+            return nullptr;
+        }
+
+        e.last_used = ++uses;
+        return &e.visible;
+    }
+
+    return nullptr;
+}
+
+void ray_cache::insert(const sentinel::real3d& from,
+                       const sentinel::real3d& to,
+                       std::uint32_t tag,
+                       bool visible) noexcept
+{
+    const auto key = make_key(from, to);
+
+    // prefer the entry with the same key, then a free entry, then the least recently used
+    entry* victim = &entries[0];
+    for (entry& e : entries) {
+        if (e.occupied && e.tag == tag && e.key == key) {
+            victim = &e;
+            break;
+        } else if (!e.occupied) {
+            if (victim->occupied)
+                victim = &e;
+        } else if (victim->occupied && e.last_used < victim->last_used) {
+            victim = &e;
+        }
+    }
+
+    *victim = entry{key, tag, now, ++uses, visible, true};
+}
+
+std::array<std::int32_t, 6> ray_cache::make_key(const sentinel::real3d& from,
+                                                const sentinel::real3d& to) noexcept
+{
+    auto snap = [] (sentinel::real x) { return static_cast<std::int32_t>(std::floor(x / quantum)); };
+    return {snap(from[0]), snap(from[1]), snap(from[2]),
+            snap(to[0]),   snap(to[1]),   snap(to[2])};
+}
+
+} // namespace simulacrum
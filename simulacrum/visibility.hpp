@@ -0,0 +1,140 @@
+
+//          Copyright surrealwaffle 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <vector>
+
+#include <sentinel/types.hpp>
+#include <sentinel/tags/collision_bsp.hpp>
+
+#include "graph.hpp"
+#include "hierarchy.hpp"
+
+namespace simulacrum {
+
+/** \brief A coarse table of which clusters of a #navigation_hierarchy may see each
+ *         other, sampled by segment tests against the collision BSP.
+ *
+ * Each cluster is represented by up to #samples_per_cluster of its vertices, lifted to
+ * eye height. Two clusters are visible to each other if any segment between the
+ * samples of either cluster or its adjacent clusters passes through the structure
+ * unobstructed. The table is a bit matrix, so a query is a single lookup.
+ *
+ * The neighbouring samples cover most of the lines of sight that a cluster's own
+ * samples miss, such as those past the corners at its boundary, but as the table is
+ * still sampled, a pair marked as hidden may rarely see each other.
+ * A cluster is always visible to itself.
+ */
+class cluster_visibility {
+public:
+    using graph_type    = navigation_graph::graph_type;
+    using vertex_index  = graph_type::vertex_index;
+    using cluster_index = navigation_hierarchy::cluster_index;
+
+    static constexpr std::size_t    samples_per_cluster = 3;
+    static constexpr sentinel::real eye_height          = 0.6f;
+
+    cluster_visibility() = default;
+
+    /** \brief Builds the table over the clusters of \a hierarchy, testing segments
+     *         against \a cbsp.
+     *
+     * The build is split across threads, so it is meant to be run off the game thread.
+     */
+    cluster_visibility(const navigation_hierarchy&          hierarchy,
+                       const navigation_graph&              nav_graph,
+                       const sentinel::tags::collision_bsp& cbsp);
+
+    /** \brief Returns the number of clusters in the table.
+     */
+    std::size_t cluster_count() const noexcept { return clusters; }
+
+    /** \brief Returns `true` if cluster \a a may see cluster \a b.
+     *
+     * Clusters outside of the table are assumed to be visible.
+     */
+    bool maybe_visible(cluster_index a, cluster_index b) const noexcept
+    {
+        if (a >= clusters || b >= clusters)
+            return true;
+        return (bits[a * words_per_row + b / 64] >> (b % 64)) & 1;
+    }
+
+    /** \brief Returns the number of pairs of distinct clusters marked visible.
+     */
+    std::size_t visible_pair_count() const noexcept;
+
+private:
+    std::size_t clusters      = 0;
+    std::size_t words_per_row = 0;
+
+    std::vector<std::uint64_t> bits; ///< The rows of the matrix, by cluster.
+};
+
+/** \brief A small cache of the results of exact visibility tests between points, which
+ *         are expected to repeat over consecutive ticks.
+ *
+ * Entries are keyed by their endpoints snapped to a grid #quantum units across and by
+ * a caller-supplied tag, such as the identity of the target object. Entries expire
+ * #max_age ticks after they were stored, as the objects that obstruct the tests move.
+ * The cache is small enough that lookups are linear scans.
+ */
+class ray_cache {
+public:
+    static constexpr std::size_t    capacity = 64;
+    static constexpr sentinel::real quantum  = 0.25f;
+    static constexpr long           max_age  = 3;
+
+    /** \brief Advances the age of the entries by \a ticks.
+     */
+    void advance(long ticks) noexcept { now += ticks; }
+
+    /** \brief Discards all entries.
+     */
+    void clear() noexcept;
+
+    /** \brief Finds the result of a test from \a from to \a to.
+     *
+     * \return A pointer to the result stored, or `nullptr` if there is no such
+     *         unexpired entry.
+     */
+    const bool* find(const sentinel::real3d& from,
+                     const sentinel::real3d& to,
+                     std::uint32_t tag) noexcept;
+
+    /** \brief Stores the result of a test from \a from to \a to, evicting the least
+     *         recently used entry if the cache is full.
+     */
+    void insert(const sentinel::real3d& from,
+                const sentinel::real3d& to,
+                std::uint32_t tag,
+                bool visible) noexcept;
+
+private:
+    struct entry {
+        std::array<std::int32_t, 6> key;
+        std::uint32_t               tag;
+        long                        stored;    ///< The tick the result was stored on.
+        std::uint64_t               last_used; ///< The value of #uses when the entry
+                                               ///< was last found or stored.
+        bool                        visible;
+        bool                        occupied = false;
+    };
+
+    long                        now  = 0;
+    std::uint64_t               uses = 0;
+    std::array<entry, capacity> entries;
+
+    static std::array<std::int32_t, 6> make_key(const sentinel::real3d& from,
+                                                const sentinel::real3d& to) noexcept;
+};
+
+} // namespace simulacrum